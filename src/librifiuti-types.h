@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2007-2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+/*
+ * Types shared between parsing library and its users. Installed
+ * along with librifiuti.h, so nothing internal belongs here.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+
+/* Only symbols marked with this are exported from shared library */
+#if defined(__GNUC__) && ! defined(_WIN32)
+#define R2_API __attribute__((visibility ("default")))
+#else
+#define R2_API
+#endif
+
+typedef enum
+{
+    R2_FATAL_ERROR_LIVE_UNSUPPORTED,  /* Can't detect live system env */
+    R2_FATAL_ERROR_ILLEGAL_DATA,  /* all data broken, not empty bin */
+    R2_FATAL_ERROR_TEMPFILE,
+    R2_FATAL_ERROR_STATE_FILE,  /* Can't read or write scan state */
+    R2_FATAL_ERROR_TRACE_FILE,  /* Can't write trace events */
+    R2_FATAL_ERROR_METRICS_FILE,  /* Can't write metrics */
+    R2_FATAL_ERROR_SQLITE,  /* Can't write SQLite database */
+
+} R2FatalError;
+
+/**
+ * @brief Per record non-fatal error
+ * @note Some error may indicate the whole record is invalidated,
+ * but there also exists very minor error that doesn't.
+ */
+typedef enum
+{
+    R2_REC_ERROR_DRIVE_LETTER,
+    R2_REC_ERROR_DUBIOUS_TIME,
+    R2_REC_ERROR_DUBIOUS_PATH,
+    R2_REC_ERROR_CONV_PATH,
+    R2_REC_ERROR_IDX_SIZE_INVALID,
+    R2_REC_ERROR_VER_UNSUPPORTED,  /* ($Recycle.bin) bad version */
+    R2_REC_ERROR_HASH_PAYLOAD,  /* ($Recycle.bin) can't read trashed file */
+
+} R2RecordError;
+
+// our own error domains
+
+#define R2_FATAL_ERROR (rifiuti_fatal_error_quark ())
+R2_API
+GQuark rifiuti_fatal_error_quark (void);
+
+#define R2_REC_ERROR (rifiuti_record_error_quark ())
+R2_API
+GQuark rifiuti_record_error_quark (void);
+
+typedef enum
+{
+    RECYCLE_BIN_TYPE_UNKNOWN = 0,
+    RECYCLE_BIN_TYPE_FILE,
+    RECYCLE_BIN_TYPE_DIR,
+} rbin_type;
+
+/* The first 4 or 8 bytes of recycle bin index files */
+typedef enum
+{
+    /* negative number = error */
+
+    VERSION_INCONSISTENT = -2,  /* Mixed versions in same folder */
+    VERSION_NOT_FOUND,  /* Empty $Recycle.bin */
+
+    /* $Recycle.bin */
+
+    VERSION_VISTA = 1,
+    VERSION_WIN10,
+
+    /* INFO / INFO2 */
+
+    VERSION_WIN95 = 0,
+    VERSION_NT4   = 2,
+    VERSION_WIN98 = 4,
+    VERSION_ME_03,
+} detected_os_ver;
+
+
+/* Fields which can be selected for output */
+typedef enum
+{
+    OUT_FIELD_INDEX = 0,
+    OUT_FIELD_TIME,
+    OUT_FIELD_GONE,
+    OUT_FIELD_SIZE,
+    OUT_FIELD_PATH,
+    OUT_FIELD_HASH,  /* only available when payload hashing is requested */
+    OUT_FIELD_INDEX_HASH,  /* only available when index hashing is requested */
+    OUT_FIELD_MAX
+} out_field;
+
+/**
+ * @brief Whether original trashed file still exists
+ */
+typedef enum
+{
+    FILESTATUS_UNKNOWN = 0,
+    FILESTATUS_EXISTS,
+    FILESTATUS_GONE
+} trash_file_status;
+
+/**
+ * @brief Field used for sorting records
+ * @note Natural order is the order of records inside `INFO2`
+ * file, or by deletion time for `$Recycle.bin`.
+ */
+typedef enum
+{
+    SORT_NATURAL,
+    SORT_TIME,
+    SORT_SIZE,
+    SORT_INDEX
+} sort_field;
+
+typedef struct _parse_opts parse_opts;
+typedef struct _path_store path_store;
+
+/**
+ * @brief Metadata for recycle bin
+ * @note This is a merge of `INFO2` and `$Recycle.bin` elements.
+ */
+typedef struct _rbin_meta
+{
+    rbin_type type;  /* `INFO2` or `$Recycle.bin` format */
+    char *filename;  /* File or dir name of trash can itself */
+    /**
+     * @brief The global recycle bin version
+     * @note For `INFO2`, the value is stored in certain bytes of `INFO2` index file.
+     * For `$Recycle.bin`, it is determined collectively from all index files within
+     * the folder.
+     */
+    int64_t version;
+    /**
+     * @brief Size of each trash record within index file
+     * @note It is either 280 or 800 bytes, depending on Windows version
+     * @attention For `INFO2` only. `$Recycle.bin` has only one record per file.
+     */
+    uint32_t recordsize;
+    /**
+     * @brief Total entry ever existed in `INFO2` file
+     * @note On Windows 95 and NT 4.x, `INFO2` keeps a field for counting number
+     * of trashed entries. The field is unused afterwards.
+     * @attention For `INFO2` only
+     */
+    uint32_t total_entry;
+    /**
+     * @brief Whether empty spaces in index file was padded with junk data
+     * @note For Windows 98, ME and 2000, paths and fields are not padded with
+     * zero filled memory, but with arbitrary random data, presumably memory
+     * segments due to sloppy programming practice.
+     * @attention For `INFO2` only
+     */
+    bool fill_junk;
+    /**
+     * @brief List of trash file records pointer
+     */
+    GPtrArray *records;
+    /**
+     * @brief List of invalid records and their errors
+     */
+    GHashTable *invalid_records;
+    /**
+     * @brief Number of records dropped by record filter or limit
+     * @note Such records are valid, merely not wanted by user
+     */
+    uint32_t filtered;
+    /**
+     * @brief Storage of interned directory components of paths
+     * @note `NULL` unless path interning is requested, in which
+     * case record paths only keep their last component.
+     */
+    path_store *paths;
+    /**
+     * @brief Settings used when parsing this recycle bin
+     */
+    const parse_opts *opts;
+    /**
+     * @brief Full path of all index files to be parsed
+     */
+    GPtrArray *idxfiles;
+    /**
+     * @brief Content of index files preloaded into memory as `GBytes`,
+     * in the same order as `idxfiles`
+     * @note `NULL` unless preloaded, in which case index files are
+     * parsed from memory instead of being read again
+     */
+    GPtrArray *idxdata;
+    /**
+     * @brief Whether a single `$Recycle.bin` index file is taken
+     * out of its original folder, so that trash file status is unknown
+     */
+    bool isolated_index;
+    /**
+     * @brief Digest of whole index file, prefixed with algorithm name
+     * @note `NULL` unless index hashing is requested, or if index
+     * file can't be fully read
+     * @attention For `INFO2` only. Each `$Recycle.bin` record keeps
+     * digest of its own index file.
+     */
+    char *index_hash;
+
+} metarecord;
+
+/**
+ * @brief Structure for single recycle bin item
+ * @note This is a merge of `INFO2` and `$Recycle.bin` elements.
+ */
+typedef struct _rbin_struct
+{
+    /**
+     * @brief version of each index file
+     * @note `meta.version` keeps the global status of whole dir,
+     * while this one keeps individual version of index file.
+     * @attention For `$Recycle.bin` only
+     */
+    uint64_t version;
+    /**
+     * @brief Chronological index number for INFO2
+     * @attention For `INFO2` only
+     */
+    uint32_t index_n;
+
+    /**
+     * @brief Index file name
+     * @attention For `$Recyle.bin` only
+     */
+    char *index_s;
+
+    GDateTime *deltime;  /* Item trashing time */
+
+    /**
+     * @brief Trashed time (`deltime`) stored as Windows datetime integer
+     * @note For internal entry sorting in `$Recycle.bin`. `INFO2` records sort using `index_n` field.
+     */
+    int64_t winfiletime;
+
+    /**
+     * @brief Trashed file size
+     * @note Can mean cluster size or actual file/folder size,
+     * depending on Recycle bin version. Not invertigated
+     * thoroughly yet.
+     */
+    uint64_t filesize;
+
+    /**
+     * @brief Original path of trashed file, in unicode
+     * @note Original path was stored in index file in UTF-16
+     * encoding since Windows 2000. The raw UTF-16 data is
+     * stored here. `GString` structure is chosen for
+     * convenience in storing buffer length, which can't be
+     * easily determined from null termination when path data
+     * is truncated (due to broken file)
+     */
+    GString *raw_uni_path;
+
+    /**
+     * @brief Original path of trashed file, in ANSI code page
+     * @note Until Windows 2003, index file preserves trashed file
+     * path in ANSI code page. The raw path is stored here.
+     * @attention For `INFO2` only. Can be either full path or
+     * 8.3 format, depending on Windows version and code page used.
+     */
+    GString *raw_legacy_path;
+
+    /**
+     * @brief Interned directory of `raw_uni_path` and `raw_legacy_path`
+     * @note Only meaningful when `meta.paths` is in use, where
+     * the raw path fields hold last path component only.
+     * Use `PATH_STORE_ROOT` if path has no directory part.
+     */
+    uint32_t uni_dir;
+    uint32_t legacy_dir;
+
+    /**
+     * @brief Whether original trashed file is gone
+     * @note Trash file can be detected if it still exists, but via very
+     * different mechanisms on different formats. For `INFO2`, one can
+     * only deduce if it is either permanently removed, or restored on
+     * filesystem. For `$Recycle.bin`, it is guaranteed to be restored
+     * if `$R...` named trashed file doesn't exist in folder.
+     */
+    trash_file_status gone;
+    /**
+     * @brief Drive letter for removed trash entry
+     * @note If `INFO2` entry is marked as gone, first letter of original
+     * path is removed and stored elsewhere, which corresponds to drive letter.
+     * @attention For `INFO2` only
+     */
+    unsigned char drive;
+    /**
+     * @brief Error associated with this trash entry
+     */
+    GError *error;
+
+    /**
+     * @brief Full path of trashed file, kept for payload hashing only
+     * @attention For `$Recycle.bin` only
+     */
+    char *payload_path;
+    /**
+     * @brief Digest of trashed file or folder, prefixed with algorithm
+     * name, or `NULL` if not available
+     */
+    char *payload_hash;
+    /**
+     * @brief Digest of index file, prefixed with algorithm name
+     * @attention For `$Recycle.bin` only
+     */
+    char *index_hash;
+
+} rbin_struct;
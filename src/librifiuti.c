@@ -0,0 +1,993 @@
+/*
+ * Copyright (C) 2007-2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <glib/gi18n.h>
+
+#include "utils-conv.h"
+#include "utils-error.h"
+#include "utils-filter.h"
+#include "utils-hash.h"
+#include "utils-pathmatch.h"
+#include "utils-platform.h"
+#include "utils-stats.h"
+#include "utils.h"
+#include "librifiuti.h"
+
+/* Our own error domain */
+
+G_DEFINE_QUARK (rifiuti-fatal-error-quark, rifiuti_fatal_error)
+G_DEFINE_QUARK (rifiuti-record-error-quark, rifiuti_record_error)
+
+/**
+ * @brief Converts Windows FILETIME number to glib counterpart
+ * @param win_filetime The FILETIME integer to be converted
+ * @return `GDateTime` with UTC timezone
+ */
+GDateTime *
+win_filetime_to_gdatetime (int64_t win_filetime)
+{
+    int64_t t;
+
+    /* Let's assume we don't need subsecond time resolution */
+    t = (win_filetime - 116444736000000000LL) / 10000000;
+
+    g_debug ("FileTime -> Epoch: %" PRId64
+        " -> %" PRId64, win_filetime, t);
+
+    return g_date_time_new_from_unix_utc (t);
+}
+
+
+/**
+ * @brief Free all fields used in a single recycle bin record
+ * @param record Pointer to the record structure
+ */
+static void
+_free_record_cb (rbin_struct *record)
+{
+    g_free (record->index_s);
+    g_date_time_unref (record->deltime);
+    if (record->raw_uni_path)
+        g_string_free (record->raw_uni_path, TRUE);
+    if (record->raw_legacy_path)
+        g_string_free (record->raw_legacy_path, TRUE);
+    g_clear_error (&record->error);
+    g_free (record->payload_path);
+    g_free (record->payload_hash);
+    g_free (record->index_hash);
+    g_free (record);
+}
+
+
+/**
+ * @brief Allocate fresh metadata for a single recycle bin
+ * @param type Recycle bin type
+ * @param opts Parse settings, which must outlive the metadata
+ * @return The metadata, free with `meta_free()`
+ */
+metarecord *
+meta_new   (rbin_type          type,
+            const parse_opts  *opts)
+{
+    metarecord *m = g_malloc0 (sizeof (metarecord));
+
+    m->type = type;
+    m->version = VERSION_NOT_FOUND;
+    m->records = g_ptr_array_new ();
+    g_ptr_array_set_free_func (m->records, (GDestroyNotify) _free_record_cb);
+    m->invalid_records = g_hash_table_new_full (
+        g_str_hash,
+        g_str_equal,
+        (GDestroyNotify) g_free,
+        (GDestroyNotify) g_error_free
+    );
+    m->opts = opts;
+    m->idxfiles = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+    if (opts->intern_paths)
+        m->paths = path_store_new ();
+
+    return m;
+}
+
+
+void
+meta_free   (metarecord   *m)
+{
+    if (m == NULL)
+        return;
+
+    g_ptr_array_unref (m->records);
+    g_hash_table_destroy (m->invalid_records);
+    g_ptr_array_unref (m->idxfiles);
+    if (m->idxdata)
+        g_ptr_array_unref (m->idxdata);
+    path_store_free (m->paths);
+    g_free (m->filename);
+    g_free (m->index_hash);
+    g_free (m);
+}
+
+
+/**
+ * @brief Scan folder and add all index files for parsing
+ * @param list Pointer to file list to be modified
+ * @param path The folder to scan
+ * @param error Pointer to `GError` for error reporting
+ * @return `TRUE` on success, `FALSE` if folder can't be opened
+ */
+static bool
+_populate_index_file_list (GPtrArray   *list,
+                           const char  *path,
+                           GError     **error)
+{
+    GDir           *dir;
+    const char     *direntry;
+    GPatternSpec   *pattern1, *pattern2;
+
+    // g_dir_open() returns cryptic error message or even succeeds on Windows,
+    // when in fact the directory content is inaccessible.
+#ifdef G_OS_WIN32
+    if ( !can_list_win32_folder (path, error) ) {
+        return false;
+    }
+#endif
+
+    if (NULL == (dir = g_dir_open (path, 0, error)))
+        return false;
+
+    pattern1 = g_pattern_spec_new ("$I??????.*");
+    pattern2 = g_pattern_spec_new ("$I??????");
+
+    while ((direntry = g_dir_read_name (dir)) != NULL)
+    {
+#if GLIB_CHECK_VERSION (2, 70, 0)
+        if (!g_pattern_spec_match_string (pattern1, direntry) &&
+            !g_pattern_spec_match_string (pattern2, direntry))
+            continue;
+#else /* glib < 2.70 */
+        if (!g_pattern_match_string (pattern1, direntry) &&
+            !g_pattern_match_string (pattern2, direntry))
+            continue;
+#endif
+        g_ptr_array_add (list,
+            g_build_filename (path, direntry, NULL));
+    }
+
+    g_dir_close (dir);
+
+    g_pattern_spec_free (pattern1);
+    g_pattern_spec_free (pattern2);
+
+    return true;
+}
+
+
+/**
+ * @brief Search for desktop.ini in folder for hint of recycle bin
+ * @param path The searched path
+ * @return `TRUE` if `desktop.ini` found to contain recycle bin
+ *         identifier, `FALSE` otherwise
+ */
+static bool
+_found_desktop_ini (const char *path)
+{
+    char *filename = NULL, *content = NULL, *found = NULL;
+
+    filename = g_build_filename (path, "desktop.ini", NULL);
+    if (!g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+    {
+        g_free (filename);
+        return false;
+    }
+
+    if (g_file_get_contents (filename, &content, NULL, NULL))
+        /* Don't bother parsing, we don't use the content at all */
+        found = strstr (content, RECYCLE_BIN_CLSID);
+
+    g_free (content);
+    g_free (filename);
+    return (found != NULL);
+}
+
+
+/**
+ * @brief Add potentially valid index file(s) to list of metadata
+ * @param meta The metadata, whose `idxfiles` is appended to
+ * @param path The file or folder to be checked
+ * @param error A `GError` pointer to store potential problems
+ * @return `TRUE` if input file/dir is valid, `FALSE` otherwise
+ * @note `meta->isolated_index` is set if `path` is a single
+ * `$Recycle.bin` type index taken out of its original folder
+ * @attention Successful result does not imply files are appended
+ * to list, which is the case for empty recycle bin
+ */
+bool
+find_index_files (metarecord  *meta,
+                  const char  *path,
+                  GError     **error)
+{
+    GPtrArray  *list = meta->idxfiles;
+    rbin_type   type = meta->type;
+
+    g_debug ("Start checking path '%s'...", path);
+
+    g_return_val_if_fail (path != NULL, FALSE);
+
+    if (!g_file_test (path, G_FILE_TEST_EXISTS))
+    {
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+            _("'%s' does not exist."), path);
+        return FALSE;
+    }
+
+    if ((type == RECYCLE_BIN_TYPE_DIR) &&
+        g_file_test (path, G_FILE_TEST_IS_DIR))
+    {
+        stats_time  mark;
+        bool        ok;
+
+        stats_mark (meta->opts->stats, &mark);
+        ok = _populate_index_file_list (list, path, error);
+        stats_add_since (meta->opts->stats, STATS_PHASE_ENUMERATE, &mark);
+        if (! ok)
+            return FALSE;
+        /*
+         * last ditch effort: search for desktop.ini. Just print empty content
+         * representing empty recycle bin if found.
+         */
+        if (list->len == 0 && ! _found_desktop_ini (path))
+        {
+            g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+                _("No files with name pattern '%s' "
+                "are found in directory."), "$Ixxxxxx.*");
+            return FALSE;
+        }
+    }
+    else if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    {
+        if (type == RECYCLE_BIN_TYPE_DIR) {
+            char *parent_dir = g_path_get_dirname (path);
+            meta->isolated_index = ! _found_desktop_ini (parent_dir);
+            g_free (parent_dir);
+        }
+        g_ptr_array_add (list, g_strdup (path));
+    }
+    else
+    {
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+            (type == RECYCLE_BIN_TYPE_DIR) ?
+            _("'%s' is not a normal file or directory.") :
+            _("'%s' is not a normal file."), path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+#define _CMP(a, b) (((a) > (b)) - ((a) < (b)))
+
+/**
+ * @brief Compare records by sort field only, ignoring tie breaker
+ * @return Negative if `a` is printed before `b`, positive if
+ * after, 0 if equal or undecidable
+ * @note Only fixed fields are compared, so that it can be used
+ * on partially populated record.
+ */
+static int
+_compare_sort_field   (const metarecord    *meta,
+                       const rbin_struct   *a,
+                       const rbin_struct   *b)
+{
+    int diff = 0;
+
+    switch (meta->opts->sort_by)
+    {
+        case SORT_NATURAL:
+            if (meta->type == RECYCLE_BIN_TYPE_FILE)
+                return 0;
+            /* fall through */
+        case SORT_TIME:
+            diff = _CMP (a->winfiletime, b->winfiletime);
+            break;
+
+        case SORT_SIZE:
+        {
+            // Broken size is sorted as smallest
+            int64_t sa = (a->filesize == G_MAXUINT64) ? -1 : (int64_t) a->filesize;
+            int64_t sb = (b->filesize == G_MAXUINT64) ? -1 : (int64_t) b->filesize;
+            diff = _CMP (sa, sb);
+            break;
+        }
+
+        case SORT_INDEX:
+            if (meta->type == RECYCLE_BIN_TYPE_FILE)
+                diff = _CMP (a->index_n, b->index_n);
+            else if (a->index_s && b->index_s)
+                diff = strcmp (a->index_s, b->index_s);
+            break;
+
+        default: g_assert_not_reached ();
+    }
+
+    return meta->opts->sort_desc ? -diff : diff;
+}
+
+
+static int
+_compare_records   (const metarecord    *meta,
+                    const rbin_struct   *a,
+                    const rbin_struct   *b)
+{
+    int diff = _compare_sort_field (meta, a, b);
+
+    if (diff)
+        return diff;
+
+    return (meta->type == RECYCLE_BIN_TYPE_FILE) ?
+        _CMP (a->index_n, b->index_n) :
+        strcmp (a->index_s, b->index_s);
+}
+
+
+static int
+_sort_records_cb   (gconstpointer   left,
+                    gconstpointer   right,
+                    gpointer        meta)
+{
+    return _compare_records ((const metarecord *) meta,
+                             *((rbin_struct **) left),
+                             *((rbin_struct **) right));
+}
+
+
+/*
+ * With record limit, `meta->records` is kept as a binary max-heap
+ * during parsing, where top of heap is the kept record which would
+ * be printed last. It is turned into sorted array afterwards.
+ */
+
+static void
+_heap_swap   (GPtrArray   *heap,
+              guint        i,
+              guint        j)
+{
+    gpointer tmp = heap->pdata[i];
+    heap->pdata[i] = heap->pdata[j];
+    heap->pdata[j] = tmp;
+}
+
+
+static void
+_heap_sift_up   (const metarecord   *meta,
+                 guint               i)
+{
+    GPtrArray *heap = meta->records;
+
+    while (i > 0)
+    {
+        guint parent = (i - 1) / 2;
+        if (_compare_records (meta, heap->pdata[i], heap->pdata[parent]) <= 0)
+            break;
+        _heap_swap (heap, i, parent);
+        i = parent;
+    }
+}
+
+
+static void
+_heap_sift_down   (const metarecord   *meta,
+                   guint               i)
+{
+    GPtrArray *heap = meta->records;
+
+    while (true)
+    {
+        guint largest = i, l = 2 * i + 1, r = 2 * i + 2;
+
+        if (l < heap->len &&
+            _compare_records (meta, heap->pdata[l], heap->pdata[largest]) > 0)
+            largest = l;
+        if (r < heap->len &&
+            _compare_records (meta, heap->pdata[r], heap->pdata[largest]) > 0)
+            largest = r;
+        if (largest == i)
+            break;
+        _heap_swap (heap, i, largest);
+        i = largest;
+    }
+}
+
+
+static inline bool
+_limit_uses_heap   (const metarecord   *meta)
+{
+    return (meta->opts->record_limit > 0) &&
+        ! (meta->opts->sort_by == SORT_NATURAL &&
+           meta->type == RECYCLE_BIN_TYPE_FILE);
+}
+
+
+/**
+ * @brief Check if partially populated record can make it into output
+ * @param record The record, where only fixed fields are filled
+ * @return `false` if record limit has been reached, and the record
+ * would be sorted after all kept records
+ * @note This is meant to drop records before their paths are
+ * converted. Fields not yet available never cause a record to be
+ * dropped, final decision is left to `keep_record()`.
+ */
+bool
+may_keep_record   (const metarecord    *meta,
+                   const rbin_struct   *record)
+{
+    int limit = meta->opts->record_limit;
+
+    if (limit == 0 || meta->records->len < (guint) limit)
+        return true;
+
+    // INFO2 in natural order simply keeps first N records
+    if (! _limit_uses_heap (meta))
+        return false;
+
+    return _compare_sort_field (meta, record, meta->records->pdata[0]) <= 0;
+}
+
+
+/**
+ * @brief Add fully populated record to record list of metadata
+ * @param meta The metadata
+ * @param record The record, whose ownership is taken over
+ * @note If record limit is in effect, either the new record or
+ * the last kept record would be discarded when list is full.
+ */
+void
+keep_record   (metarecord    *meta,
+               rbin_struct   *record)
+{
+    GPtrArray *heap = meta->records;
+
+    if (! _limit_uses_heap (meta))
+    {
+        g_ptr_array_add (heap, record);
+        return;
+    }
+
+    if (heap->len < (guint) meta->opts->record_limit)
+    {
+        g_ptr_array_add (heap, record);
+        _heap_sift_up (meta, heap->len - 1);
+        return;
+    }
+
+    meta->filtered++;
+    if (_compare_records (meta, record, heap->pdata[0]) >= 0)
+    {
+        _free_record_cb (record);
+        return;
+    }
+
+    _free_record_cb (heap->pdata[0]);
+    heap->pdata[0] = record;
+    _heap_sift_down (meta, 0);
+}
+
+
+/**
+ * @brief Arrange records in requested order
+ * @note `INFO2` records in natural order are left untouched
+ */
+static void
+_sort_records   (metarecord   *meta)
+{
+    if (meta->opts->sort_by == SORT_NATURAL &&
+        meta->type == RECYCLE_BIN_TYPE_FILE)
+        return;
+
+    g_ptr_array_sort_with_data (meta->records, _sort_records_cb, meta);
+}
+
+
+
+/**
+ * @brief Get raw path of record which is intended for display
+ * @param meta The metadata which record belongs to
+ * @param record The record to retrieve path from
+ * @param expanded Location to store full path reconstructed from
+ * path store, which must be freed by caller if set
+ * @return Either the path stored in record itself, or `*expanded`
+ * if path interning is in effect
+ */
+const GString *
+record_get_raw_path   (const metarecord    *meta,
+                       const rbin_struct   *record,
+                       GString            **expanded)
+{
+    const GString *leaf;
+    uint32_t       dir_id;
+    const char    *legacy_encoding = meta->opts->legacy_encoding;
+
+    leaf   = legacy_encoding ? record->raw_legacy_path :
+                               record->raw_uni_path    ;
+    dir_id = legacy_encoding ? record->legacy_dir :
+                               record->uni_dir    ;
+
+    if (meta->paths == NULL || leaf == NULL)
+        return leaf;
+
+    *expanded = path_store_expand (meta->paths, dir_id, leaf);
+    return *expanded;
+}
+
+
+
+/**
+ * @brief Check if field is wanted by user of metadata
+ * @note Parsers may skip work for unwanted fields
+ */
+bool
+meta_wants_field   (const metarecord   *meta,
+                    out_field           field)
+{
+    return (meta->opts->fields & (1u << field)) != 0;
+}
+
+
+/**
+ * @brief Read all index files of recycle bin into memory
+ * @param meta The metadata, whose index files are already found
+ * @param error Location to store error upon failure
+ * @return `true` on success, `false` if any index file can't be read
+ * @note Later parsing doesn't touch index files anymore, so that
+ * it can be repeated without disk access
+ */
+bool
+load_index_files   (metarecord   *meta,
+                    GError      **error)
+{
+    GPtrArray *data;
+
+    g_return_val_if_fail (meta->idxdata == NULL, false);
+
+    data = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+    for (guint i = 0; i < meta->idxfiles->len; i++)
+    {
+        const char *path = g_ptr_array_index (meta->idxfiles, i);
+        char       *buf;
+        gsize       bufsize;
+        stats_time  mark;
+        bool        ok;
+
+        stats_mark (meta->opts->stats, &mark);
+        ok = g_file_get_contents (path, &buf, &bufsize, error);
+        stats_add_since (meta->opts->stats, STATS_PHASE_READ, &mark);
+        if (! ok)
+        {
+            g_ptr_array_unref (data);
+            return false;
+        }
+        stats_add_read (meta->opts->stats, bufsize);
+        g_ptr_array_add (data, g_bytes_new_take (buf, bufsize));
+    }
+
+    meta->idxdata = data;
+    return true;
+}
+
+
+/**
+ * @brief Parse all index files of recycle bin, and sort records
+ * @param meta The metadata, whose index files are already found
+ * @param error Location to store fatal error
+ * @return `true` on success, `false` if error is set
+ * @note Problems of individual records don't constitute fatal error,
+ * they are kept in `meta->invalid_records` and each record instead.
+ */
+bool
+parse_recycle_bin   (metarecord   *meta,
+                     GError      **error)
+{
+    for (guint i = 0; i < meta->idxfiles->len; i++)
+    {
+        const char *path = g_ptr_array_index (meta->idxfiles, i);
+
+        if (meta->idxdata)
+        {
+            gsize  size;
+            void  *buf = (void *) g_bytes_get_data (
+                g_ptr_array_index (meta->idxdata, i), &size);
+
+            if (meta->type == RECYCLE_BIN_TYPE_FILE)
+                parse_info2_buffer (path, buf, size, meta);
+            else
+                parse_vista_buffer (path, buf, size, meta);
+        }
+        else if (meta->type == RECYCLE_BIN_TYPE_FILE)
+            parse_info2_index (path, meta);
+        else
+            parse_vista_index (path, meta);
+    }
+
+    if (! meta->records->len && ! meta->filtered &&
+        g_hash_table_size (meta->invalid_records))
+    {
+        g_set_error_literal (error, R2_FATAL_ERROR,
+            R2_FATAL_ERROR_ILLEGAL_DATA,
+            _("No valid recycle bin record found"));
+        return false;
+    }
+
+    _sort_records (meta);
+
+    // Only records surviving sorting and limit are worth hashing
+    if (meta->opts->hash_payload)
+        hash_payloads (meta);
+
+    if (meta->version == VERSION_INCONSISTENT)
+    {
+        g_set_error_literal (error, R2_FATAL_ERROR,
+            R2_FATAL_ERROR_ILLEGAL_DATA,
+            _("Index files from multiple Windows versions are mixed together."
+            "  Please check each file individually."));
+        return false;
+    }
+
+    return true;
+}
+
+
+/* Library interface */
+
+struct _r2_ctx
+{
+    rbin_type       type;
+    parse_opts      opts;
+    char           *legacy_encoding;
+    record_filter  *where_filter;
+    path_matcher   *path_filter;
+    metarecord     *meta;
+};
+
+
+/**
+ * @brief Create parsing context for a kind of recycle bin
+ * @param type Either `RECYCLE_BIN_TYPE_FILE` for `INFO2`, or
+ * `RECYCLE_BIN_TYPE_DIR` for `$Recycle.bin`
+ * @return The context, free with `r2_ctx_free()`
+ * @note By default all fields are parsed, records are kept in
+ * natural order without limit.
+ */
+r2_ctx *
+r2_ctx_new   (rbin_type   type)
+{
+    r2_ctx *ctx;
+
+    g_return_val_if_fail (type == RECYCLE_BIN_TYPE_FILE ||
+        type == RECYCLE_BIN_TYPE_DIR, NULL);
+
+    ctx = g_malloc0 (sizeof (r2_ctx));
+    ctx->type = type;
+    ctx->opts.fields = (1u << OUT_FIELD_MAX) - 1;
+    ctx->opts.sort_by = SORT_NATURAL;
+
+    return ctx;
+}
+
+
+void
+r2_ctx_free   (r2_ctx   *ctx)
+{
+    if (ctx == NULL)
+        return;
+
+    meta_free (ctx->meta);
+    record_filter_free (ctx->where_filter);
+    path_matcher_free (ctx->path_filter);
+    g_free (ctx->legacy_encoding);
+    g_free (ctx);
+}
+
+
+/**
+ * @brief Specify code page of legacy paths
+ * @param ctx The context
+ * @param enc Windows code page, or `NULL` to use unicode paths only
+ * @param error Location to store error upon failure
+ * @return `false` if encoding is unusable
+ * @note Mandatory for `INFO2` from Windows ME or earlier. Must be
+ * set before `r2_ctx_set_path_patterns()`.
+ */
+bool
+r2_ctx_set_legacy_encoding   (r2_ctx       *ctx,
+                              const char   *enc,
+                              GError      **error)
+{
+    g_return_val_if_fail (ctx != NULL, false);
+
+    if (enc && ! enc_is_ascii_compatible (enc, error))
+        return false;
+
+    g_free (ctx->legacy_encoding);
+    ctx->legacy_encoding = g_strdup (enc);
+    ctx->opts.legacy_encoding = ctx->legacy_encoding;
+    return true;
+}
+
+
+/**
+ * @brief Only keep records matching filter expression
+ * @param ctx The context
+ * @param expr Filter expression, same as `--where` option;
+ * `NULL` removes filter
+ * @param localtime Whether dates in expression are in local time
+ * @param error Location to store error upon failure
+ * @return `false` if expression is invalid
+ */
+bool
+r2_ctx_set_filter   (r2_ctx       *ctx,
+                     const char   *expr,
+                     bool          localtime,
+                     GError      **error)
+{
+    record_filter *filter = NULL;
+
+    g_return_val_if_fail (ctx != NULL, false);
+
+    if (expr && ! (filter = record_filter_compile (expr,
+        ctx->type, localtime, error)))
+        return false;
+
+    record_filter_free (ctx->where_filter);
+    ctx->where_filter = filter;
+    ctx->opts.where_filter = filter;
+    return true;
+}
+
+
+/**
+ * @brief Only keep records whose path matches any pattern
+ * @param ctx The context
+ * @param globs Path globs, same as `--path-glob` option; can be `NULL`
+ * @param substrs Path substrings, same as `--path-substr` option;
+ * can be `NULL`
+ * @param error Location to store error upon failure
+ * @return `false` if any pattern is invalid
+ */
+bool
+r2_ctx_set_path_patterns   (r2_ctx        *ctx,
+                            char * const  *globs,
+                            char * const  *substrs,
+                            GError       **error)
+{
+    path_matcher *matcher;
+    GError       *err = NULL;
+
+    g_return_val_if_fail (ctx != NULL, false);
+
+    matcher = path_matcher_compile (globs, substrs,
+        ctx->legacy_encoding, &err);
+    if (err)
+    {
+        g_propagate_error (error, err);
+        return false;
+    }
+
+    path_matcher_free (ctx->path_filter);
+    ctx->path_filter = matcher;
+    ctx->opts.path_filter = matcher;
+    return true;
+}
+
+
+/**
+ * @brief Specify fields needed by caller
+ * @param ctx The context
+ * @param fields Bit mask of `out_field`, where `(1 << field)`
+ * denotes field is needed
+ * @note Parsing of unneeded fields may be skipped, in which case
+ * they are left empty in records
+ */
+void
+r2_ctx_set_fields   (r2_ctx     *ctx,
+                     uint32_t    fields)
+{
+    g_return_if_fail (ctx != NULL);
+    ctx->opts.fields = fields;
+}
+
+
+/**
+ * @brief Specify order and maximum number of records kept
+ * @param ctx The context
+ * @param by Field used for sorting
+ * @param desc Whether order is descending
+ * @param limit Maximum number of records, 0 means unlimited
+ */
+void
+r2_ctx_set_order   (r2_ctx       *ctx,
+                    sort_field    by,
+                    bool          desc,
+                    int           limit)
+{
+    g_return_if_fail (ctx != NULL);
+    g_return_if_fail (limit >= 0);
+
+    ctx->opts.sort_by = by;
+    ctx->opts.sort_desc = desc;
+    ctx->opts.record_limit = limit;
+}
+
+
+/**
+ * @brief Compute digest of trashed files of kept records
+ * @param ctx The context
+ * @param enable Whether trashed files are hashed
+ * @param type Checksum algorithm, either MD5 or SHA256
+ * @param jobs Maximum number of files hashed concurrently
+ * @note For `$Recycle.bin` only, and `OUT_FIELD_HASH` must also be
+ * among fields needed
+ */
+void
+r2_ctx_set_payload_hash   (r2_ctx          *ctx,
+                           bool             enable,
+                           GChecksumType    type,
+                           int              jobs)
+{
+    g_return_if_fail (ctx != NULL);
+    g_return_if_fail (! enable || hash_type_name (type) != NULL);
+    g_return_if_fail (jobs > 0);
+
+    ctx->opts.hash_payload = enable && ctx->type == RECYCLE_BIN_TYPE_DIR;
+    ctx->opts.payload_hash_type = type;
+    ctx->opts.hash_jobs = jobs;
+}
+
+
+/**
+ * @brief Compute digest of index files while they are parsed
+ * @param ctx The context
+ * @param enable Whether index files are hashed
+ * @param type Checksum algorithm, either MD5 or SHA256
+ * @note Digest is kept in `index_hash` of metadata for `INFO2`, and
+ * of each record for `$Recycle.bin`, in which case `OUT_FIELD_INDEX_HASH`
+ * must also be among fields needed
+ */
+void
+r2_ctx_set_index_hash   (r2_ctx          *ctx,
+                         bool             enable,
+                         GChecksumType    type)
+{
+    g_return_if_fail (ctx != NULL);
+    g_return_if_fail (! enable || hash_type_name (type) != NULL);
+
+    ctx->opts.hash_index = enable;
+    ctx->opts.index_hash_type = type;
+}
+
+
+/**
+ * @brief Parse recycle bin, replacing any previously loaded one
+ * @param ctx The context
+ * @param path `INFO2` file, `$Recycle.bin` folder or single `$I` file
+ * @param error Location to store fatal error
+ * @return `true` on success. Even so, some records may be invalid,
+ * check `invalid_records` of metadata and `error` of each record.
+ */
+bool
+r2_ctx_load   (r2_ctx       *ctx,
+               const char   *path,
+               GError      **error)
+{
+    g_return_val_if_fail (ctx != NULL, false);
+    g_return_val_if_fail (path != NULL, false);
+
+    meta_free (ctx->meta);
+    ctx->meta = meta_new (ctx->type, &ctx->opts);
+    ctx->meta->filename = g_strdup (path);
+
+    return find_index_files (ctx->meta, path, error) &&
+        parse_recycle_bin (ctx->meta, error);
+}
+
+
+/**
+ * @brief Get metadata of loaded recycle bin
+ * @return The metadata owned by context, or `NULL` if nothing
+ * is loaded yet
+ */
+const metarecord *
+r2_ctx_get_meta   (const r2_ctx   *ctx)
+{
+    g_return_val_if_fail (ctx != NULL, NULL);
+    return ctx->meta;
+}
+
+
+/**
+ * @brief Get original path of record in UTF-8
+ * @param ctx The context which record belongs to
+ * @param record The record
+ * @return Newly allocated path, where broken characters are
+ * escaped; or `NULL` if path is not available
+ * @note Legacy path is returned if legacy encoding is set
+ */
+char *
+r2_record_get_path   (const r2_ctx        *ctx,
+                      const rbin_struct   *record)
+{
+    const GString  *src;
+    GString        *full_path = NULL;
+    char           *result;
+
+    g_return_val_if_fail (ctx != NULL && ctx->meta != NULL, NULL);
+    g_return_val_if_fail (record != NULL, NULL);
+
+    if (NULL == (src = record_get_raw_path (ctx->meta, record, &full_path)))
+        return NULL;
+
+    result = conv_path_to_utf8_with_tmpl (src,
+        ctx->legacy_encoding, FORMAT_TEXT, NULL, NULL, NULL);
+    if (full_path)
+        g_string_free (full_path, TRUE);
+
+    return result;
+}
+
+
+void
+r2_iter_init   (r2_iter        *iter,
+                const r2_ctx   *ctx)
+{
+    g_return_if_fail (iter != NULL);
+
+    iter->ctx = ctx;
+    iter->pos = 0;
+}
+
+
+/**
+ * @brief Advance iterator to next record
+ * @return The record owned by context, or `NULL` if there is no
+ * more record
+ */
+const rbin_struct *
+r2_iter_next   (r2_iter   *iter)
+{
+    const metarecord *meta;
+
+    g_return_val_if_fail (iter != NULL, NULL);
+
+    meta = iter->ctx ? iter->ctx->meta : NULL;
+    if (meta == NULL || iter->pos >= meta->records->len)
+        return NULL;
+
+    return g_ptr_array_index (meta->records, iter->pos++);
+}
+
+
+void
+hexdump    (void     *start,
+            size_t    size)
+{
+    GString *s = g_string_new ("");
+    size_t i = 0;
+    while (true)
+    {
+        if (i % 16 == 0)
+        {
+            if (s->len > 0)
+            {
+                g_debug ("%s", s->str);
+                s = g_string_assign (s, "");
+            }
+            g_string_append_printf (s, "%04zX    ", i);
+        }
+        if (i >= size)
+            break;
+        g_string_append_printf (s, "%02" PRIX8 " ", *(uint8_t *) (start+i));
+        i++;
+    }
+
+    g_string_free (s, TRUE);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+/*
+ * Embeddable recycle bin parsing library.
+ *
+ * All state lives in `r2_ctx`; no global data is touched during
+ * parsing. Different contexts can therefore be used concurrently
+ * from different threads, though a single context must not be
+ * shared between threads without external locking.
+ *
+ *     r2_ctx *ctx = r2_ctx_new (RECYCLE_BIN_TYPE_DIR);
+ *     if (r2_ctx_load (ctx, path, &error)) {
+ *         r2_iter iter;
+ *         const rbin_struct *rec;
+ *         r2_iter_init (&iter, ctx);
+ *         while ((rec = r2_iter_next (&iter)) != NULL)
+ *             ...
+ *     }
+ *     r2_ctx_free (ctx);
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+
+#include "librifiuti-types.h"
+
+typedef struct _r2_ctx r2_ctx;
+
+/**
+ * @brief Iterator over records of a loaded recycle bin
+ * @note Allocated by caller, typically on stack
+ */
+typedef struct _r2_iter
+{
+    const r2_ctx  *ctx;
+    guint          pos;
+} r2_iter;
+
+R2_API
+r2_ctx *          r2_ctx_new                 (rbin_type           type);
+
+R2_API
+void              r2_ctx_free                (r2_ctx             *ctx);
+
+R2_API
+bool              r2_ctx_set_legacy_encoding (r2_ctx             *ctx,
+                                              const char         *enc,
+                                              GError            **error);
+
+R2_API
+bool              r2_ctx_set_filter          (r2_ctx             *ctx,
+                                              const char         *expr,
+                                              bool                localtime,
+                                              GError            **error);
+
+R2_API
+bool              r2_ctx_set_path_patterns   (r2_ctx             *ctx,
+                                              char * const       *globs,
+                                              char * const       *substrs,
+                                              GError            **error);
+
+R2_API
+void              r2_ctx_set_fields          (r2_ctx             *ctx,
+                                              uint32_t            fields);
+
+R2_API
+void              r2_ctx_set_order           (r2_ctx             *ctx,
+                                              sort_field          by,
+                                              bool                desc,
+                                              int                 limit);
+
+R2_API
+void              r2_ctx_set_payload_hash    (r2_ctx             *ctx,
+                                              bool                enable,
+                                              GChecksumType       type,
+                                              int                 jobs);
+
+R2_API
+void              r2_ctx_set_index_hash      (r2_ctx             *ctx,
+                                              bool                enable,
+                                              GChecksumType       type);
+
+R2_API
+bool              r2_ctx_load                (r2_ctx             *ctx,
+                                              const char         *path,
+                                              GError            **error);
+
+R2_API
+const metarecord * r2_ctx_get_meta           (const r2_ctx       *ctx);
+
+R2_API
+char *            r2_record_get_path         (const r2_ctx       *ctx,
+                                              const rbin_struct  *record);
+
+R2_API
+void              r2_iter_init               (r2_iter            *iter,
+                                              const r2_ctx       *ctx);
+
+R2_API
+const rbin_struct * r2_iter_next             (r2_iter            *iter);
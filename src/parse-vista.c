@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2007-2024, Abel Cheung
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "utils-error.h"
+#include "utils-conv.h"
+#include "utils.h"
+#include "utils-filter.h"
+#include "utils-hash.h"
+#include "utils-pathmatch.h"
+#include "utils-probes.h"
+#include "utils-stats.h"
+#include "rifiuti-vista.h"
+
+
+/**
+ * @brief Basic validation of index file
+ * @param filename Full path of index file
+ * @param buf Content of index file
+ * @param bufsize Size of buffer
+ * @param ver Location to store index file version
+ * @param error Location to store error upon failure
+ * @return `TRUE` if file is deemed usable, `FALSE` otherwise
+ * @note This only checks if index file has sufficient amount
+ * of data for sensible reading
+ */
+static bool
+_validate_index_file   (const char   *filename,
+                        const void   *buf,
+                        gsize         bufsize,
+                        uint64_t     *ver,
+                        GError      **error)
+{
+    g_return_val_if_fail (filename && *filename, false);
+    g_return_val_if_fail (buf      , false);
+    g_return_val_if_fail (! error  || ! *error , false);
+    g_return_val_if_fail (ver      , false);
+
+    g_debug ("Start file validation for '%s'...", filename);
+
+    if (bufsize <= VERSION1_FILENAME_OFFSET)
+    {
+        g_set_error_literal (error, R2_REC_ERROR,
+        R2_REC_ERROR_IDX_SIZE_INVALID,
+            _("File is not a $Recycle.bin index"));
+        return false;
+    }
+
+    copy_field (*ver, buf, VERSION_OFFSET, FILESIZE_OFFSET);
+    *ver = GUINT64_FROM_LE (*ver);
+    g_debug ("version = %" PRIu64, *ver);
+
+    switch (*ver)
+    {
+    case VERSION_VISTA: break;  // already handled above
+
+    case VERSION_WIN10:
+        // Version 2 adds a uint32 file name strlen before file name.
+        // This presumably breaks the 260 char barrier in version 1.
+        if (bufsize <= VERSION2_FILENAME_OFFSET)
+        {
+            g_set_error_literal (error, R2_REC_ERROR,
+            R2_REC_ERROR_IDX_SIZE_INVALID,
+                _("File is not a $Recycle.bin index"));
+            return false;
+        }
+        break;
+
+    default:
+        if (*ver < 10)
+            g_set_error (error, R2_REC_ERROR,
+                R2_REC_ERROR_VER_UNSUPPORTED,
+                _("Index file version %" PRIu64 " is unsupported"), *ver);
+        else
+            g_set_error (error, R2_REC_ERROR,
+                R2_REC_ERROR_VER_UNSUPPORTED,
+                "%s", _("File is not a $Recycle.bin index"));
+        return false;
+    }
+
+    g_debug ("Finished file validation for '%s'", filename);
+    return true;
+}
+
+
+static rbin_struct *
+_populate_record_data  (metarecord  *meta,
+                        void        *buf,
+                        gsize        bufsize,
+                        uint64_t     version,
+                        trash_file_status gone)
+{
+    rbin_struct  *record;
+    uint32_t      path_sz_expected, path_sz_actual;
+    size_t        null_terminator_offset;
+    void         *pathbuf_start = NULL;
+    bool          erraneous = false;
+    GString      *u;  // shorthand
+
+    switch (version)
+    {
+    case VERSION_VISTA:
+        // In rare cases, the size of index file is one byte short of
+        // (fixed) 544 bytes in Vista. Under such occasion, file size
+        // only occupies 56 bit, not 64 bit as it ought to be.
+        // Actually this 56-bit file size is very likely wrong after all.
+        // This is observed during deletion of dd.exe from Forensic
+        // Acquisition Utilities (by George M. Garner Jr)
+        // in certain localized Vista.
+        if (bufsize == VERSION1_FILE_SIZE - 1)
+            erraneous = true;
+
+        path_sz_expected = WIN_PATH_MAX * sizeof(gunichar2);
+        path_sz_actual = bufsize + (int)erraneous - VERSION1_FILENAME_OFFSET;
+        pathbuf_start = buf - (int)erraneous + VERSION1_FILENAME_OFFSET;
+        break;
+
+    case VERSION_WIN10:
+        copy_field (path_sz_expected, buf, VERSION1_FILENAME_OFFSET,
+            VERSION2_FILENAME_OFFSET);
+        path_sz_expected = GUINT32_FROM_LE (path_sz_expected) *
+            sizeof(gunichar2);
+        path_sz_actual = bufsize - VERSION2_FILENAME_OFFSET;
+        pathbuf_start = buf + VERSION2_FILENAME_OFFSET;
+        break;
+
+    default:
+        g_assert_not_reached ();
+    }
+
+    record = g_malloc0 (sizeof (rbin_struct));
+    record->version = version;
+    record->gone = gone;
+
+    copy_field (record->filesize, buf, FILESIZE_OFFSET,
+        FILETIME_OFFSET - (int) erraneous);
+    if (erraneous)
+    {
+        g_debug ("filesize field broken, 56 bit only, val=0x%" PRIX64,
+                 record->filesize);
+        /* not printing the value because it was wrong and misleading */
+        record->filesize = G_MAXUINT64;
+    }
+    else
+    {
+        record->filesize = GUINT64_FROM_LE (record->filesize);
+        g_debug ("deleted file size = %" PRIu64, record->filesize);
+    }
+
+    /* File deletion time */
+    copy_field (record->winfiletime, buf - (int) erraneous,
+        FILETIME_OFFSET, VERSION1_FILENAME_OFFSET);
+    record->winfiletime = GINT64_FROM_LE (record->winfiletime);
+
+    // All fields used by record filter are available now; drop
+    // unwanted record before any path conversion takes place
+    if (! record_filter_eval (meta->opts->where_filter, record) ||
+        ! may_keep_record (meta, record))
+        goto filtered;
+
+    // Match path patterns on raw bytes before any conversion
+    if (meta->opts->path_filter && ! path_matcher_match (
+        meta->opts->path_filter, pathbuf_start,
+        ucs2_bytelen (pathbuf_start, MIN (path_sz_actual, path_sz_expected)),
+        sizeof (gunichar2)))
+        goto filtered;
+
+    record->deltime = win_filetime_to_gdatetime (record->winfiletime);
+    if (record->error == NULL)
+    {
+        GDateTime *now = g_date_time_new_now_utc ();
+
+        if (g_date_time_difference (record->deltime, now) > 525600000LL ||  // 1y
+            g_date_time_get_year (record->deltime) < 2007)
+            g_set_error_literal (&record->error, R2_REC_ERROR,
+                R2_REC_ERROR_DUBIOUS_TIME,
+                _("File deletion time is suspicious or broken"));
+        g_date_time_unref (now);
+    }
+
+    // Unicode path
+
+    if (path_sz_actual > path_sz_expected)
+    {
+        g_set_error_literal (&record->error, R2_REC_ERROR,
+            R2_REC_ERROR_DUBIOUS_PATH,
+            _("Ignored dangling extraneous data after record"));
+    }
+    else if (path_sz_actual < path_sz_expected && ! erraneous)
+    {
+        g_set_error_literal (&record->error, R2_REC_ERROR,
+            R2_REC_ERROR_DUBIOUS_PATH,
+            _("Record is truncated, thus unicode path might be incomplete"));
+    }
+
+    // Path is neither stored nor validated if not printed
+    if (! meta_wants_field (meta, OUT_FIELD_PATH))
+        return record;
+
+    u = g_string_new_len ((const char *) pathbuf_start,
+        MIN(path_sz_actual, path_sz_expected));
+    record->raw_uni_path = u;
+
+    null_terminator_offset = ucs2_bytelen (u->str, u->len);
+
+    if (record->error == NULL)
+    {
+        char *s = g_convert (u->str, null_terminator_offset,
+            "UTF-8", "UTF-16LE", NULL, NULL, NULL);
+        if (s)
+            g_free (s);
+        else
+            g_set_error_literal (&record->error, R2_REC_ERROR, R2_REC_ERROR_CONV_PATH,
+                _("Path contains broken unicode character(s)"));
+    }
+
+    if (meta->paths)
+        record->raw_uni_path = path_store_intern (meta->paths,
+            u, sizeof (gunichar2), &record->uni_dir);
+
+    return record;
+
+    filtered:
+
+    g_clear_error (&record->error);
+    g_free (record);
+    return NULL;
+}
+
+/**
+ * @brief Merge version of single index file into overall version
+ * @note All parsed index files are taken into account, including
+ * those not kept due to filtering or record limit
+ */
+static void
+_merge_idx_version   (metarecord   *meta,
+                      const char   *name,
+                      uint64_t      version)
+{
+    if (meta->version == VERSION_INCONSISTENT)
+        return;
+
+    if (meta->version == VERSION_NOT_FOUND)
+        meta->version = (int64_t) version;
+    else if (meta->version != (int64_t) version)
+    {
+        g_debug ("Bad entry %s, meta ver = %" PRId64
+            ", rec ver = %" PRId64,
+            name, meta->version, (int64_t) version);
+        meta->version = VERSION_INCONSISTENT;
+    }
+}
+
+
+static void
+_parse_vista_buffer   (const char   *index_file,
+                       void         *buf,
+                       gsize         bufsize,
+                       metarecord   *meta)
+{
+    rbin_struct       *record = NULL;
+    char              *basename = NULL;
+    uint64_t           version = 0;
+    char              *trash_path = NULL;
+    trash_file_status  gone;
+    bool               hash_wanted;
+    GError            *error = NULL;
+
+    basename = g_path_get_basename (index_file);
+
+    if (! _validate_index_file (index_file, buf, bufsize, &version, &error))
+    {
+        g_hash_table_replace (meta->invalid_records,
+            g_strdup (basename), error);
+        g_free (basename);
+        return;
+    }
+
+    g_debug ("Start populating record for '%s'...", basename);
+
+    /* Check corresponding $R.... file existance, only when needed */
+    hash_wanted = meta->opts->hash_payload &&
+        meta_wants_field (meta, OUT_FIELD_HASH);
+    if (meta->isolated_index || ! (hash_wanted ||
+        meta_wants_field (meta, OUT_FIELD_GONE) ||
+        record_filter_uses_gone (meta->opts->where_filter)))
+        gone = FILESTATUS_UNKNOWN;
+    else
+    {
+        char *dirname = g_path_get_dirname (index_file);
+        char *trash_basename = g_strdup (basename);
+        trash_basename[1] = 'R';  /* $R... versus $I... */
+        trash_path = g_build_filename (dirname, trash_basename, NULL);
+        gone = g_file_test (trash_path, G_FILE_TEST_EXISTS) ?
+            FILESTATUS_EXISTS : FILESTATUS_GONE;
+        g_free (dirname);
+        g_free (trash_basename);
+    }
+
+    record = _populate_record_data (meta, buf, bufsize, version, gone);
+
+    _merge_idx_version (meta, basename, version);
+
+    if (record == NULL)
+    {
+        g_debug ("Record '%s' dropped by filter", basename);
+        meta->filtered++;
+        g_free (basename);
+        g_free (trash_path);
+        return;
+    }
+
+    R2_PROBE2 (record__populated, version, record->filesize);
+
+    record->index_s = basename;
+    // Content is already in memory, no need to read again
+    if (meta->opts->hash_index &&
+        meta_wants_field (meta, OUT_FIELD_INDEX_HASH))
+        record->index_hash = hash_buffer (meta->opts->index_hash_type,
+            buf, bufsize);
+    // Hashed later, after all records are collected
+    if (hash_wanted && gone == FILESTATUS_EXISTS)
+        record->payload_path = g_steal_pointer (&trash_path);
+    g_free (trash_path);
+    keep_record (meta, record);
+
+    g_debug ("Parsing done for '%s'", basename);
+}
+
+
+static void
+_parse_vista_buffer_timed   (const char   *index_file,
+                             void         *buf,
+                             gsize         bufsize,
+                             metarecord   *meta)
+{
+    stats_time mark;
+
+    stats_mark (meta->opts->stats, &mark);
+    _parse_vista_buffer (index_file, buf, bufsize, meta);
+    stats_add_since (meta->opts->stats, STATS_PHASE_PARSE, &mark);
+}
+
+
+/**
+ * @brief Parse content of `$Recycle.bin` index file already in memory
+ * @param index_file Path of index file, which needs not be readable
+ * @param buf Content of index file
+ * @param bufsize Size of buffer
+ * @param meta The metadata
+ * @note Status of trashed file is still checked from filesystem
+ * if requested, because it can change without touching index file
+ */
+void
+parse_vista_buffer   (const char   *index_file,
+                      void         *buf,
+                      gsize         bufsize,
+                      metarecord   *meta)
+{
+    R2_PROBE1 (index__start, index_file);
+    _parse_vista_buffer_timed (index_file, buf, bufsize, meta);
+    R2_PROBE2 (index__done, index_file, bufsize);
+}
+
+
+/**
+ * @brief Parse `$Recycle.bin` index file and add its record to metadata
+ * @param index_file Path of index file
+ * @param meta The metadata
+ */
+void
+parse_vista_index   (const char   *index_file,
+                     metarecord   *meta)
+{
+    gsize              bufsize;
+    char              *buf = NULL;
+    GError            *error = NULL;
+    stats_time         mark;
+    bool               ok;
+
+    R2_PROBE1 (index__start, index_file);
+
+    stats_mark (meta->opts->stats, &mark);
+    ok = g_file_get_contents (index_file, &buf, &bufsize, &error);
+    stats_add_since (meta->opts->stats, STATS_PHASE_READ, &mark);
+
+    if (! ok)
+    {
+        g_hash_table_replace (meta->invalid_records,
+            g_path_get_basename (index_file), error);
+        R2_PROBE2 (index__done, index_file, 0);
+        return;
+    }
+
+    stats_add_read (meta->opts->stats, bufsize);
+
+    _parse_vista_buffer_timed (index_file, buf, bufsize, meta);
+    g_free (buf);
+
+    R2_PROBE2 (index__done, index_file, bufsize);
+}
@@ -0,0 +1,729 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "utils-arrow.h"
+
+/*
+ * Writer of Arrow IPC streaming format, see
+ * https://arrow.apache.org/docs/format/Columnar.html
+ *
+ * Each message is a Flatbuffers encoded header followed by body
+ * holding column buffers. Flatbuffers are built back to front, so
+ * children objects are written before their parent, and offsets
+ * are counted from end of buffer until it is finished.
+ */
+
+#define FB_MAX_FIELDS       8
+#define METADATA_V5         4
+#define CONTINUATION        0xFFFFFFFFu
+
+/* Values of Arrow union and enum types */
+enum { HEADER_SCHEMA = 1, HEADER_DICTIONARY_BATCH, HEADER_RECORD_BATCH };
+enum { TYPE_INT = 2, TYPE_UTF8 = 5, TYPE_TIMESTAMP = 10 };
+enum { TIME_UNIT_MICROSECOND = 2 };
+
+typedef struct _fb_builder
+{
+    guint8     *buf;
+    gsize       cap;
+    gsize       head;      /* content is from head to end of buf */
+    gsize       minalign;
+    uint32_t    fields[FB_MAX_FIELDS];  /* table under construction */
+    int         n_fields;
+    uint32_t    table_start;
+} fb_builder;
+
+typedef struct _arrow_column
+{
+    arrow_field  spec;
+    GString     *validity;   /* bitmap, 1 = valid */
+    GString     *values;     /* fixed width values, or string offsets */
+    GString     *data;       /* string content */
+    guint        length;
+    guint        null_count;
+} arrow_column;
+
+struct _arrow_stream
+{
+    arrow_column  *cols;
+    int            n_cols;
+    char         **metadata;
+};
+
+
+static fb_builder *
+_fb_new   (void)
+{
+    fb_builder *b = g_malloc0 (sizeof (fb_builder));
+
+    b->cap = b->head = 256;
+    b->buf = g_malloc0 (b->cap);
+    b->minalign = 1;
+    return b;
+}
+
+
+static uint32_t
+_fb_size   (const fb_builder   *b)
+{
+    return (uint32_t) (b->cap - b->head);
+}
+
+
+static void
+_fb_reserve   (fb_builder   *b,
+               gsize         len)
+{
+    while (b->head < len)
+    {
+        gsize   used = b->cap - b->head;
+        guint8 *newbuf = g_malloc0 (b->cap * 2);
+
+        memcpy (newbuf + b->cap * 2 - used, b->buf + b->head, used);
+        g_free (b->buf);
+        b->buf = newbuf;
+        b->head = b->cap * 2 - used;
+        b->cap *= 2;
+    }
+}
+
+
+static void
+_fb_push_bytes   (fb_builder    *b,
+                  const void    *data,
+                  gsize          len)
+{
+    _fb_reserve (b, len);
+    b->head -= len;
+    if (data)
+        memcpy (b->buf + b->head, data, len);
+    else
+        memset (b->buf + b->head, 0, len);
+}
+
+
+/* Pad so that buffer is aligned after `additional` bytes are pushed */
+static void
+_fb_prep   (fb_builder   *b,
+            gsize         align,
+            gsize         additional)
+{
+    if (align > b->minalign)
+        b->minalign = align;
+    _fb_push_bytes (b, NULL,
+        (~(_fb_size (b) + additional) + 1) & (align - 1));
+}
+
+
+static void
+_fb_push_scalar   (fb_builder   *b,
+                   uint64_t      value,
+                   gsize         size)
+{
+    guint8 bytes[8];
+
+    for (gsize i = 0; i < size; i++)
+        bytes[i] = (value >> (i * 8)) & 0xFF;
+    _fb_prep (b, size, 0);
+    _fb_push_bytes (b, bytes, size);
+}
+
+
+/* Push offset pointing to object written before, and return its location */
+static uint32_t
+_fb_push_offset   (fb_builder   *b,
+                   uint32_t      target)
+{
+    _fb_prep (b, 4, 0);
+    _fb_push_scalar (b, _fb_size (b) + 4 - target, 4);
+    return _fb_size (b);
+}
+
+
+static uint32_t
+_fb_string   (fb_builder   *b,
+              const char   *str)
+{
+    gsize len = strlen (str);
+
+    _fb_prep (b, 4, len + 1);
+    _fb_push_bytes (b, NULL, 1);
+    _fb_push_bytes (b, str, len);
+    _fb_push_scalar (b, len, 4);
+    return _fb_size (b);
+}
+
+
+static uint32_t
+_fb_offset_vector   (fb_builder       *b,
+                     const uint32_t   *offsets,
+                     gsize             n)
+{
+    _fb_prep (b, 4, 4 * n);
+    for (gsize i = n; i-- > 0; )
+        _fb_push_offset (b, offsets[i]);
+    _fb_push_scalar (b, n, 4);
+    return _fb_size (b);
+}
+
+
+/* Vector of structs each having two longs, like FieldNode or Buffer */
+static uint32_t
+_fb_pair_vector   (fb_builder      *b,
+                   const int64_t   *pairs,
+                   gsize            n)
+{
+    _fb_prep (b, 4, 16 * n);
+    _fb_prep (b, 8, 16 * n);
+    for (gsize i = n; i-- > 0; )
+    {
+        _fb_push_scalar (b, (uint64_t) pairs[2 * i + 1], 8);
+        _fb_push_scalar (b, (uint64_t) pairs[2 * i], 8);
+    }
+    _fb_push_scalar (b, n, 4);
+    return _fb_size (b);
+}
+
+
+/* Tables can't nest, so children must be written beforehand */
+static void
+_fb_table_start   (fb_builder   *b,
+                   int           n_fields)
+{
+    g_assert (n_fields <= FB_MAX_FIELDS);
+
+    memset (b->fields, 0, sizeof (b->fields));
+    b->n_fields = n_fields;
+    b->table_start = _fb_size (b);
+}
+
+
+static void
+_fb_table_scalar   (fb_builder   *b,
+                    int           slot,
+                    uint64_t      value,
+                    gsize         size)
+{
+    _fb_push_scalar (b, value, size);
+    b->fields[slot] = _fb_size (b);
+}
+
+
+static void
+_fb_table_offset   (fb_builder   *b,
+                    int           slot,
+                    uint32_t      target)
+{
+    b->fields[slot] = _fb_push_offset (b, target);
+}
+
+
+static uint32_t
+_fb_table_end   (fb_builder   *b)
+{
+    uint32_t  obj, vt;
+    int       n = b->n_fields;
+
+    // Placeholder of offset to vtable, which is written right before
+    _fb_push_scalar (b, 0, 4);
+    obj = _fb_size (b);
+
+    while (n > 0 && b->fields[n - 1] == 0)
+        n--;
+    for (int i = n; i-- > 0; )
+        _fb_push_scalar (b, b->fields[i] ? obj - b->fields[i] : 0, 2);
+    _fb_push_scalar (b, obj - b->table_start, 2);
+    _fb_push_scalar (b, (n + 2) * 2, 2);
+    vt = _fb_size (b);
+
+    for (gsize i = 0; i < 4; i++)
+        b->buf[b->cap - obj + i] = ((vt - obj) >> (i * 8)) & 0xFF;
+
+    return obj;
+}
+
+
+/* Finish flatbuffer with root table, then free the builder */
+static GString *
+_fb_finish   (fb_builder   *b,
+              uint32_t      root)
+{
+    GString *s;
+
+    _fb_prep (b, b->minalign, 4);
+    _fb_push_offset (b, root);
+
+    s = g_string_new_len ((const char *) b->buf + b->head, _fb_size (b));
+    g_free (b->buf);
+    g_free (b);
+    return s;
+}
+
+
+static void
+_append_le   (GString    *s,
+              uint64_t    value,
+              gsize       size)
+{
+    for (gsize i = 0; i < size; i++)
+        s = g_string_append_c (s, (char) ((value >> (i * 8)) & 0xFF));
+}
+
+
+static void
+_pad8   (GString   *s)
+{
+    while (s->len % 8)
+        s = g_string_append_c (s, '\0');
+}
+
+
+/* Frame message header and body as in IPC streaming format */
+static void
+_append_message   (GString         *out,
+                   fb_builder      *b,
+                   guint8           header_type,
+                   uint32_t         header,
+                   const GString   *body)
+{
+    GString  *fb;
+    uint32_t  root;
+
+    _fb_table_start (b, 4);
+    _fb_table_scalar (b, 3, body ? body->len : 0, 8);  // bodyLength
+    _fb_table_offset (b, 2, header);
+    _fb_table_scalar (b, 1, header_type, 1);
+    _fb_table_scalar (b, 0, METADATA_V5, 2);
+    root = _fb_table_end (b);
+    fb = _fb_finish (b, root);
+    _pad8 (fb);
+
+    _append_le (out, CONTINUATION, 4);
+    _append_le (out, fb->len, 4);
+    g_string_append_len (out, fb->str, fb->len);
+    if (body)
+        g_string_append_len (out, body->str, body->len);
+
+    g_string_free (fb, TRUE);
+}
+
+
+static gsize
+_value_width   (arrow_col_type   type)
+{
+    switch (type)
+    {
+        case ARROW_COL_UINT32:       return 4;
+        case ARROW_COL_UINT64:
+        case ARROW_COL_TIMESTAMP_US: return 8;
+        case ARROW_COL_DICT_UTF8:    return 1;
+        default:                     return 0;
+    }
+}
+
+
+static void
+_column_reset   (arrow_column   *col)
+{
+    g_string_truncate (col->validity, 0);
+    g_string_truncate (col->values, 0);
+    g_string_truncate (col->data, 0);
+    if (col->spec.type == ARROW_COL_UTF8)
+        _append_le (col->values, 0, 4);
+    col->length = col->null_count = 0;
+}
+
+
+/**
+ * @brief Create Arrow IPC stream writer
+ * @param fields Column definitions, which must outlive the writer
+ * @param n_fields Number of columns
+ * @param metadata `NULL` terminated list of alternating keys and
+ * values, kept as custom metadata of schema
+ * @return The writer, free with `arrow_stream_free()`
+ */
+arrow_stream *
+arrow_stream_new   (const arrow_field   *fields,
+                    int                  n_fields,
+                    char               **metadata)
+{
+    arrow_stream *stream = g_malloc0 (sizeof (arrow_stream));
+
+    stream->n_cols = n_fields;
+    stream->cols = g_malloc0_n (n_fields, sizeof (arrow_column));
+    stream->metadata = g_strdupv (metadata);
+
+    for (int i = 0; i < n_fields; i++)
+    {
+        arrow_column *col = &stream->cols[i];
+
+        col->spec = fields[i];
+        col->validity = g_string_new (NULL);
+        col->values = g_string_new (NULL);
+        col->data = g_string_new (NULL);
+        _column_reset (col);
+    }
+
+    return stream;
+}
+
+
+void
+arrow_stream_free   (arrow_stream   *stream)
+{
+    if (stream == NULL)
+        return;
+
+    for (int i = 0; i < stream->n_cols; i++)
+    {
+        g_string_free (stream->cols[i].validity, TRUE);
+        g_string_free (stream->cols[i].values, TRUE);
+        g_string_free (stream->cols[i].data, TRUE);
+    }
+    g_free (stream->cols);
+    g_strfreev (stream->metadata);
+    g_free (stream);
+}
+
+
+static void
+_column_add_row   (arrow_column   *col,
+                   bool            valid)
+{
+    if (col->length % 8 == 0)
+        col->validity = g_string_append_c (col->validity, '\0');
+    if (valid)
+        col->validity->str[col->length / 8] |= 1 << (col->length % 8);
+    else
+        col->null_count++;
+    col->length++;
+}
+
+
+void
+arrow_append_null   (arrow_stream   *stream,
+                     int             col)
+{
+    arrow_column *c = &stream->cols[col];
+
+    if (c->spec.type == ARROW_COL_UTF8)
+        _append_le (c->values, c->data->len, 4);
+    else
+        _append_le (c->values, 0, _value_width (c->spec.type));
+    _column_add_row (c, false);
+}
+
+
+/**
+ * @brief Append integer to column, which is dictionary index
+ * in case of dictionary column
+ */
+void
+arrow_append_int   (arrow_stream   *stream,
+                    int             col,
+                    int64_t         value)
+{
+    arrow_column *c = &stream->cols[col];
+
+    g_return_if_fail (c->spec.type != ARROW_COL_UTF8);
+
+    _append_le (c->values, (uint64_t) value, _value_width (c->spec.type));
+    _column_add_row (c, true);
+}
+
+
+void
+arrow_append_str   (arrow_stream   *stream,
+                    int             col,
+                    const char     *str)
+{
+    arrow_column *c = &stream->cols[col];
+
+    g_return_if_fail (c->spec.type == ARROW_COL_UTF8);
+
+    c->data = g_string_append (c->data, str);
+    _append_le (c->values, c->data->len, 4);
+    _column_add_row (c, true);
+}
+
+
+guint
+arrow_pending_rows   (const arrow_stream   *stream)
+{
+    return stream->n_cols ? stream->cols[0].length : 0;
+}
+
+
+/* Write type of column, return its union type */
+static guint8
+_fb_column_type   (fb_builder      *b,
+                   arrow_col_type   type,
+                   uint32_t        *offset)
+{
+    uint32_t tz;
+
+    switch (type)
+    {
+        case ARROW_COL_UINT32:
+        case ARROW_COL_UINT64:
+            _fb_table_start (b, 2);
+            _fb_table_scalar (b, 0, _value_width (type) * 8, 4);
+            _fb_table_scalar (b, 1, 0, 1);  // unsigned
+            *offset = _fb_table_end (b);
+            return TYPE_INT;
+
+        case ARROW_COL_TIMESTAMP_US:
+            tz = _fb_string (b, "UTC");
+            _fb_table_start (b, 2);
+            _fb_table_offset (b, 1, tz);
+            _fb_table_scalar (b, 0, TIME_UNIT_MICROSECOND, 2);
+            *offset = _fb_table_end (b);
+            return TYPE_TIMESTAMP;
+
+        default:  // Dictionary column has type of its values
+            _fb_table_start (b, 0);
+            *offset = _fb_table_end (b);
+            return TYPE_UTF8;
+    }
+}
+
+
+static uint32_t
+_fb_field   (fb_builder          *b,
+             const arrow_field   *spec,
+             int64_t              dict_id)
+{
+    uint32_t  name, type, dict = 0, children, idx_type;
+    guint8    type_type;
+
+    name = _fb_string (b, spec->name);
+    type_type = _fb_column_type (b, spec->type, &type);
+
+    if (spec->type == ARROW_COL_DICT_UTF8)
+    {
+        _fb_table_start (b, 2);
+        _fb_table_scalar (b, 0, 8, 4);
+        _fb_table_scalar (b, 1, 1, 1);  // signed
+        idx_type = _fb_table_end (b);
+
+        _fb_table_start (b, 4);
+        _fb_table_scalar (b, 0, (uint64_t) dict_id, 8);
+        _fb_table_offset (b, 1, idx_type);
+        dict = _fb_table_end (b);
+    }
+
+    // Readers expect children vector even if empty
+    children = _fb_offset_vector (b, NULL, 0);
+
+    _fb_table_start (b, 7);
+    _fb_table_offset (b, 0, name);
+    _fb_table_offset (b, 3, type);
+    if (dict)
+        _fb_table_offset (b, 4, dict);
+    _fb_table_offset (b, 5, children);
+    _fb_table_scalar (b, 1, 1, 1);  // nullable
+    _fb_table_scalar (b, 2, type_type, 1);
+    return _fb_table_end (b);
+}
+
+
+/* Record batch without compression, using given body layout */
+static uint32_t
+_fb_record_batch   (fb_builder      *b,
+                    int64_t          length,
+                    const int64_t   *nodes,
+                    gsize            n_nodes,
+                    const int64_t   *buffers,
+                    gsize            n_buffers)
+{
+    uint32_t nodes_off, buffers_off;
+
+    nodes_off = _fb_pair_vector (b, nodes, n_nodes);
+    buffers_off = _fb_pair_vector (b, buffers, n_buffers);
+
+    _fb_table_start (b, 3);
+    _fb_table_scalar (b, 0, (uint64_t) length, 8);
+    _fb_table_offset (b, 1, nodes_off);
+    _fb_table_offset (b, 2, buffers_off);
+    return _fb_table_end (b);
+}
+
+
+/* Append buffer to body, and record its location */
+static void
+_add_buffer   (GString      *body,
+               int64_t      *buffers,
+               gsize        *n,
+               const char   *data,
+               gsize         len)
+{
+    buffers[(*n) * 2] = body->len;
+    buffers[(*n) * 2 + 1] = len;
+    (*n)++;
+    g_string_append_len (body, data, len);
+    _pad8 (body);
+}
+
+
+/* Add buffers of column to body, as described in columnar format */
+static void
+_add_column_buffers   (GString              *body,
+                       int64_t              *buffers,
+                       gsize                *n,
+                       const arrow_column   *col)
+{
+    // Validity bitmap can be left out if nothing is null
+    _add_buffer (body, buffers, n, col->validity->str,
+        col->null_count ? col->validity->len : 0);
+    _add_buffer (body, buffers, n, col->values->str, col->values->len);
+    if (col->spec.type == ARROW_COL_UTF8)
+        _add_buffer (body, buffers, n, col->data->str, col->data->len);
+}
+
+
+static void
+_append_dictionary   (GString              *out,
+                      const arrow_column   *col,
+                      int64_t               dict_id)
+{
+    arrow_column   values = { .spec.type = ARROW_COL_UTF8 };
+    fb_builder    *b = _fb_new ();
+    GString       *body = g_string_new (NULL);
+    int64_t        node[2], buffers[6];
+    gsize          n = 0;
+    uint32_t       batch, header;
+
+    values.validity = g_string_new (NULL);
+    values.values = g_string_new (NULL);
+    values.data = g_string_new (NULL);
+    _column_reset (&values);
+    for (int i = 0; i < col->spec.dict_len; i++)
+    {
+        values.data = g_string_append (values.data, col->spec.dict[i]);
+        _append_le (values.values, values.data->len, 4);
+        _column_add_row (&values, true);
+    }
+
+    node[0] = values.length;
+    node[1] = 0;
+    _add_column_buffers (body, buffers, &n, &values);
+
+    batch = _fb_record_batch (b, values.length, node, 1, buffers, n);
+    _fb_table_start (b, 3);
+    _fb_table_scalar (b, 0, (uint64_t) dict_id, 8);
+    _fb_table_offset (b, 1, batch);
+    header = _fb_table_end (b);
+    _append_message (out, b, HEADER_DICTIONARY_BATCH, header, body);
+
+    g_string_free (values.validity, TRUE);
+    g_string_free (values.values, TRUE);
+    g_string_free (values.data, TRUE);
+    g_string_free (body, TRUE);
+}
+
+
+/**
+ * @brief Encode schema of stream, along with values of
+ * dictionary columns
+ * @return Encoded messages, which must be written first
+ * @note Column index is used as dictionary ID
+ */
+GString *
+arrow_schema_message   (const arrow_stream   *stream)
+{
+    fb_builder  *b = _fb_new ();
+    GString     *out = g_string_new (NULL);
+    uint32_t    *offsets, fields, metadata = 0, header;
+    guint        n_meta = stream->metadata ?
+                          g_strv_length (stream->metadata) / 2 : 0;
+
+    offsets = g_malloc0_n (MAX (n_meta, (guint) stream->n_cols) + 1,
+        sizeof (uint32_t));
+
+    for (int i = 0; i < stream->n_cols; i++)
+        offsets[i] = _fb_field (b, &stream->cols[i].spec, i);
+    fields = _fb_offset_vector (b, offsets, stream->n_cols);
+
+    if (n_meta)
+    {
+        for (guint i = 0; i < n_meta; i++)
+        {
+            uint32_t key = _fb_string (b, stream->metadata[i * 2]);
+            uint32_t value = _fb_string (b, stream->metadata[i * 2 + 1]);
+
+            _fb_table_start (b, 2);
+            _fb_table_offset (b, 0, key);
+            _fb_table_offset (b, 1, value);
+            offsets[i] = _fb_table_end (b);
+        }
+        metadata = _fb_offset_vector (b, offsets, n_meta);
+    }
+
+    _fb_table_start (b, 4);
+    _fb_table_offset (b, 1, fields);
+    if (metadata)
+        _fb_table_offset (b, 2, metadata);
+    header = _fb_table_end (b);
+    _append_message (out, b, HEADER_SCHEMA, header, NULL);
+    g_free (offsets);
+
+    for (int i = 0; i < stream->n_cols; i++)
+        if (stream->cols[i].spec.type == ARROW_COL_DICT_UTF8)
+            _append_dictionary (out, &stream->cols[i], i);
+
+    return out;
+}
+
+
+/**
+ * @brief Encode pending rows as a record batch, and clear them
+ * @return Encoded message
+ */
+GString *
+arrow_batch_message   (arrow_stream   *stream)
+{
+    fb_builder  *b = _fb_new ();
+    GString     *out = g_string_new (NULL);
+    GString     *body = g_string_new (NULL);
+    int64_t     *nodes, *buffers;
+    gsize        n = 0;
+    guint        rows = arrow_pending_rows (stream);
+    uint32_t     header;
+
+    nodes = g_malloc0_n (stream->n_cols * 2 + 1, sizeof (int64_t));
+    buffers = g_malloc0_n (stream->n_cols * 6 + 1, sizeof (int64_t));
+
+    for (int i = 0; i < stream->n_cols; i++)
+    {
+        arrow_column *col = &stream->cols[i];
+
+        g_assert (col->length == rows);
+        nodes[i * 2] = col->length;
+        nodes[i * 2 + 1] = col->null_count;
+        _add_column_buffers (body, buffers, &n, col);
+        _column_reset (col);
+    }
+
+    header = _fb_record_batch (b, rows, nodes, stream->n_cols, buffers, n);
+    _append_message (out, b, HEADER_RECORD_BATCH, header, body);
+
+    g_free (nodes);
+    g_free (buffers);
+    g_string_free (body, TRUE);
+    return out;
+}
+
+
+/* Append end of stream marker */
+void
+arrow_append_eos   (GString   *s)
+{
+    _append_le (s, CONTINUATION, 4);
+    _append_le (s, 0, 4);
+}
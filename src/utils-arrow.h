@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <glib.h>
+
+/* Rows kept in memory before they are written as a record batch */
+#define ARROW_BATCH_ROWS 65536
+
+/* Column types supported by Arrow IPC stream writer */
+typedef enum
+{
+    ARROW_COL_UTF8,
+    ARROW_COL_UINT32,
+    ARROW_COL_UINT64,
+    ARROW_COL_TIMESTAMP_US,   /* microseconds since epoch, UTC */
+    ARROW_COL_DICT_UTF8,      /* dictionary of strings, int8 index */
+} arrow_col_type;
+
+typedef struct _arrow_field
+{
+    const char          *name;
+    arrow_col_type       type;
+    const char * const  *dict;   /* values of dictionary column */
+    int                  dict_len;
+} arrow_field;
+
+typedef struct _arrow_stream arrow_stream;
+
+arrow_stream * arrow_stream_new       (const arrow_field   *fields,
+                                       int                  n_fields,
+                                       char               **metadata);
+
+void           arrow_stream_free      (arrow_stream        *stream);
+
+void           arrow_append_null      (arrow_stream        *stream,
+                                       int                  col);
+
+void           arrow_append_int       (arrow_stream        *stream,
+                                       int                  col,
+                                       int64_t              value);
+
+void           arrow_append_str       (arrow_stream        *stream,
+                                       int                  col,
+                                       const char          *str);
+
+guint          arrow_pending_rows     (const arrow_stream  *stream);
+
+GString *      arrow_schema_message   (const arrow_stream  *stream);
+
+GString *      arrow_batch_message    (arrow_stream        *stream);
+
+void           arrow_append_eos       (GString             *s);
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2007-2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+/*
+ * Functions shared by command line programs only, which are
+ * not part of library.
+ */
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "utils-conv.h"
+#include "utils.h"
+
+typedef bool (*ProcessBinFunc)            (GError          **error);
+
+bool          rifiuti_init                (rbin_type         type,
+                                           char             *usage_param,
+                                           char             *usage_summary,
+                                           char           ***argv,
+                                           GError          **error);
+
+bool          dump_content                (GError          **error);
+
+void          dump_records                (out_fmt           format);
+
+exitcode      rifiuti_cleanup             (GError          **error);
+
+void          process_bins                (ProcessBinFunc    func,
+                                           GError          **error);
+
+bool          field_is_wanted             (out_field         field);
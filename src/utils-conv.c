@@ -11,6 +11,7 @@
 
 #include "utils-error.h"
 #include "utils-conv.h"
+#include "utils-probes.h"
 
 
 struct _fmt_data fmt[] = {
@@ -41,6 +42,36 @@ struct _fmt_data fmt[] = {
         },
         .gone_outtext  = {"null", "false", "true"},
     },
+    {
+        // Paths are formatted as in JSON
+        .friendly_name = "NDJSON format",
+        .fallback_tmpl = {"", "<\\%02X>", "*u%04X"},
+        .gone_outtext  = {"null", "false", "true"},
+    },
+    {
+        // Deletion status is stored as boolean or nil
+        .friendly_name = "MessagePack format",
+        .fallback_tmpl = {"<\\u%04X>", "<\\%02X>", "<\\u%04X>"},
+        .gone_outtext  = {NULL, NULL, NULL},
+    },
+    {
+        // Deletion status is dictionary encoded
+        .friendly_name = "Arrow IPC stream format",
+        .fallback_tmpl = {"<\\u%04X>", "<\\%02X>", "<\\u%04X>"},
+        .gone_outtext  = {"unknown", "false", "true"},
+    },
+    {
+        // Deletion status is stored as integer or NULL
+        .friendly_name = "SQLite database",
+        .fallback_tmpl = {"<\\u%04X>", "<\\%02X>", "<\\u%04X>"},
+        .gone_outtext  = {NULL, NULL, NULL},
+    },
+    {
+        // Deletion status has no place in bodyfile
+        .friendly_name = "Bodyfile format",
+        .fallback_tmpl = {"<\\u%04X>", "<\\%02X>", "<\\u%04X>"},
+        .gone_outtext  = {NULL, NULL, NULL},
+    },
 };
 
 
@@ -189,6 +220,25 @@ _filter_printable_char   (const char   *str,
 }
 
 
+/**
+ * @brief Count characters which would be turned into escape sequences
+ * @note Same criteria as `_filter_printable_char()`
+ */
+static size_t
+_count_unprintable_char   (const char   *str)
+{
+    size_t n = 0;
+
+    for (const char *p = str; *p; p = g_utf8_next_char (p))
+    {
+        gunichar c = g_utf8_get_char (p);
+        if (! g_unichar_isgraph (c) && c != 0x20)
+            n++;
+    }
+    return n;
+}
+
+
 static void
 _sync_pos   (GString   *str,
              gsize     *bytes_left,
@@ -216,6 +266,8 @@ _sync_pos   (GString   *str,
  * @param fmt_type Type of output format; see `fmt[]` for detail
  * @param func String transform func for post processing; can be
  * `NULL`, which still does some internal filtering
+ * @param counts Location to accumulate number of problems met during
+ * conversion; can be `NULL`
  * @param error Location to store error upon problem
  * @return UTF-8 encoded path, or `NULL` if conversion error happens
  * @note This is very similar to `g_convert_with_fallback()`, but the
@@ -232,6 +284,7 @@ conv_path_to_utf8_with_tmpl (const GString   *path,
                              const char      *from_enc,
                              out_fmt          fmt_type,
                              StrTransformFunc func,
+                             conv_counts     *counts,
                              GError         **error)
 {
     char            *i_ptr,
@@ -304,6 +357,7 @@ conv_path_to_utf8_with_tmpl (const GString   *path,
             size_t *processed = g_malloc (sizeof (size_t));
             *processed = i_size - i_left;
             g_ptr_array_add (err_offsets, processed);
+            R2_PROBE1 (conv__fallback, *processed);
         }
             _advance_octet (char_sz, &i_ptr, &i_left, s, fmt_type);
             _sync_pos (s, &o_left, &o_ptr, true);
@@ -342,12 +396,18 @@ conv_path_to_utf8_with_tmpl (const GString   *path,
         g_free (old);
     }
 
+    if (counts)
+        counts->fallbacks += err_offsets->len;
+
     g_ptr_array_free (err_offsets, TRUE);
 
     // Pass 2: Post processing, e.g. convert non-printable chars to hex
 
     g_return_val_if_fail (g_utf8_validate (s->str, -1, NULL), NULL);
 
+    if (counts)
+        counts->escaped += _count_unprintable_char (s->str);
+
     if (func == NULL)
         result = _filter_printable_char (s->str, fmt_type);
     else
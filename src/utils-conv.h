@@ -26,6 +26,11 @@ typedef enum
     FORMAT_TEXT,
     FORMAT_XML,
     FORMAT_JSON,
+    FORMAT_NDJSON,
+    FORMAT_MSGPACK,
+    FORMAT_ARROW,
+    FORMAT_SQLITE,
+    FORMAT_BODYFILE,
 } out_fmt;
 
 
@@ -48,6 +53,13 @@ typedef
 char *      (*StrTransformFunc)           (const char       *src);
 
 
+// Problems met during path conversion, for statistics
+typedef struct _conv_counts {
+    size_t fallbacks;  // illegal sequences in source encoding
+    size_t escaped;    // unprintable characters after conversion
+} conv_counts;
+
+
 bool          enc_is_ascii_compatible     (const char       *enc,
                                            GError          **error);
 
@@ -58,6 +70,7 @@ char *        conv_path_to_utf8_with_tmpl (const GString    *path,
                                            const char       *from_enc,
                                            out_fmt           fmt_type,
                                            StrTransformFunc  func,
+                                           conv_counts      *counts,
                                            GError          **error);
 
 char *        filter_escapes              (const char       *str);
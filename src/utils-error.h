@@ -8,29 +8,7 @@
 
 #include <glib.h>
 
-typedef enum
-{
-    R2_FATAL_ERROR_LIVE_UNSUPPORTED,  /* Can't detect live system env */
-    R2_FATAL_ERROR_ILLEGAL_DATA,  /* all data broken, not empty bin */
-    R2_FATAL_ERROR_TEMPFILE,
-
-} R2FatalError;
-
-/**
- * @brief Per record non-fatal error
- * @note Some error may indicate the whole record is invalidated,
- * but there also exists very minor error that doesn't.
- */
-typedef enum
-{
-    R2_REC_ERROR_DRIVE_LETTER,
-    R2_REC_ERROR_DUBIOUS_TIME,
-    R2_REC_ERROR_DUBIOUS_PATH,
-    R2_REC_ERROR_CONV_PATH,
-    R2_REC_ERROR_IDX_SIZE_INVALID,
-    R2_REC_ERROR_VER_UNSUPPORTED,  /* ($Recycle.bin) bad version */
-
-} R2RecordError;
+#include "librifiuti-types.h"
 
 typedef enum
 {
@@ -40,12 +18,6 @@ typedef enum
 
 // our own error domains
 
-#define R2_FATAL_ERROR (rifiuti_fatal_error_quark ())
-GQuark rifiuti_fatal_error_quark (void);
-
-#define R2_REC_ERROR (rifiuti_record_error_quark ())
-GQuark rifiuti_record_error_quark (void);
-
 #define R2_MISC_ERROR (rifiuti_misc_error_quark ())
 GQuark rifiuti_misc_error_quark (void);
 
@@ -0,0 +1,597 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "utils-filter.h"
+
+// Upper limit of evaluation stack, which is way more than
+// any sane person would type on command line
+#define FILTER_STACK_MAX 64
+
+// Upper limit of nested '(' and '!', so that parser recursion
+// can't exhaust C stack
+#define FILTER_NEST_MAX  64
+
+
+typedef enum
+{
+    FIELD_TIME,
+    FIELD_SIZE,
+    FIELD_INDEX,
+    FIELD_GONE,
+} _filter_field;
+
+typedef enum
+{
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE,
+} _filter_cmp;
+
+typedef enum
+{
+    FOP_CMP,        /* push result of comparing field with operand */
+    FOP_TEST_GONE,  /* push whether trashed file is gone */
+    FOP_NOT,
+    FOP_AND,
+    FOP_OR,
+} _filter_opcode;
+
+/**
+ * @brief Single instruction of compiled filter program
+ * @note Program is stored in postfix order, and evaluated
+ * with a tiny stack of boolean values.
+ */
+typedef struct
+{
+    _filter_opcode  op;
+    _filter_field   field;
+    _filter_cmp     cmp;
+    double          num;    /* operand of size and index */
+    int64_t         epoch;  /* operand of time, in seconds */
+} _filter_insn;
+
+struct _record_filter
+{
+    GArray   *prog;
+};
+
+
+typedef enum
+{
+    TOK_END,
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_AND,
+    TOK_OR,
+    TOK_NOT,
+    TOK_CMP,
+    TOK_IDENT,
+    TOK_NUMBER,
+    TOK_DATE,
+} _tok_type;
+
+typedef struct
+{
+    _tok_type     type;
+    size_t        pos;
+    _filter_cmp   cmp;
+    double        num;
+    int64_t       epoch;
+    const char   *ident;
+    size_t        len;
+} _token;
+
+typedef struct
+{
+    const char   *expr;
+    const char   *p;
+    _token        tok;
+    GArray       *prog;
+    int           depth;
+    int           nest;
+    rbin_type     type;
+    GTimeZone    *tz;
+    GError      **error;
+} _parser;
+
+
+static bool
+_syntax_error   (_parser      *ps,
+                 const char   *reason)
+{
+    if (*ps->error == NULL)
+        g_set_error (ps->error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+            _("Invalid filter expression at position %zu: %s"),
+            ps->tok.pos + 1, reason);
+    return false;
+}
+
+
+/**
+ * @brief Try to parse date literal in `YYYY-MM-DD[(T| )HH:MM[:SS]]` form
+ * @return Number of bytes consumed, or 0 if it is not a date
+ */
+static size_t
+_lex_date   (_parser   *ps,
+             int64_t   *epoch)
+{
+    const char *p = ps->p;
+    int         y, mo, d, h = 0, mi = 0, s = 0, n = 0, m = 0;
+    GDateTime  *dt;
+
+    for (int i = 0; i < 4; i++)
+        if (! g_ascii_isdigit (p[i]))
+            return 0;
+
+    if (p[4] != '-' || 3 != sscanf (p, "%4d-%2d-%2d%n", &y, &mo, &d, &n))
+        return 0;
+
+    if ((p[n] == 'T' || p[n] == ' ') && g_ascii_isdigit (p[n+1]) &&
+        2 == sscanf (p + n + 1, "%2d:%2d%n", &h, &mi, &m))
+    {
+        n += 1 + m;
+        if (p[n] == ':' && 1 == sscanf (p + n + 1, "%2d%n", &s, &m))
+            n += 1 + m;
+    }
+
+    if (NULL == (dt = g_date_time_new (ps->tz, y, mo, d, h, mi, s)))
+        return 0;
+
+    *epoch = g_date_time_to_unix (dt);
+    g_date_time_unref (dt);
+    return n;
+}
+
+
+static bool
+_next_token   (_parser   *ps)
+{
+    _token *t = &ps->tok;
+
+    while (g_ascii_isspace (*ps->p))
+        ps->p++;
+
+    t->pos = ps->p - ps->expr;
+
+    switch (*ps->p)
+    {
+    case '\0': t->type = TOK_END;    return true;
+    case '(' : t->type = TOK_LPAREN; ps->p++; return true;
+    case ')' : t->type = TOK_RPAREN; ps->p++; return true;
+
+    case '&':
+        if (ps->p[1] != '&')
+            return _syntax_error (ps, _("expecting '&&'"));
+        t->type = TOK_AND; ps->p += 2;
+        return true;
+
+    case '|':
+        if (ps->p[1] != '|')
+            return _syntax_error (ps, _("expecting '||'"));
+        t->type = TOK_OR; ps->p += 2;
+        return true;
+
+    case '!':
+        if (ps->p[1] == '=') {
+            t->type = TOK_CMP; t->cmp = CMP_NE; ps->p += 2;
+        } else {
+            t->type = TOK_NOT; ps->p++;
+        }
+        return true;
+
+    case '=':
+        t->type = TOK_CMP; t->cmp = CMP_EQ;
+        ps->p += (ps->p[1] == '=') ? 2 : 1;
+        return true;
+
+    case '<':
+    case '>':
+        t->type = TOK_CMP;
+        if (ps->p[1] == '=') {
+            t->cmp = (*ps->p == '<') ? CMP_LE : CMP_GE; ps->p += 2;
+        } else {
+            t->cmp = (*ps->p == '<') ? CMP_LT : CMP_GT; ps->p++;
+        }
+        return true;
+
+    default: break;
+    }
+
+    if (g_ascii_isalpha (*ps->p) || *ps->p == '_')
+    {
+        t->type  = TOK_IDENT;
+        t->ident = ps->p;
+        while (g_ascii_isalnum (*ps->p) || *ps->p == '_')
+            ps->p++;
+        t->len = ps->p - t->ident;
+        return true;
+    }
+
+    if (g_ascii_isdigit (*ps->p) || *ps->p == '.')
+    {
+        size_t n;
+        char  *end;
+
+        if (0 != (n = _lex_date (ps, &t->epoch)))
+        {
+            t->type = TOK_DATE;
+            ps->p  += n;
+            return true;
+        }
+        t->num = g_ascii_strtod (ps->p, &end);
+        if (end == ps->p)
+            return _syntax_error (ps, _("malformed number"));
+        t->type = TOK_NUMBER;
+        ps->p   = end;
+        return true;
+    }
+
+    return _syntax_error (ps, _("unexpected character"));
+}
+
+
+static bool
+_ident_is   (const _token   *t,
+             const char     *word)
+{
+    return (t->type == TOK_IDENT &&
+            strlen (word) == t->len &&
+            0 == g_ascii_strncasecmp (t->ident, word, t->len));
+}
+
+
+static void
+_emit   (_parser        *ps,
+         _filter_insn   *insn)
+{
+    switch (insn->op)
+    {
+    case FOP_CMP:
+    case FOP_TEST_GONE:
+        ps->depth++; break;
+    case FOP_AND:
+    case FOP_OR:
+        ps->depth--; break;
+    default: break;
+    }
+
+    if (ps->depth > FILTER_STACK_MAX)
+    {
+        _syntax_error (ps, _("expression too complex"));
+        return;
+    }
+    g_array_append_val (ps->prog, *insn);
+}
+
+
+static bool _parse_or (_parser *ps);
+
+
+static bool
+_nest_enter   (_parser   *ps)
+{
+    if (++ps->nest > FILTER_NEST_MAX)
+        return _syntax_error (ps, _("expression too complex"));
+    return true;
+}
+
+
+static bool
+_parse_primary   (_parser   *ps)
+{
+    _filter_insn insn = { 0 };
+
+    if (ps->tok.type == TOK_LPAREN)
+    {
+        if (! _nest_enter (ps) || ! _next_token (ps) || ! _parse_or (ps))
+            return false;
+        ps->nest--;
+        if (ps->tok.type != TOK_RPAREN)
+            return _syntax_error (ps, _("expecting ')'"));
+        return _next_token (ps);
+    }
+
+    if      (_ident_is (&ps->tok, "time"))  insn.field = FIELD_TIME;
+    else if (_ident_is (&ps->tok, "size"))  insn.field = FIELD_SIZE;
+    else if (_ident_is (&ps->tok, "index")) insn.field = FIELD_INDEX;
+    else if (_ident_is (&ps->tok, "gone"))  insn.field = FIELD_GONE;
+    else
+        return _syntax_error (ps,
+            _("expecting one of 'time', 'size', 'index' or 'gone'"));
+
+    if (insn.field == FIELD_INDEX && ps->type != RECYCLE_BIN_TYPE_FILE)
+        return _syntax_error (ps,
+            _("'index' field is only available for INFO2"));
+
+    if (! _next_token (ps))
+        return false;
+
+    if (insn.field == FIELD_GONE)
+    {
+        bool negate = false;
+
+        insn.op = FOP_TEST_GONE;
+        if (ps->tok.type == TOK_CMP)
+        {
+            if (ps->tok.cmp != CMP_EQ && ps->tok.cmp != CMP_NE)
+                return _syntax_error (ps,
+                    _("'gone' can only be compared with '==' or '!='"));
+            negate = (ps->tok.cmp == CMP_NE);
+            if (! _next_token (ps))
+                return false;
+            if (_ident_is (&ps->tok, "false"))
+                negate = ! negate;
+            else if (! _ident_is (&ps->tok, "true"))
+                return _syntax_error (ps, _("expecting 'true' or 'false'"));
+            if (! _next_token (ps))
+                return false;
+        }
+        _emit (ps, &insn);
+        if (negate)
+        {
+            _filter_insn neg = { .op = FOP_NOT };
+            _emit (ps, &neg);
+        }
+        return (*ps->error == NULL);
+    }
+
+    insn.op = FOP_CMP;
+    if (ps->tok.type != TOK_CMP)
+        return _syntax_error (ps, _("expecting comparison operator"));
+    insn.cmp = ps->tok.cmp;
+
+    if (! _next_token (ps))
+        return false;
+
+    if (insn.field == FIELD_TIME)
+    {
+        if (ps->tok.type != TOK_DATE)
+            return _syntax_error (ps, _("expecting date in YYYY-MM-DD form"));
+        insn.epoch = ps->tok.epoch;
+    }
+    else
+    {
+        if (ps->tok.type != TOK_NUMBER)
+            return _syntax_error (ps, _("expecting number"));
+        insn.num = ps->tok.num;
+    }
+
+    _emit (ps, &insn);
+    return (*ps->error == NULL) && _next_token (ps);
+}
+
+
+static bool
+_parse_unary   (_parser   *ps)
+{
+    _filter_insn insn = { .op = FOP_NOT };
+
+    if (ps->tok.type != TOK_NOT)
+        return _parse_primary (ps);
+
+    if (! _nest_enter (ps) || ! _next_token (ps) || ! _parse_unary (ps))
+        return false;
+    ps->nest--;
+    _emit (ps, &insn);
+    return (*ps->error == NULL);
+}
+
+
+static bool
+_parse_and   (_parser   *ps)
+{
+    _filter_insn insn = { .op = FOP_AND };
+
+    if (! _parse_unary (ps))
+        return false;
+
+    while (ps->tok.type == TOK_AND)
+    {
+        if (! _next_token (ps) || ! _parse_unary (ps))
+            return false;
+        _emit (ps, &insn);
+    }
+    return (*ps->error == NULL);
+}
+
+
+static bool
+_parse_or   (_parser   *ps)
+{
+    _filter_insn insn = { .op = FOP_OR };
+
+    if (! _parse_and (ps))
+        return false;
+
+    while (ps->tok.type == TOK_OR)
+    {
+        if (! _next_token (ps) || ! _parse_and (ps))
+            return false;
+        _emit (ps, &insn);
+    }
+    return (*ps->error == NULL);
+}
+
+
+/**
+ * @brief Compile record filter expression into predicate program
+ * @param expr The filter expression, such as
+ * `time >= 2024-01-01 && size > 1e8 && gone`
+ * @param type Recycle bin type; some fields are only available
+ * for certain type
+ * @param localtime Whether date literals are in local time zone
+ * instead of UTC
+ * @param error Location to store syntax error
+ * @return The compiled filter, or `NULL` upon error
+ * @note Supported fields are `time`, `size`, `index` (INFO2 only)
+ * and `gone`. Comparisons can be combined with `&&`, `||`, `!`
+ * and parentheses.
+ */
+record_filter *
+record_filter_compile   (const char   *expr,
+                         rbin_type     type,
+                         bool          localtime,
+                         GError      **error)
+{
+    _parser         ps = { 0 };
+    record_filter  *filter;
+
+    g_return_val_if_fail (expr != NULL, NULL);
+    g_return_val_if_fail (error != NULL && *error == NULL, NULL);
+
+    ps.expr  = ps.p = expr;
+    ps.prog  = g_array_new (FALSE, FALSE, sizeof (_filter_insn));
+    ps.type  = type;
+    ps.tz    = localtime ? g_time_zone_new_local () : g_time_zone_new_utc ();
+    ps.error = error;
+
+    if (_next_token (&ps) && _parse_or (&ps) && ps.tok.type != TOK_END)
+        _syntax_error (&ps, _("unexpected trailing data"));
+
+    g_time_zone_unref (ps.tz);
+
+    if (*error)
+    {
+        g_array_free (ps.prog, TRUE);
+        return NULL;
+    }
+
+    g_debug ("Compiled filter '%s' into %u instructions", expr, ps.prog->len);
+    filter = g_malloc0 (sizeof (record_filter));
+    filter->prog = ps.prog;
+    return filter;
+}
+
+
+static bool
+_compare   (const _filter_insn   *insn,
+            const rbin_struct    *record)
+{
+    int diff;
+
+    switch (insn->field)
+    {
+    case FIELD_TIME:
+    {
+        // Same resolution as displayed time, see win_filetime_to_gdatetime()
+        int64_t t = (record->winfiletime - 116444736000000000LL) / 10000000;
+        diff = (t > insn->epoch) - (t < insn->epoch);
+        break;
+    }
+    case FIELD_SIZE:
+    {
+        if (record->filesize == G_MAXUINT64)  // faulty, never matches
+            return false;
+        double v = (double) record->filesize;
+        diff = (v > insn->num) - (v < insn->num);
+        break;
+    }
+    case FIELD_INDEX:
+    {
+        double v = (double) record->index_n;
+        diff = (v > insn->num) - (v < insn->num);
+        break;
+    }
+    default: g_assert_not_reached ();
+    }
+
+    switch (insn->cmp)
+    {
+    case CMP_EQ: return diff == 0;
+    case CMP_NE: return diff != 0;
+    case CMP_LT: return diff <  0;
+    case CMP_LE: return diff <= 0;
+    case CMP_GT: return diff >  0;
+    case CMP_GE: return diff >= 0;
+    default: g_assert_not_reached ();
+    }
+    return false;
+}
+
+
+/**
+ * @brief Evaluate compiled filter against a record
+ * @param filter The compiled filter, can be `NULL` which accepts
+ * every record
+ * @param record The record to check, where only fixed fields
+ * (time, size, index and gone status) need to be filled
+ * @return `true` if record is wanted
+ */
+bool
+record_filter_eval   (const record_filter   *filter,
+                      const rbin_struct     *record)
+{
+    bool  stack[FILTER_STACK_MAX];
+    int   sp = 0;
+
+    if (filter == NULL)
+        return true;
+
+    for (guint i = 0; i < filter->prog->len; i++)
+    {
+        const _filter_insn *insn =
+            &g_array_index (filter->prog, _filter_insn, i);
+
+        switch (insn->op)
+        {
+        case FOP_CMP:
+            stack[sp++] = _compare (insn, record);
+            break;
+        case FOP_TEST_GONE:
+            stack[sp++] = (record->gone == FILESTATUS_GONE);
+            break;
+        case FOP_NOT:
+            stack[sp-1] = ! stack[sp-1];
+            break;
+        case FOP_AND:
+            sp--;
+            stack[sp-1] = stack[sp-1] && stack[sp];
+            break;
+        case FOP_OR:
+            sp--;
+            stack[sp-1] = stack[sp-1] || stack[sp];
+            break;
+        }
+    }
+
+    return stack[0];
+}
+
+
+/**
+ * @brief Check if filter ever tests gone status of trashed file
+ * @note Gone status is costly for `$Recycle.bin`, which needs
+ * checking existance of corresponding `$R` file
+ */
+bool
+record_filter_uses_gone   (const record_filter   *filter)
+{
+    if (filter == NULL)
+        return false;
+
+    for (guint i = 0; i < filter->prog->len; i++)
+        if (g_array_index (filter->prog, _filter_insn, i).op == FOP_TEST_GONE)
+            return true;
+    return false;
+}
+
+
+void
+record_filter_free   (record_filter   *filter)
+{
+    if (filter == NULL)
+        return;
+
+    g_array_free (filter->prog, TRUE);
+    g_free (filter);
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "utils.h"
+
+typedef struct _record_filter record_filter;
+
+record_filter *  record_filter_compile   (const char           *expr,
+                                          rbin_type             type,
+                                          bool                  localtime,
+                                          GError              **error);
+
+bool             record_filter_eval      (const record_filter  *filter,
+                                          const rbin_struct    *record);
+
+bool             record_filter_uses_gone (const record_filter  *filter);
+
+void             record_filter_free      (record_filter        *filter);
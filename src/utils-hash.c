@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "utils-error.h"
+#include "utils-hash.h"
+#include "utils-stats.h"
+
+/* Shared by all workers of single hash_payloads() run */
+typedef struct
+{
+    const parse_opts  *opts;
+    gint               queued;  // jobs pushed but not started yet
+} hash_job_ctx;
+
+static const struct
+{
+    const char     *name;
+    GChecksumType   type;
+} hash_types[] = {
+    { "md5",    G_CHECKSUM_MD5    },
+    { "sha256", G_CHECKSUM_SHA256 },
+};
+
+
+/**
+ * @brief Look up checksum type by its name as used in options
+ * @return `true` if name is supported, `false` otherwise
+ */
+bool
+hash_type_from_name   (const char      *name,
+                       GChecksumType   *type)
+{
+    for (gsize i = 0; i < G_N_ELEMENTS (hash_types); i++)
+    {
+        if (g_ascii_strcasecmp (name, hash_types[i].name) == 0)
+        {
+            *type = hash_types[i].type;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+const char *
+hash_type_name   (GChecksumType   type)
+{
+    for (gsize i = 0; i < G_N_ELEMENTS (hash_types); i++)
+        if (hash_types[i].type == type)
+            return hash_types[i].name;
+    g_return_val_if_reached (NULL);
+}
+
+
+/**
+ * @brief Format digest of checksum, prefixed with algorithm name
+ * @return Digest string such as `sha256:...`, free with `g_free()`
+ */
+char *
+hash_checksum_string   (GChecksum       *cs,
+                        GChecksumType    type)
+{
+    return g_strdup_printf ("%s:%s",
+        hash_type_name (type), g_checksum_get_string (cs));
+}
+
+
+/**
+ * @brief Compute digest of memory buffer
+ * @return Digest string such as `sha256:...`, free with `g_free()`
+ */
+char *
+hash_buffer   (GChecksumType    type,
+               const void      *buf,
+               gsize            size)
+{
+    GChecksum  *cs = g_checksum_new (type);
+    char       *result;
+
+    g_checksum_update (cs, buf, size);
+    result = hash_checksum_string (cs, type);
+    g_checksum_free (cs);
+    return result;
+}
+
+
+/**
+ * @brief Feed whole content of regular file into checksum
+ * @param buf Read buffer of `HASH_READ_SIZE` bytes
+ */
+static bool
+_hash_file   (GChecksum    *cs,
+              const char   *path,
+              guchar       *buf,
+              GError      **error)
+{
+    FILE    *fp;
+    size_t   n;
+    bool     ok;
+
+    if (NULL == (fp = g_fopen (path, "rb")))
+    {
+        int e = errno;
+        g_set_error (error, R2_REC_ERROR, R2_REC_ERROR_HASH_PAYLOAD,
+            _("Can not open trashed file '%s': %s"), path, g_strerror (e));
+        return false;
+    }
+
+    // Large sequential reads, bypassing stdio buffer
+    setvbuf (fp, NULL, _IONBF, 0);
+    while ((n = fread (buf, 1, HASH_READ_SIZE, fp)) > 0)
+        g_checksum_update (cs, buf, n);
+
+    if (! (ok = ! ferror (fp)))
+        g_set_error (error, R2_REC_ERROR, R2_REC_ERROR_HASH_PAYLOAD,
+            _("Error reading trashed file '%s'"), path);
+
+    fclose (fp);
+    return ok;
+}
+
+
+static gint
+_cmp_names   (gconstpointer   a,
+              gconstpointer   b)
+{
+    return strcmp (*(const char **) a, *(const char **) b);
+}
+
+
+/**
+ * @brief Append manifest of folder content, recursively
+ * @param root The trashed folder
+ * @param rel Path relative to `root`, `NULL` for `root` itself
+ * @param manifest The manifest to append to
+ * @note Manifest is a list of lines sorted by name within each
+ * folder. File is listed as `<digest>  <path>`, as `sha256sum` does,
+ * folder as `<path>/`, and symbolic link as `<path> -> <target>`.
+ * Path always uses `/` as separator.
+ */
+static bool
+_build_manifest   (GChecksumType   type,
+                   const char     *root,
+                   const char     *rel,
+                   guchar         *buf,
+                   GString        *manifest,
+                   GError        **error)
+{
+    GDir        *dir;
+    GPtrArray   *names;
+    const char  *name;
+    char        *dirpath;
+    bool         ok = true;
+
+    dirpath = rel ? g_build_filename (root, rel, NULL) : g_strdup (root);
+    if (NULL == (dir = g_dir_open (dirpath, 0, error)))
+    {
+        g_free (dirpath);
+        return false;
+    }
+
+    names = g_ptr_array_new_with_free_func (g_free);
+    while ((name = g_dir_read_name (dir)) != NULL)
+        g_ptr_array_add (names, g_strdup (name));
+    g_dir_close (dir);
+    g_ptr_array_sort (names, _cmp_names);
+
+    for (guint i = 0; ok && i < names->len; i++)
+    {
+        const char  *n = g_ptr_array_index (names, i);
+        char        *path = g_build_filename (dirpath, n, NULL);
+        char        *relpath = rel ? g_strconcat (rel, "/", n, NULL) :
+                                     g_strdup (n);
+
+        if (g_file_test (path, G_FILE_TEST_IS_SYMLINK))
+        {
+            char *target = g_file_read_link (path, NULL);
+            g_string_append_printf (manifest, "%s -> %s\n",
+                relpath, target ? target : "");
+            g_free (target);
+        }
+        else if (g_file_test (path, G_FILE_TEST_IS_DIR))
+        {
+            g_string_append_printf (manifest, "%s/\n", relpath);
+            ok = _build_manifest (type, root, relpath, buf, manifest, error);
+        }
+        else
+        {
+            GChecksum *cs = g_checksum_new (type);
+            if ((ok = _hash_file (cs, path, buf, error)))
+                g_string_append_printf (manifest, "%s  %s\n",
+                    g_checksum_get_string (cs), relpath);
+            g_checksum_free (cs);
+        }
+
+        g_free (path);
+        g_free (relpath);
+    }
+
+    g_ptr_array_free (names, TRUE);
+    g_free (dirpath);
+    return ok;
+}
+
+
+/* Runs in worker thread, and only touches its own record */
+static void
+_hash_payload_cb   (gpointer   data,
+                    gpointer   user_data)
+{
+    rbin_struct       *record = data;
+    hash_job_ctx      *ctx = user_data;
+    const parse_opts  *opts = ctx->opts;
+    GChecksum         *cs;
+    guchar            *buf;
+    GError            *error = NULL;
+    stats_time         mark;
+    bool               ok;
+
+    stats_mark (opts->stats, &mark);
+    stats_counter (opts->stats, "hash_queue",
+        g_atomic_int_add (&ctx->queued, -1) - 1);
+
+    cs = g_checksum_new (opts->payload_hash_type);
+    buf = g_malloc (HASH_READ_SIZE);
+
+    if (g_file_test (record->payload_path, G_FILE_TEST_IS_DIR))
+    {
+        GString *manifest = g_string_new (NULL);
+        if ((ok = _build_manifest (opts->payload_hash_type,
+            record->payload_path, NULL, buf, manifest, &error)))
+            g_checksum_update (cs, (guchar *) manifest->str, manifest->len);
+        g_string_free (manifest, TRUE);
+    }
+    else
+        ok = _hash_file (cs, record->payload_path, buf, &error);
+
+    if (ok)
+        record->payload_hash = hash_checksum_string (cs,
+            opts->payload_hash_type);
+    else if (record->error == NULL)
+        record->error = error;
+    else
+        g_error_free (error);
+
+    g_free (buf);
+    g_checksum_free (cs);
+
+    stats_span (opts->stats, "hash", "worker", &mark, record->payload_path);
+}
+
+
+/* Start with largest payloads, so they overlap with smaller ones */
+static gint
+_larger_first   (gconstpointer   a,
+                 gconstpointer   b,
+                 gpointer        data)
+{
+    const rbin_struct *ra = a, *rb = b;
+
+    UNUSED (data);
+    return (ra->filesize < rb->filesize) - (ra->filesize > rb->filesize);
+}
+
+
+/**
+ * @brief Hash trashed files of all kept records concurrently
+ * @param meta The metadata, whose records are updated with digests
+ * @note At most `hash_jobs` files are read at the same time. Trashed
+ * folder is hashed as a manifest of its content, so that its digest
+ * changes if any file inside is renamed, added, removed or modified.
+ */
+void
+hash_payloads   (metarecord   *meta)
+{
+    GThreadPool   *pool;
+    hash_job_ctx   ctx;
+
+    g_return_if_fail (meta != NULL && meta->opts->hash_payload);
+
+    ctx.opts = meta->opts;
+    ctx.queued = 0;
+    pool = g_thread_pool_new (&_hash_payload_cb, &ctx,
+        MAX (1, meta->opts->hash_jobs), FALSE, NULL);
+    g_thread_pool_set_sort_function (pool, &_larger_first, NULL);
+
+    for (guint i = 0; i < meta->records->len; i++)
+    {
+        rbin_struct *record = g_ptr_array_index (meta->records, i);
+        if (record->payload_path && ! record->payload_hash)
+        {
+            stats_counter (meta->opts->stats, "hash_queue",
+                g_atomic_int_add (&ctx.queued, 1) + 1);
+            g_thread_pool_push (pool, record, NULL);
+        }
+    }
+
+    // Wait for all jobs
+    g_thread_pool_free (pool, FALSE, TRUE);
+}
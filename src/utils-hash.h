@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "utils.h"
+
+/* Size of each read when hashing trashed files */
+#define HASH_READ_SIZE  (1 << 20)
+
+/* Default number of trashed files hashed concurrently */
+#define HASH_DEFAULT_JOBS  4
+
+bool          hash_type_from_name   (const char      *name,
+                                     GChecksumType   *type);
+
+const char *  hash_type_name        (GChecksumType    type);
+
+char *        hash_checksum_string  (GChecksum       *cs,
+                                     GChecksumType    type);
+
+char *        hash_buffer           (GChecksumType    type,
+                                     const void      *buf,
+                                     gsize            size);
+
+void          hash_payloads         (metarecord      *meta);
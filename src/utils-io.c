@@ -4,18 +4,35 @@
  * Please see LICENSE file for more info.
  */
 
+#include <string.h>
+
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
+#ifdef G_OS_WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 #include "utils-io.h"
 #include "utils-platform.h"
+#include "utils-probes.h"
+#include "utils-stats.h"
 
 
 static FILE        *out_fh             = NULL;
 static FILE        *err_fh             = NULL;
 static FILE        *prev_fh            = NULL;
 static char        *tmpfile_path       = NULL;
+static run_stats    *io_stats           = NULL;
+static FILE        *kept_fh            = NULL;
+static bool         discarding         = false;
+
+#ifdef G_OS_WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
 
 
 static void
@@ -40,6 +57,16 @@ _local_print   (const char   *str,
     }
     else
 #endif
+    if (is_stdout && io_stats)
+    {
+        stats_time mark;
+
+        stats_mark (io_stats, &mark);
+        fputs (str, fh);
+        stats_add_since (io_stats, STATS_PHASE_WRITE, &mark);
+        io_stats->bytes_written += strlen (str);
+    }
+    else
         fputs (str, fh);
 }
 
@@ -107,7 +134,13 @@ clean_tempfile   (char      *dest,
 
     if (prev_fh)
     {
+        stats_time mark;
+
+        // Buffered output is only written now
+        stats_mark (io_stats, &mark);
         fclose (out_fh);
+        stats_add_since (io_stats, STATS_PHASE_WRITE, &mark);
+        R2_PROBE1 (output__flush, dest);
         out_fh = prev_fh;
     }
 
@@ -141,13 +174,137 @@ init_handles   (void)
 }
 
 
+/**
+ * @brief Account time and size of standard output in statistics
+ * @param stats The statistics, or `NULL` to stop accounting
+ */
+void
+io_set_stats   (run_stats   *stats)
+{
+    io_stats = stats;
+}
+
+
+/**
+ * @brief Flush standard output, accounting its time in statistics
+ */
+void
+io_flush   (void)
+{
+    stats_time mark;
+
+    if (out_fh == NULL)
+        return;
+
+    stats_mark (io_stats, &mark);
+    fflush (out_fh);
+    stats_add_since (io_stats, STATS_PHASE_WRITE, &mark);
+    R2_PROBE1 (output__flush, NULL);
+}
+
+
+/**
+ * @brief Write binary data to standard output, accounting its
+ * time and size in statistics
+ * @param data The data
+ * @param len Size of data
+ * @note Unlike `g_print()`, data is not checked for UTF-8 validity
+ */
+void
+io_write   (const void   *data,
+            gsize         len)
+{
+    stats_time mark;
+
+    g_return_if_fail (out_fh != NULL);
+
+    stats_mark (io_stats, &mark);
+    fwrite (data, 1, len, out_fh);
+    stats_add_since (io_stats, STATS_PHASE_WRITE, &mark);
+    if (io_stats)
+        io_stats->bytes_written += len;
+}
+
+
+/**
+ * @brief Prepare standard output for writing binary data
+ * @param error Location to store error upon failure
+ * @return `false` if standard output is Windows console, which
+ * can't take binary data, `true` otherwise
+ */
+bool
+io_set_binary   (GError   **error)
+{
+#ifdef G_OS_WIN32
+    if (out_fh == NULL)
+    {
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("Binary output can't be shown on console, please "
+              "redirect it or use '-o' option."));
+        return false;
+    }
+    _setmode (_fileno (out_fh), _O_BINARY);
+#else
+    UNUSED (error);
+#endif
+    return true;
+}
+
+
+/**
+ * @brief Send standard output to null device, or restore it
+ * @param discard `true` to start discarding output, `false` to
+ * write to original destination again
+ * @param error Location to store error upon failure
+ * @return `true` on success, `false` if null device can't be opened
+ * @note Output is still formatted and written as usual, so that
+ * its cost is accounted, only without reaching disk or terminal
+ */
+bool
+io_discard_output   (bool       discard,
+                     GError   **error)
+{
+    FILE  *fh;
+    int    e;
+
+    if (discard == discarding)
+        return true;
+
+    if (! discard)
+    {
+        fclose (out_fh);
+        out_fh = kept_fh;
+        kept_fh = NULL;
+        discarding = false;
+        return true;
+    }
+
+    if (NULL == (fh = g_fopen (NULL_DEVICE, "wb")))
+    {
+        e = errno;
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno(e),
+            _("Can not open null device: %s"), g_strerror(e));
+        return false;
+    }
+
+    kept_fh = out_fh;
+    out_fh = fh;
+    discarding = true;
+    return true;
+}
+
+
 /**
  * @brief Close all output / error file handles before exit
  */
 void
 close_handles   (void)
 {
-    if (out_fh != NULL) fclose (out_fh);
+    if (out_fh != NULL)
+    {
+        fclose (out_fh);
+        R2_PROBE1 (output__flush, NULL);
+    }
     if (err_fh != NULL) fclose (err_fh);
     return;
 }
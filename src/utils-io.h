@@ -9,7 +9,16 @@
 #include <stdbool.h>
 #include <glib.h>
 
+#include "utils.h"
+
 void              init_handles               (void);
+void              io_set_stats               (run_stats *stats);
+void              io_flush                   (void);
+void              io_write                   (const void *data,
+                                              gsize       len);
+bool              io_set_binary              (GError   **error);
+bool              io_discard_output          (bool       discard,
+                                              GError   **error);
 void              close_handles              (void);
 bool              get_tempfile               (GError   **error);
 bool              clean_tempfile             (char      *dest,
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <glib/gi18n.h>
+
+#include "utils-memstats.h"
+
+/*
+ * Allocators of C library are replaced for the whole program, so
+ * that allocations inside GLib and iconv are seen as well. Block
+ * sizes are taken from malloc_usable_size(), which makes frees
+ * accountable without any extra header. This relies on glibc
+ * exporting its own allocators under __libc_* names, and is only
+ * built upon request because it costs a few atomic operations
+ * per allocation.
+ */
+
+extern void *__libc_malloc   (size_t size);
+extern void *__libc_calloc   (size_t n, size_t size);
+extern void *__libc_realloc  (void *ptr, size_t size);
+extern void *__libc_memalign (size_t align, size_t size);
+extern void  __libc_free     (void *ptr);
+
+static const char *phase_names[MEM_PHASE_MAX] = {
+    "other", "parse", "convert", "format"
+};
+
+static _Atomic int       cur_phase = MEM_PHASE_OTHER;
+static _Atomic uint64_t  n_allocs[MEM_PHASE_MAX];
+static _Atomic uint64_t  n_bytes[MEM_PHASE_MAX];
+static _Atomic int64_t   in_use;
+static _Atomic int64_t   peak_in_use;
+
+
+static void
+_account_alloc   (void   *ptr)
+{
+    size_t   size;
+    int      phase;
+    int64_t  now, peak;
+
+    if (ptr == NULL)
+        return;
+
+    size = malloc_usable_size (ptr);
+    phase = atomic_load_explicit (&cur_phase, memory_order_relaxed);
+    atomic_fetch_add_explicit (&n_allocs[phase], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit (&n_bytes[phase], size, memory_order_relaxed);
+
+    now = atomic_fetch_add_explicit (&in_use, (int64_t) size,
+        memory_order_relaxed) + (int64_t) size;
+    peak = atomic_load_explicit (&peak_in_use, memory_order_relaxed);
+    while (now > peak && ! atomic_compare_exchange_weak_explicit (
+        &peak_in_use, &peak, now, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+
+static void
+_account_free   (void   *ptr)
+{
+    if (ptr != NULL)
+        atomic_fetch_sub_explicit (&in_use,
+            (int64_t) malloc_usable_size (ptr), memory_order_relaxed);
+}
+
+
+void *
+malloc   (size_t   size)
+{
+    void *p = __libc_malloc (size);
+    _account_alloc (p);
+    return p;
+}
+
+
+void *
+calloc   (size_t   n,
+          size_t   size)
+{
+    void *p = __libc_calloc (n, size);
+    _account_alloc (p);
+    return p;
+}
+
+
+void *
+realloc   (void     *ptr,
+           size_t    size)
+{
+    void *p;
+
+    // Block may move, treat as free followed by allocation
+    _account_free (ptr);
+    p = __libc_realloc (ptr, size);
+    if (p)
+        _account_alloc (p);
+    else if (ptr && size)
+        _account_alloc (ptr);  // original block is intact
+    return p;
+}
+
+
+void
+free   (void   *ptr)
+{
+    _account_free (ptr);
+    __libc_free (ptr);
+}
+
+
+void *
+memalign   (size_t   align,
+            size_t   size)
+{
+    void *p = __libc_memalign (align, size);
+    _account_alloc (p);
+    return p;
+}
+
+
+void *
+aligned_alloc   (size_t   align,
+                 size_t   size)
+{
+    return memalign (align, size);
+}
+
+
+int
+posix_memalign   (void   **memptr,
+                  size_t   align,
+                  size_t   size)
+{
+    void *p;
+
+    if (align % sizeof (void *) || (align & (align - 1)))
+        return EINVAL;
+    if (NULL == (p = memalign (align, size)))
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+
+/**
+ * @brief Charge following allocations to specified phase
+ * @return The previous phase, for restoring later
+ */
+mem_phase
+mem_stats_set_phase   (mem_phase   phase)
+{
+    g_return_val_if_fail (phase < MEM_PHASE_MAX, MEM_PHASE_OTHER);
+    return atomic_exchange (&cur_phase, phase);
+}
+
+
+/**
+ * @brief Summarize allocations for display
+ * @param records Number of records processed
+ * @return Newly allocated string with trailing newline
+ */
+char *
+mem_stats_to_string   (uint64_t   records)
+{
+    GString        *s;
+    struct rusage   ru;
+    uint64_t        total = 0;
+    int64_t         peak;
+    long            peak_rss_kb = 0;
+
+    // Snapshot first, so that formatting doesn't skew numbers
+    peak = atomic_load (&peak_in_use);
+    for (int i = 0; i < MEM_PHASE_MAX; i++)
+        total += atomic_load (&n_allocs[i]);
+    if (getrusage (RUSAGE_SELF, &ru) == 0)
+        peak_rss_kb = ru.ru_maxrss;  // kilobytes on Linux
+
+    s = g_string_new (NULL);
+    g_string_append_printf (s, "%s\n%-12s%14s%16s\n", _("Memory statistics:"),
+        _("Phase"), _("Allocations"), _("Bytes"));
+    for (int i = 0; i < MEM_PHASE_MAX; i++)
+        g_string_append_printf (s, "%-12s%14" PRIu64 "%16" PRIu64 "\n",
+            phase_names[i], atomic_load (&n_allocs[i]),
+            atomic_load (&n_bytes[i]));
+
+    g_string_append_printf (s, _("Peak heap in use: %" PRId64 " bytes\n"),
+        peak);
+    g_string_append_printf (s, _("Peak RSS: %ld KiB\n"), peak_rss_kb);
+    g_string_append_printf (s, _("Records: %" PRIu64 "\n"), records);
+    if (records)
+        g_string_append_printf (s, _("Allocations per record: %.1f\n"),
+            (double) total / records);
+    if (peak > 0)
+        g_string_append_printf (s, _("Records per MiB of peak heap: %.1f\n"),
+            (double) records * 1048576 / peak);
+
+    return g_string_free (s, FALSE);
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+
+/* Phases that memory allocations are charged to */
+typedef enum
+{
+    MEM_PHASE_OTHER = 0,
+    MEM_PHASE_PARSE,
+    MEM_PHASE_CONVERT,
+    MEM_PHASE_FORMAT,
+    MEM_PHASE_MAX
+} mem_phase;
+
+#ifdef ENABLE_MEM_STATS
+
+mem_phase     mem_stats_set_phase   (mem_phase   phase);
+
+char *        mem_stats_to_string   (uint64_t    records);
+
+#else
+
+/* Allocators are not wrapped, nothing to account */
+static inline mem_phase
+mem_stats_set_phase   (mem_phase   phase)
+{
+    (void) phase;
+    return MEM_PHASE_OTHER;
+}
+
+#endif
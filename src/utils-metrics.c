@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <inttypes.h>
+
+#include "utils-error.h"
+#include "utils-metrics.h"
+
+/* Upper bounds of recycle bin duration histogram, in seconds */
+static const double bin_buckets[] = { 0.001, 0.01, 0.1, 1, 10, 60 };
+
+/* Label values of R2RecordError, in the same order */
+static const char *rec_error_names[] = {
+    "drive_letter", "dubious_time", "dubious_path", "conv_path",
+    "idx_size_invalid", "ver_unsupported", "hash_payload",
+};
+
+/* Errors are counted by code, any other error domain is lumped */
+enum { ERR_LABEL_FILE = G_N_ELEMENTS (rec_error_names), ERR_LABEL_OTHER,
+       ERR_LABEL_MAX };
+
+struct _run_metrics
+{
+    char      *program;
+    uint64_t   bins;
+    uint64_t   records;
+    uint64_t   invalid[ERR_LABEL_MAX];   // index files or segments dropped
+    uint64_t   rec_errors[ERR_LABEL_MAX];  // kept records with problem
+    uint64_t   results[EXIT_ERR_UNHANDLED + 1];  // by exit code of bin
+    uint64_t   duration_buckets[G_N_ELEMENTS (bin_buckets)];
+    double     duration_sum;
+};
+
+
+run_metrics *
+metrics_new   (const char   *program)
+{
+    run_metrics *metrics = g_malloc0 (sizeof (run_metrics));
+
+    metrics->program = g_strdup (program);
+    return metrics;
+}
+
+
+void
+metrics_free   (run_metrics   *metrics)
+{
+    if (metrics == NULL)
+        return;
+
+    g_free (metrics->program);
+    g_free (metrics);
+}
+
+
+static guint
+_error_label   (const GError   *error)
+{
+    if (error->domain == R2_REC_ERROR &&
+        error->code >= 0 && error->code < ERR_LABEL_FILE)
+        return (guint) error->code;
+    if (error->domain == G_FILE_ERROR)
+        return ERR_LABEL_FILE;
+    return ERR_LABEL_OTHER;
+}
+
+
+static const char *
+_error_label_name   (guint   label)
+{
+    if (label < ERR_LABEL_FILE)
+        return rec_error_names[label];
+    return label == ERR_LABEL_FILE ? "file" : "other";
+}
+
+
+/**
+ * @brief Count a processed recycle bin
+ * @param metrics The metrics
+ * @param meta Metadata of recycle bin, after parsing
+ * @param duration Time spent on recycle bin in microseconds
+ */
+void
+metrics_add_bin   (run_metrics        *metrics,
+                   const metarecord   *meta,
+                   gint64              duration)
+{
+    GHashTableIter  iter;
+    gpointer        val;
+    double          secs = duration / (double) G_USEC_PER_SEC;
+
+    g_return_if_fail (metrics != NULL && meta != NULL);
+
+    metrics->bins++;
+    metrics->records += meta->records->len + meta->filtered;
+
+    g_hash_table_iter_init (&iter, meta->invalid_records);
+    while (g_hash_table_iter_next (&iter, NULL, &val))
+        metrics->invalid[_error_label (val)]++;
+
+    for (guint i = 0; i < meta->records->len; i++)
+    {
+        const rbin_struct *record = g_ptr_array_index (meta->records, i);
+        if (record->error)
+            metrics->rec_errors[_error_label (record->error)]++;
+    }
+
+    // Buckets are cumulative, as in exported format
+    for (gsize i = 0; i < G_N_ELEMENTS (bin_buckets); i++)
+        if (secs <= bin_buckets[i])
+            metrics->duration_buckets[i]++;
+    metrics->duration_sum += secs;
+}
+
+
+/**
+ * @brief Count exit status of a processed recycle bin
+ */
+void
+metrics_add_result   (run_metrics   *metrics,
+                      exitcode       code)
+{
+    g_return_if_fail (metrics != NULL);
+
+    metrics->results[MIN ((guint) code, EXIT_ERR_UNHANDLED)]++;
+}
+
+
+static void
+_header   (GString      *s,
+           const char   *name,
+           const char   *type,
+           const char   *help)
+{
+    g_string_append_printf (s, "# HELP rifiuti_%s %s\n"
+        "# TYPE rifiuti_%s %s\n", name, help, name, type);
+}
+
+
+/**
+ * @brief Export metrics in Prometheus text format
+ * @param metrics The metrics
+ * @param stats Statistics of the same run
+ * @param finished Whether run is over, in which case `code` is
+ * exported as exit status of program
+ * @param code Exit status of program
+ * @return Newly allocated string
+ */
+char *
+metrics_to_string   (const run_metrics  *metrics,
+                     const run_stats    *stats,
+                     bool                finished,
+                     exitcode            code)
+{
+    GString      *s;
+    const char   *p;
+    // Exposition format always uses '.' regardless of locale
+    char          num[G_ASCII_DTOSTR_BUF_SIZE];
+
+    g_return_val_if_fail (metrics != NULL && stats != NULL, NULL);
+
+    s = g_string_new (NULL);
+    p = metrics->program;
+
+    _header (s, "bins_processed_total", "counter",
+        "Recycle bins processed.");
+    g_string_append_printf (s, "rifiuti_bins_processed_total"
+        "{program=\"%s\"} %" PRIu64 "\n", p, metrics->bins);
+
+    _header (s, "bin_results_total", "counter",
+        "Recycle bins attempted, by exit status of each.");
+    for (guint i = 0; i < G_N_ELEMENTS (metrics->results); i++)
+        if (metrics->results[i])
+            g_string_append_printf (s, "rifiuti_bin_results_total"
+                "{program=\"%s\",code=\"%u\"} %" PRIu64 "\n",
+                p, i, metrics->results[i]);
+
+    _header (s, "records_parsed_total", "counter",
+        "Valid records parsed, including those filtered out.");
+    g_string_append_printf (s, "rifiuti_records_parsed_total"
+        "{program=\"%s\"} %" PRIu64 "\n", p, metrics->records);
+
+    _header (s, "invalid_records_total", "counter",
+        "Index files or segments which can't be parsed, by error.");
+    for (guint i = 0; i < ERR_LABEL_MAX; i++)
+        g_string_append_printf (s, "rifiuti_invalid_records_total"
+            "{program=\"%s\",code=\"%s\"} %" PRIu64 "\n",
+            p, _error_label_name (i), metrics->invalid[i]);
+
+    _header (s, "record_errors_total", "counter",
+        "Parsed records with problem, by error.");
+    for (guint i = 0; i < ERR_LABEL_MAX; i++)
+        g_string_append_printf (s, "rifiuti_record_errors_total"
+            "{program=\"%s\",code=\"%s\"} %" PRIu64 "\n",
+            p, _error_label_name (i), metrics->rec_errors[i]);
+
+    _header (s, "bytes_read_total", "counter",
+        "Bytes read from index files.");
+    g_string_append_printf (s, "rifiuti_bytes_read_total"
+        "{program=\"%s\"} %" PRIu64 "\n", p, stats->bytes_read);
+
+    _header (s, "bytes_written_total", "counter",
+        "Bytes written as output.");
+    g_string_append_printf (s, "rifiuti_bytes_written_total"
+        "{program=\"%s\"} %" PRIu64 "\n", p, stats->bytes_written);
+
+    _header (s, "phase_seconds_total", "counter",
+        "Wall clock time spent in each phase of processing.");
+    for (stats_phase ph = 0; ph < STATS_PHASE_MAX; ph++)
+        g_string_append_printf (s, "rifiuti_phase_seconds_total"
+            "{program=\"%s\",phase=\"%s\"} %s\n", p,
+            stats_phase_name (ph),
+            g_ascii_formatd (num, sizeof (num), "%.6f",
+                stats->phase[ph].wall / (double) G_USEC_PER_SEC));
+
+    _header (s, "phase_cpu_seconds_total", "counter",
+        "CPU time spent in each phase of processing.");
+    for (stats_phase ph = 0; ph < STATS_PHASE_MAX; ph++)
+        g_string_append_printf (s, "rifiuti_phase_cpu_seconds_total"
+            "{program=\"%s\",phase=\"%s\"} %s\n", p,
+            stats_phase_name (ph),
+            g_ascii_formatd (num, sizeof (num), "%.6f",
+                stats->phase[ph].cpu / (double) G_USEC_PER_SEC));
+
+    _header (s, "bin_duration_seconds", "histogram",
+        "Time spent on each recycle bin.");
+    for (gsize i = 0; i < G_N_ELEMENTS (bin_buckets); i++)
+        g_string_append_printf (s, "rifiuti_bin_duration_seconds_bucket"
+            "{program=\"%s\",le=\"%s\"} %" PRIu64 "\n", p,
+            g_ascii_formatd (num, sizeof (num), "%g", bin_buckets[i]),
+            metrics->duration_buckets[i]);
+    g_string_append_printf (s,
+        "rifiuti_bin_duration_seconds_bucket"
+        "{program=\"%s\",le=\"+Inf\"} %" PRIu64 "\n"
+        "rifiuti_bin_duration_seconds_sum{program=\"%s\"} %s\n"
+        "rifiuti_bin_duration_seconds_count{program=\"%s\"} %" PRIu64 "\n",
+        p, metrics->bins,
+        p, g_ascii_formatd (num, sizeof (num), "%.6f", metrics->duration_sum),
+        p, metrics->bins);
+
+    if (finished)
+    {
+        _header (s, "exit_code", "gauge", "Exit status of last run.");
+        g_string_append_printf (s, "rifiuti_exit_code"
+            "{program=\"%s\"} %d\n", p, (int) code);
+    }
+
+    _header (s, "last_update_timestamp_seconds", "gauge",
+        "Time when metrics were written.");
+    g_string_append_printf (s, "rifiuti_last_update_timestamp_seconds"
+        "{program=\"%s\"} %" PRId64 "\n", p,
+        g_get_real_time () / G_USEC_PER_SEC);
+
+    return g_string_free (s, FALSE);
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "utils.h"
+#include "utils-stats.h"
+
+/* Counters exported in Prometheus text format */
+typedef struct _run_metrics run_metrics;
+
+run_metrics * metrics_new           (const char         *program);
+
+void          metrics_free          (run_metrics        *metrics);
+
+void          metrics_add_bin       (run_metrics        *metrics,
+                                     const metarecord   *meta,
+                                     gint64              duration);
+
+void          metrics_add_result    (run_metrics        *metrics,
+                                     exitcode            code);
+
+char *        metrics_to_string     (const run_metrics  *metrics,
+                                     const run_stats    *stats,
+                                     bool                finished,
+                                     exitcode            code);
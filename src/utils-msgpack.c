@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <string.h>
+
+#include "utils-msgpack.h"
+
+
+/* Append type marker followed by big endian integer of given size */
+static void
+_append_be   (GString    *s,
+              guint8      marker,
+              uint64_t    value,
+              guint       size)
+{
+    s = g_string_append_c (s, (char) marker);
+    while (size--)
+        s = g_string_append_c (s, (char) ((value >> (size * 8)) & 0xFF));
+}
+
+
+void
+msgpack_append_nil   (GString   *s)
+{
+    s = g_string_append_c (s, (char) 0xC0);
+}
+
+
+void
+msgpack_append_bool   (GString   *s,
+                       bool       value)
+{
+    s = g_string_append_c (s, (char) (value ? 0xC3 : 0xC2));
+}
+
+
+void
+msgpack_append_uint   (GString    *s,
+                       uint64_t    value)
+{
+    if (value <= 0x7F)  // positive fixint
+        s = g_string_append_c (s, (char) value);
+    else if (value <= G_MAXUINT8)
+        _append_be (s, 0xCC, value, 1);
+    else if (value <= G_MAXUINT16)
+        _append_be (s, 0xCD, value, 2);
+    else if (value <= G_MAXUINT32)
+        _append_be (s, 0xCE, value, 4);
+    else
+        _append_be (s, 0xCF, value, 8);
+}
+
+
+void
+msgpack_append_int   (GString   *s,
+                      int64_t    value)
+{
+    if (value >= 0)
+        msgpack_append_uint (s, (uint64_t) value);
+    else if (value >= -32)  // negative fixint
+        s = g_string_append_c (s, (char) value);
+    else if (value >= G_MININT8)
+        _append_be (s, 0xD0, (uint64_t) value, 1);
+    else if (value >= G_MININT16)
+        _append_be (s, 0xD1, (uint64_t) value, 2);
+    else if (value >= G_MININT32)
+        _append_be (s, 0xD2, (uint64_t) value, 4);
+    else
+        _append_be (s, 0xD3, (uint64_t) value, 8);
+}
+
+
+/**
+ * @brief Append string to MessagePack output
+ * @param s The output
+ * @param str String in UTF-8 encoding, which is not validated
+ */
+void
+msgpack_append_str   (GString      *s,
+                      const char   *str)
+{
+    size_t len = strlen (str);
+
+    if (len < 32)  // fixstr
+        s = g_string_append_c (s, (char) (0xA0 | len));
+    else if (len <= G_MAXUINT8)
+        _append_be (s, 0xD9, len, 1);
+    else if (len <= G_MAXUINT16)
+        _append_be (s, 0xDA, len, 2);
+    else
+        _append_be (s, 0xDB, len, 4);
+
+    s = g_string_append_len (s, str, len);
+}
+
+
+/**
+ * @brief Start a map in MessagePack output
+ * @param s The output
+ * @param n_pairs Number of key value pairs, which must be appended
+ * right after this call
+ */
+void
+msgpack_append_map   (GString    *s,
+                      uint32_t    n_pairs)
+{
+    if (n_pairs < 16)  // fixmap
+        s = g_string_append_c (s, (char) (0x80 | n_pairs));
+    else if (n_pairs <= G_MAXUINT16)
+        _append_be (s, 0xDE, n_pairs, 2);
+    else
+        _append_be (s, 0xDF, n_pairs, 4);
+}
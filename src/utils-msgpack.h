@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+
+/*
+ * Minimal MessagePack encoder, only covering types used in output.
+ * Each value is appended to string in its shortest form.
+ */
+
+void          msgpack_append_nil      (GString        *s);
+
+void          msgpack_append_bool     (GString        *s,
+                                       bool            value);
+
+void          msgpack_append_uint     (GString        *s,
+                                       uint64_t        value);
+
+void          msgpack_append_int      (GString        *s,
+                                       int64_t         value);
+
+void          msgpack_append_str      (GString        *s,
+                                       const char     *str);
+
+void          msgpack_append_map      (GString        *s,
+                                       uint32_t        n_pairs);
@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "utils-pathmatch.h"
+
+// Pattern unit matching any single character unit
+#define UNIT_WILDCARD  G_MAXUINT32
+
+
+/**
+ * @brief Literal run of a pattern between `*` wildcards
+ * @note Units are UTF-16 code units (host order) or single
+ * bytes of legacy code page, with ASCII letters already folded
+ * to lower case. `anchor` is position of a unit which is not
+ * a letter nor wildcard, so its raw bytes can be located
+ * with `memchr()` regardless of case; `-1` if there is none.
+ */
+typedef struct
+{
+    uint32_t  *units;
+    size_t     len;
+    gssize     anchor;
+} _segment;
+
+/**
+ * @brief A compiled glob or substring pattern
+ * @note Substring pattern is merely a single segment without
+ * any anchoring, i.e. equivalent to glob `*needle*`.
+ */
+typedef struct
+{
+    GArray  *segs;
+    bool     head_anchored;
+    bool     tail_anchored;
+} _pattern;
+
+/**
+ * @brief Set of path patterns, any of which can match
+ * @note Every pattern is compiled twice, against UTF-16LE paths
+ * and against paths in legacy code page. Latter list contains
+ * `NULL` for patterns not representable in that code page.
+ */
+struct _path_matcher
+{
+    GPtrArray  *uni;
+    GPtrArray  *legacy;
+};
+
+
+static inline uint32_t
+_fold   (uint32_t   u)
+{
+    return (u >= 'A' && u <= 'Z') ? u + ('a' - 'A') : u;
+}
+
+
+static inline uint32_t
+_unit_at   (const guchar   *h,
+            size_t          i,
+            size_t          char_sz)
+{
+    return (char_sz == 1) ? h[i] :
+        (uint32_t) (h[2*i] | (h[2*i+1] << 8));
+}
+
+
+static void
+_pattern_free   (_pattern   *pat)
+{
+    if (pat == NULL)
+        return;
+
+    for (guint i = 0; i < pat->segs->len; i++)
+        g_free (g_array_index (pat->segs, _segment, i).units);
+    g_array_free (pat->segs, TRUE);
+    g_free (pat);
+}
+
+
+/**
+ * @brief Encode literal UTF-8 run and append to segment units
+ * @return `false` if run can't be represented in target encoding
+ */
+static bool
+_append_literal   (GArray       *units,
+                   const char   *run,
+                   gssize        len,
+                   const char   *legacy_enc)
+{
+    if (len == 0)
+        return true;
+
+    if (legacy_enc)
+    {
+        gsize  outlen;
+        char  *s = g_convert (run, len, legacy_enc, "UTF-8",
+            NULL, &outlen, NULL);
+
+        if (s == NULL)
+            return false;
+        for (gsize i = 0; i < outlen; i++)
+        {
+            uint32_t u = _fold ((guchar) s[i]);
+            g_array_append_val (units, u);
+        }
+        g_free (s);
+    }
+    else
+    {
+        glong       outlen;
+        gunichar2  *s = g_utf8_to_utf16 (run, len, NULL, &outlen, NULL);
+
+        if (s == NULL)
+            return false;
+        for (glong i = 0; i < outlen; i++)
+        {
+            uint32_t u = _fold (s[i]);
+            g_array_append_val (units, u);
+        }
+        g_free (s);
+    }
+    return true;
+}
+
+
+static void
+_finish_segment   (_pattern   *pat,
+                   GArray     *units)
+{
+    _segment seg = { NULL, units->len, -1 };
+
+    if (units->len == 0)
+    {
+        g_array_free (units, TRUE);
+        return;
+    }
+
+    for (guint i = 0; i < units->len; i++)
+    {
+        uint32_t u = g_array_index (units, uint32_t, i);
+        if (u != UNIT_WILDCARD && ! (u >= 'a' && u <= 'z'))
+        {
+            seg.anchor = i;
+            break;
+        }
+    }
+
+    seg.units = (uint32_t *) g_array_free (units, FALSE);
+    g_array_append_val (pat->segs, seg);
+}
+
+
+/**
+ * @brief Compile glob or substring into pattern of specific encoding
+ * @param str The glob or substring, in valid UTF-8
+ * @param is_glob Whether `*` and `?` are treated as wildcards
+ * @param legacy_enc Code page of pattern, or `NULL` for UTF-16LE
+ * @return The pattern, or `NULL` if it can't be represented
+ */
+static _pattern *
+_pattern_compile   (const char   *str,
+                    bool          is_glob,
+                    const char   *legacy_enc)
+{
+    _pattern    *pat;
+    GArray      *units;
+    const char  *run = str, *p = str;
+
+    pat = g_malloc0 (sizeof (_pattern));
+    pat->segs = g_array_new (FALSE, FALSE, sizeof (_segment));
+    units = g_array_new (FALSE, FALSE, sizeof (uint32_t));
+
+    if (is_glob)
+    {
+        size_t len = strlen (str);
+        pat->head_anchored = (len == 0 || str[0] != '*');
+        pat->tail_anchored = (len == 0 || str[len-1] != '*');
+    }
+
+    for (; is_glob && *p != '\0'; p = g_utf8_next_char (p))
+    {
+        if (*p != '*' && *p != '?')
+            continue;
+
+        if (! _append_literal (units, run, p - run, legacy_enc))
+            goto conv_fail;
+        run = p + 1;
+
+        if (*p == '?')
+        {
+            uint32_t u = UNIT_WILDCARD;
+            g_array_append_val (units, u);
+        }
+        else
+        {
+            _finish_segment (pat, units);
+            units = g_array_new (FALSE, FALSE, sizeof (uint32_t));
+        }
+    }
+
+    if (! _append_literal (units, run, -1, legacy_enc))
+        goto conv_fail;
+    _finish_segment (pat, units);
+
+    return pat;
+
+    conv_fail:
+
+    g_array_free (units, TRUE);
+    _pattern_free (pat);
+    return NULL;
+}
+
+
+static bool
+_segment_match_at   (const _segment   *seg,
+                     const guchar     *h,
+                     size_t            pos,
+                     size_t            char_sz)
+{
+    for (size_t k = 0; k < seg->len; k++)
+    {
+        if (seg->units[k] == UNIT_WILDCARD)
+            continue;
+        if (_fold (_unit_at (h, pos + k, char_sz)) != seg->units[k])
+            return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Find leftmost occurrence of segment at or after `from`
+ * @return Unit position of occurrence, or `-1` if not found
+ * @note If segment contains a case-invariant unit, candidates are
+ * located with `memchr()` on its low byte, so only a tiny fraction
+ * of positions ever get compared unit by unit.
+ */
+static gssize
+_segment_find   (const _segment   *seg,
+                 const guchar     *h,
+                 size_t            n,
+                 size_t            from,
+                 size_t            char_sz)
+{
+    size_t last;
+
+    if (from > n || seg->len > n - from)
+        return -1;
+    last = n - seg->len;
+
+    if (seg->anchor < 0)
+    {
+        for (size_t i = from; i <= last; i++)
+            if (_segment_match_at (seg, h, i, char_sz))
+                return i;
+        return -1;
+    }
+
+    uint32_t  a    = seg->units[seg->anchor];
+    size_t    bpos = (from + seg->anchor) * char_sz,
+              bend = (last + seg->anchor) * char_sz;
+
+    while (bpos <= bend)
+    {
+        const guchar *hit = memchr (h + bpos, a & 0xFF, bend - bpos + 1);
+        size_t        off;
+
+        if (hit == NULL)
+            return -1;
+        off = hit - h;
+
+        // Low byte found at odd offset belongs to wrong unit
+        if (char_sz == 2 && (off & 1))
+        {
+            bpos = off + 1;
+            continue;
+        }
+        if ((char_sz == 1 || h[off+1] == (a >> 8)) &&
+            _segment_match_at (seg, h, off / char_sz - seg->anchor, char_sz))
+            return off / char_sz - seg->anchor;
+
+        bpos = off + char_sz;
+    }
+    return -1;
+}
+
+
+static bool
+_pattern_match   (const _pattern   *pat,
+                  const guchar     *h,
+                  size_t            n,
+                  size_t            char_sz)
+{
+    guint   m = pat->segs->len;
+    size_t  pos = 0;
+
+    if (m == 0)
+        return ! (pat->head_anchored && pat->tail_anchored) || n == 0;
+
+    for (guint j = 0; j < m; j++)
+    {
+        const _segment *seg = &g_array_index (pat->segs, _segment, j);
+
+        if (j == 0 && pat->head_anchored)
+        {
+            if (seg->len > n || ! _segment_match_at (seg, h, 0, char_sz))
+                return false;
+            pos = seg->len;
+            if (m == 1 && pat->tail_anchored)
+                return pos == n;
+            continue;
+        }
+
+        if (j == m - 1 && pat->tail_anchored)
+            return (seg->len <= n - pos) &&
+                _segment_match_at (seg, h, n - seg->len, char_sz);
+
+        gssize i = _segment_find (seg, h, n, pos, char_sz);
+        if (i < 0)
+            return false;
+        pos = i + seg->len;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Compile path globs and substrings into matcher
+ * @param globs `NULL` terminated list of globs, where `*` matches
+ * any number of characters (including path separator) and `?`
+ * matches single character; can be `NULL`
+ * @param substrs `NULL` terminated list of substrings; can be `NULL`
+ * @param legacy_enc Code page of legacy paths, or `NULL` if
+ * legacy paths are never matched
+ * @param error Location to store error upon failure
+ * @return The matcher, free with `path_matcher_free()`. `NULL` if
+ * there is no pattern at all, or on error.
+ * @note Globs match against full path, while substrings match
+ * anywhere. Both are case-insensitive for ASCII letters only.
+ */
+path_matcher *
+path_matcher_compile   (char * const   *globs,
+                        char * const   *substrs,
+                        const char     *legacy_enc,
+                        GError        **error)
+{
+    path_matcher  *matcher;
+    char * const  *lists[2] = { globs, substrs };
+
+    if ((globs == NULL || *globs == NULL) &&
+        (substrs == NULL || *substrs == NULL))
+        return NULL;
+
+    matcher = g_malloc0 (sizeof (path_matcher));
+    matcher->uni = g_ptr_array_new_with_free_func (
+        (GDestroyNotify) _pattern_free);
+    matcher->legacy = g_ptr_array_new_with_free_func (
+        (GDestroyNotify) _pattern_free);
+
+    for (int l = 0; l < 2; l++)
+    {
+        for (char * const *s = lists[l]; s && *s; s++)
+        {
+            _pattern *pat;
+
+            // Pattern is walked by UTF-8 character, which must not
+            // skip past end of string
+            if (! g_utf8_validate (*s, -1, NULL) ||
+                NULL == (pat = _pattern_compile (*s, l == 0, NULL)))
+            {
+                char *escaped = g_strescape (*s, NULL);
+                g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    _("Path pattern '%s' is not valid UTF-8"), escaped);
+                g_free (escaped);
+                path_matcher_free (matcher);
+                return NULL;
+            }
+            g_ptr_array_add (matcher->uni, pat);
+
+            // DBCS trail bytes may collide with ASCII letters and
+            // get folded, which can only lead to extra matches
+            g_ptr_array_add (matcher->legacy, legacy_enc ?
+                _pattern_compile (*s, l == 0, legacy_enc) : NULL);
+        }
+    }
+
+    return matcher;
+}
+
+
+/**
+ * @brief Check if raw path matches any pattern in matcher
+ * @param matcher The matcher, can be `NULL` which accepts every path
+ * @param path Raw path, either in UTF-16LE or legacy code page
+ * @param bytelen Byte length of path, excluding null terminator
+ * @param char_sz Either 1 for legacy path, or 2 for UTF-16LE path
+ * @return `true` if path matches
+ */
+bool
+path_matcher_match   (const path_matcher  *matcher,
+                      const void          *path,
+                      size_t               bytelen,
+                      size_t               char_sz)
+{
+    const GPtrArray *pats;
+
+    if (matcher == NULL)
+        return true;
+
+    g_return_val_if_fail (char_sz == 1 || char_sz == 2, false);
+
+    pats = (char_sz == 1) ? matcher->legacy : matcher->uni;
+    for (guint i = 0; i < pats->len; i++)
+    {
+        const _pattern *pat = g_ptr_array_index (pats, i);
+        if (pat && _pattern_match (pat, path, bytelen / char_sz, char_sz))
+            return true;
+    }
+    return false;
+}
+
+
+void
+path_matcher_free   (path_matcher   *matcher)
+{
+    if (matcher == NULL)
+        return;
+
+    g_ptr_array_free (matcher->uni, TRUE);
+    g_ptr_array_free (matcher->legacy, TRUE);
+    g_free (matcher);
+}
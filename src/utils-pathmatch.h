@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <glib.h>
+
+typedef struct _path_matcher path_matcher;
+
+path_matcher *  path_matcher_compile   (char * const   *globs,
+                                        char * const   *substrs,
+                                        const char     *legacy_enc,
+                                        GError        **error);
+
+bool            path_matcher_match     (const path_matcher  *matcher,
+                                        const void          *path,
+                                        size_t               bytelen,
+                                        size_t               char_sz);
+
+void            path_matcher_free      (path_matcher        *matcher);
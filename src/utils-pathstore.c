@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "utils-conv.h"
+#include "utils-pathstore.h"
+
+
+/**
+ * @brief A single interned directory component
+ * @note Component bytes include the trailing path separator,
+ * so that expanding a path is merely concatenation of all
+ * components from root onwards.
+ */
+typedef struct _path_node
+{
+    uint32_t     id;
+    uint32_t     parent;
+    uint32_t     len;
+    const char  *bytes;
+} path_node;
+
+/**
+ * @brief Hash-consed table of directory components
+ * @note Node id is the position inside `nodes` array. Paths
+ * in the same recycle bin share long prefixes, so each
+ * distinct (parent, component) pair is only stored once.
+ * Component bytes are kept in raw form (UTF-16LE or ANSI
+ * code page), and never interpreted other than locating
+ * path separators.
+ */
+struct _path_store
+{
+    GPtrArray     *nodes;
+    GHashTable    *lookup;
+    GStringChunk  *chunk;
+};
+
+
+static guint
+_node_hash   (gconstpointer  key)
+{
+    const path_node *n = key;
+    guint h = 5381 + n->parent;
+
+    for (uint32_t i = 0; i < n->len; i++)
+        h = h * 33 + (guchar) n->bytes[i];
+    return h;
+}
+
+
+static gboolean
+_node_equal   (gconstpointer  a,
+               gconstpointer  b)
+{
+    const path_node *x = a, *y = b;
+
+    return (x->parent == y->parent &&
+            x->len    == y->len    &&
+            memcmp (x->bytes, y->bytes, x->len) == 0);
+}
+
+
+/**
+ * @brief Create an empty path store
+ * @return The newly allocated store, free with `path_store_free()`
+ */
+path_store *
+path_store_new   (void)
+{
+    path_store *store = g_malloc0 (sizeof (path_store));
+
+    store->nodes  = g_ptr_array_new_with_free_func (g_free);
+    store->lookup = g_hash_table_new (_node_hash, _node_equal);
+    store->chunk  = g_string_chunk_new (4096);
+
+    // Slot 0 is reserved for root, which has no component at all
+    g_ptr_array_add (store->nodes, g_malloc0 (sizeof (path_node)));
+
+    return store;
+}
+
+
+void
+path_store_free   (path_store   *store)
+{
+    if (store == NULL)
+        return;
+
+    g_hash_table_destroy (store->lookup);
+    g_ptr_array_free (store->nodes, TRUE);
+    g_string_chunk_free (store->chunk);
+    g_free (store);
+}
+
+
+static uint32_t
+_intern_component   (path_store   *store,
+                     uint32_t      parent,
+                     const char   *bytes,
+                     size_t        len)
+{
+    path_node  key = { 0, parent, (uint32_t) len, bytes },
+              *node;
+
+    if (NULL != (node = g_hash_table_lookup (store->lookup, &key)))
+        return node->id;
+
+    node = g_malloc (sizeof (path_node));
+    node->id     = store->nodes->len;
+    node->parent = parent;
+    node->len    = (uint32_t) len;
+    node->bytes  = g_string_chunk_insert_len (store->chunk, bytes, len);
+
+    g_ptr_array_add (store->nodes, node);
+    g_hash_table_add (store->lookup, node);
+
+    return node->id;
+}
+
+
+/**
+ * @brief Split path into directory components and intern them
+ * @param store The path store
+ * @param path Raw path as read from index file; ownership is
+ * taken over by this function
+ * @param char_sz Either 1 for ANSI code page path, or 2 for
+ * UTF-16LE path
+ * @param dir_id Location to store id of interned directory, or
+ * `PATH_STORE_ROOT` if path contains no separator at all
+ * @return Newly allocated string holding only the last path
+ * component. Data beyond null terminator is discarded.
+ * @note Splitting is performed on raw bytes, so expanding the
+ * result with `path_store_expand()` always yields the original
+ * bytes up to null terminator, even for broken UTF-16 sequences
+ * or DBCS trail bytes colliding with backslash.
+ */
+GString *
+path_store_intern   (path_store   *store,
+                     GString      *path,
+                     size_t        char_sz,
+                     uint32_t     *dir_id)
+{
+    size_t    len, start = 0;
+    uint32_t  parent = PATH_STORE_ROOT;
+    GString  *leaf;
+
+    g_return_val_if_fail (store != NULL, path);
+    g_return_val_if_fail (path != NULL, path);
+    g_return_val_if_fail (char_sz == 1 || char_sz == 2, path);
+    g_return_val_if_fail (dir_id != NULL, path);
+
+    len = (char_sz == 1) ?
+        strnlen (path->str, MIN (path->len, WIN_PATH_MAX)) :
+        ucs2_bytelen (path->str, path->len);
+
+    for (size_t i = 0; i + char_sz <= len; i += char_sz)
+    {
+        if (path->str[i] != '\\')
+            continue;
+        if (char_sz == 2 && path->str[i+1] != '\0')
+            continue;
+
+        parent = _intern_component (store, parent,
+            path->str + start, i + char_sz - start);
+        start = i + char_sz;
+    }
+
+    *dir_id = parent;
+    leaf = g_string_new_len (path->str + start, len - start);
+    g_string_free (path, TRUE);
+
+    return leaf;
+}
+
+
+/**
+ * @brief Reconstruct full raw path from interned directory and leaf
+ * @param store The path store
+ * @param dir_id Directory id returned from `path_store_intern()`
+ * @param leaf Last path component returned from `path_store_intern()`
+ * @return Newly allocated full path, in same encoding as the
+ * path originally interned
+ */
+GString *
+path_store_expand   (const path_store   *store,
+                     uint32_t            dir_id,
+                     const GString      *leaf)
+{
+    GPtrArray  *chain;
+    GString    *result;
+    path_node  *node;
+
+    g_return_val_if_fail (store != NULL, NULL);
+    g_return_val_if_fail (dir_id < store->nodes->len, NULL);
+
+    chain = g_ptr_array_new ();
+    while (dir_id != PATH_STORE_ROOT)
+    {
+        node = g_ptr_array_index (store->nodes, dir_id);
+        g_ptr_array_add (chain, node);
+        dir_id = node->parent;
+    }
+
+    result = g_string_sized_new (WIN_PATH_MAX * sizeof (gunichar2));
+    for (guint i = chain->len; i > 0; i--)
+    {
+        node = g_ptr_array_index (chain, i - 1);
+        g_string_append_len (result, node->bytes, node->len);
+    }
+    if (leaf)
+        g_string_append_len (result, leaf->str, leaf->len);
+
+    g_ptr_array_free (chain, TRUE);
+    return result;
+}
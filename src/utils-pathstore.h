@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <glib.h>
+
+// Directory id denoting "no directory", i.e. the leaf is whole path
+#define PATH_STORE_ROOT 0
+
+typedef struct _path_store path_store;
+
+path_store *  path_store_new        (void);
+
+void          path_store_free       (path_store      *store);
+
+GString *     path_store_intern     (path_store      *store,
+                                     GString         *path,
+                                     size_t           char_sz,
+                                     uint32_t        *dir_id);
+
+GString *     path_store_expand     (const path_store *store,
+                                     uint32_t         dir_id,
+                                     const GString   *leaf);
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include "config.h"
+
+/*
+ * USDT probes of provider "rifiuti2", for use with tools like
+ * bpftrace or perf. They expand to nothing unless ENABLE_USDT is
+ * set during build. Probes and their arguments:
+ *
+ * - index__start (path): parsing of index file begins
+ * - index__done (path, bytes): parsing of index file ends, with
+ *   number of bytes consumed
+ * - record__populated (version, size): a record is decoded
+ * - conv__fallback (offset): illegal sequence met when converting
+ *   path, at byte offset of original path
+ * - record__emitted (filetime, size): a record is formatted
+ *   for output
+ * - output__flush (path): output is flushed to file, or standard
+ *   output if path is NULL
+ */
+
+#ifdef ENABLE_USDT
+
+#include <sys/sdt.h>
+
+#define R2_PROBE1(name, a1) \
+    DTRACE_PROBE1 (rifiuti2, name, a1)
+#define R2_PROBE2(name, a1, a2) \
+    DTRACE_PROBE2 (rifiuti2, name, a1, a2)
+
+#else
+
+#define R2_PROBE1(name, a1)      do {} while (0)
+#define R2_PROBE2(name, a1, a2)  do {} while (0)
+
+#endif
@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "utils.h"
+#include "utils-serve.h"
+
+static volatile sig_atomic_t  stop_serving = 0;
+
+
+static void
+_on_stop_signal   (int   sig)
+{
+    UNUSED (sig);
+    stop_serving = 1;
+}
+
+
+static bool
+_write_all   (int           fd,
+              const void   *buf,
+              size_t        len)
+{
+    const char *p = buf;
+
+    while (len)
+    {
+        ssize_t n = write (fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+static bool
+_read_all   (int      fd,
+             void    *buf,
+             size_t   len)
+{
+    char *p = buf;
+
+    while (len)
+    {
+        ssize_t n = read (fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+static bool
+_send_frame   (int           fd,
+               char          tag,
+               const void   *payload,
+               uint32_t      len)
+{
+    guchar hdr[5] = { (guchar) tag,
+        len >> 24, (len >> 16) & 0xFF, (len >> 8) & 0xFF, len & 0xFF };
+
+    return _write_all (fd, hdr, sizeof (hdr)) &&
+        _write_all (fd, payload, len);
+}
+
+
+/**
+ * @brief Receive a request frame from client
+ * @param fd The connection
+ * @return `NULL` terminated argument list, or `NULL` if connection
+ * is closed or client violates protocol
+ */
+static char **
+_recv_request   (int   fd)
+{
+    guchar      hdr[5];
+    uint32_t    len;
+    char       *payload;
+    GPtrArray  *args;
+
+    if (! _read_all (fd, hdr, sizeof (hdr)) || hdr[0] != SERVE_FRAME_REQUEST)
+        return NULL;
+
+    len = ((uint32_t) hdr[1] << 24) | (hdr[2] << 16) | (hdr[3] << 8) | hdr[4];
+    if (len > SERVE_MAX_REQUEST)
+        return NULL;
+
+    payload = g_malloc (len + 1);
+    if (! _read_all (fd, payload, len))
+    {
+        g_free (payload);
+        return NULL;
+    }
+    payload[len] = '\0';
+
+    // Each argument is NUL terminated, so last one may lack it
+    args = g_ptr_array_new ();
+    for (uint32_t start = 0, i = 0; i < len; i++)
+    {
+        if (payload[i] != '\0' && i + 1 < len)
+            continue;
+        g_ptr_array_add (args, g_strdup (payload + start));
+        start = i + 1;
+    }
+    g_ptr_array_add (args, NULL);
+    g_free (payload);
+
+    return (char **) g_ptr_array_free (args, FALSE);
+}
+
+
+/**
+ * @brief Run single request in child process, and relay its output
+ * @param conn The connection
+ * @param func Request handler
+ * @param args Request arguments
+ * @return `false` if connection is broken
+ */
+static bool
+_run_request   (int                conn,
+                ServeRequestFunc   func,
+                char             **args)
+{
+    int              out_pipe[2], err_pipe[2], status = 0;
+    pid_t            pid;
+    struct pollfd    fds[2];
+    char             buf[65536];
+    guchar           code[4];
+    bool             ok = true;
+
+    if (pipe (out_pipe) < 0)
+        return false;
+    if (pipe (err_pipe) < 0)
+    {
+        close (out_pipe[0]);
+        close (out_pipe[1]);
+        return false;
+    }
+
+    if ((pid = fork ()) < 0)
+    {
+        close (out_pipe[0]); close (out_pipe[1]);
+        close (err_pipe[0]); close (err_pipe[1]);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        int null_fd = open ("/dev/null", O_RDONLY);
+
+        dup2 (null_fd, STDIN_FILENO);
+        dup2 (out_pipe[1], STDOUT_FILENO);
+        dup2 (err_pipe[1], STDERR_FILENO);
+        close (null_fd);
+        close (out_pipe[0]); close (out_pipe[1]);
+        close (err_pipe[0]); close (err_pipe[1]);
+        close (conn);
+
+        _exit (func (args));
+    }
+
+    close (out_pipe[1]);
+    close (err_pipe[1]);
+
+    fds[0].fd = out_pipe[0];
+    fds[1].fd = err_pipe[0];
+    fds[0].events = fds[1].events = POLLIN;
+
+    while (fds[0].fd >= 0 || fds[1].fd >= 0)
+    {
+        if (poll (fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            ssize_t n;
+
+            if (fds[i].fd < 0 || ! fds[i].revents)
+                continue;
+
+            n = read (fds[i].fd, buf, sizeof (buf));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                close (fds[i].fd);
+                fds[i].fd = -1;
+                continue;
+            }
+            if (ok && ! _send_frame (conn,
+                i ? SERVE_FRAME_STDERR : SERVE_FRAME_STDOUT, buf, n))
+            {
+                // Client is gone, no point finishing the job
+                ok = false;
+                kill (pid, SIGTERM);
+            }
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+        if (fds[i].fd >= 0)
+            close (fds[i].fd);
+
+    while (waitpid (pid, &status, 0) < 0 && errno == EINTR)
+        ;
+
+    if (! ok)
+        return false;
+
+    status = WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status);
+    code[0] = (status >> 24) & 0xFF;
+    code[1] = (status >> 16) & 0xFF;
+    code[2] = (status >>  8) & 0xFF;
+    code[3] =  status        & 0xFF;
+
+    return _send_frame (conn, SERVE_FRAME_EXIT, code, sizeof (code));
+}
+
+
+/**
+ * @brief Serve all requests of a single client connection
+ * @note Runs in its own process. Each request is further handled
+ * in a fresh child, so that state left over by one request never
+ * leaks into next one.
+ */
+static void
+_serve_connection   (int                conn,
+                     ServeRequestFunc   func)
+{
+    char **args;
+
+    signal (SIGCHLD, SIG_DFL);
+    signal (SIGINT,  SIG_DFL);
+    signal (SIGTERM, SIG_DFL);
+
+    while ((args = _recv_request (conn)) != NULL)
+    {
+        bool ok = _run_request (conn, func, args);
+        g_strfreev (args);
+        if (! ok)
+            break;
+    }
+    close (conn);
+}
+
+
+/**
+ * @brief Listen on Unix socket and handle requests until terminated
+ * @param sock_path Path of Unix socket to create
+ * @param func Request handler, which is run in child process
+ * @param error Location to store error upon failure
+ * @return `true` if server is terminated by `SIGINT` or `SIGTERM`,
+ * `false` if socket can't be set up
+ * @note Every client connection is served by forked process, so
+ * multiple clients are handled concurrently. Forking from this warm
+ * process avoids program startup, dynamic linking and initialization
+ * cost for each request. Socket is removed upon termination.
+ */
+bool
+serve_requests   (const char        *sock_path,
+                  ServeRequestFunc   func,
+                  GError           **error)
+{
+    struct sockaddr_un  addr;
+    struct sigaction    sa;
+    int                 lsock, e;
+    mode_t              old_mask;
+
+    if (strlen (sock_path) >= sizeof (addr.sun_path))
+    {
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NAMETOOLONG,
+            _("Socket path '%s' is too long"), sock_path);
+        return false;
+    }
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, sock_path);
+
+    // Only owner may connect, whatever umask the caller has; mode
+    // is set upon creation, so there is no window for others
+    old_mask = umask (0177);
+    if ((lsock = socket (AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind (lsock, (struct sockaddr *) &addr, sizeof (addr)) < 0 ||
+        listen (lsock, SOMAXCONN) < 0)
+    {
+        e = errno;
+        umask (old_mask);
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (e),
+            _("Can not listen on socket '%s': %s"),
+            sock_path, g_strerror (e));
+        if (lsock >= 0)
+            close (lsock);
+        return false;
+    }
+    umask (old_mask);
+
+    // Finished connection processes are reaped automatically
+    signal (SIGCHLD, SIG_IGN);
+    signal (SIGPIPE, SIG_IGN);
+
+    // No SA_RESTART, so that accept() is interrupted
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = _on_stop_signal;
+    sigemptyset (&sa.sa_mask);
+    sigaction (SIGINT,  &sa, NULL);
+    sigaction (SIGTERM, &sa, NULL);
+
+    g_debug ("Listening on %s", sock_path);
+
+    while (! stop_serving)
+    {
+        int    conn;
+        pid_t  pid;
+
+        if ((conn = accept (lsock, NULL, NULL)) < 0)
+        {
+            if (errno != EINTR && errno != ECONNABORTED)
+                g_warning ("accept() failed: %s", g_strerror (errno));
+            continue;
+        }
+
+        if ((pid = fork ()) == 0)
+        {
+            close (lsock);
+            _serve_connection (conn, func);
+            _exit (0);
+        }
+        if (pid < 0)
+            g_warning ("fork() failed: %s", g_strerror (errno));
+
+        close (conn);
+    }
+
+    close (lsock);
+    g_unlink (sock_path);
+
+    return true;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <glib.h>
+
+/*
+ * Framed protocol used over Unix socket in server mode. Every frame
+ * consists of 1 byte tag, payload length as 4 byte big endian
+ * unsigned integer, then the payload itself.
+ *
+ * Client sends SERVE_FRAME_REQUEST, whose payload is a list of
+ * command line arguments (without program name), each terminated
+ * by NUL. Server replies with any number of SERVE_FRAME_STDOUT and
+ * SERVE_FRAME_STDERR frames, followed by SERVE_FRAME_EXIT, whose
+ * payload is exit status as 4 byte big endian integer. Client may
+ * send next request after receiving exit status.
+ */
+#define SERVE_FRAME_REQUEST  'R'
+#define SERVE_FRAME_STDOUT   'O'
+#define SERVE_FRAME_STDERR   'E'
+#define SERVE_FRAME_EXIT     'X'
+
+#define SERVE_MAX_REQUEST    (1 << 20)
+
+/**
+ * @brief Handle a single request, inside dedicated child process
+ * @param args `NULL` terminated argument list of request
+ * @return Exit status of request
+ * @note Standard output and error are already redirected to client
+ */
+typedef int (*ServeRequestFunc)   (char   **args);
+
+bool              serve_requests             (const char        *sock_path,
+                                              ServeRequestFunc   func,
+                                              GError           **error);
@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <sqlite3.h>
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "utils-error.h"
+#include "utils-sqlite.h"
+
+/*
+ * Database has one row per recycle bin in `bins` table, which
+ * rows of `records` and `errors` tables refer to. The whole load
+ * happens in a single transaction, and indexes are only created
+ * at the end, as maintaining them for each insertion is slower.
+ */
+
+static const char schema_sql[] =
+    "CREATE TABLE IF NOT EXISTS bins ("
+    " id INTEGER PRIMARY KEY,"
+    " path TEXT NOT NULL,"
+    " format TEXT NOT NULL,"          // 'file' for INFO2, 'dir' otherwise
+    " version INTEGER,"
+    " ever_existed INTEGER,"
+    " index_hash TEXT,"
+    " filtered INTEGER NOT NULL);"
+    "CREATE TABLE IF NOT EXISTS records ("
+    " bin_id INTEGER NOT NULL REFERENCES bins (id),"
+    " idx,"                           // number for INFO2, file name otherwise
+    " filetime INTEGER NOT NULL,"
+    " time TEXT,"
+    " gone INTEGER,"                  // NULL if unknown
+    " size INTEGER,"
+    " path TEXT,"
+    " hash TEXT,"
+    " index_hash TEXT);"
+    "CREATE TABLE IF NOT EXISTS errors ("
+    " bin_id INTEGER NOT NULL REFERENCES bins (id),"
+    " source TEXT NOT NULL,"          // index file, or record index
+    " domain TEXT NOT NULL,"
+    " code INTEGER NOT NULL,"
+    " message TEXT NOT NULL);";
+
+static const char index_sql[] =
+    "CREATE INDEX IF NOT EXISTS records_bin ON records (bin_id);"
+    "CREATE INDEX IF NOT EXISTS records_filetime ON records (filetime);"
+    "CREATE INDEX IF NOT EXISTS errors_bin ON errors (bin_id);";
+
+enum { STMT_BIN, STMT_RECORD, STMT_ERROR, STMT_MAX };
+
+static const char *stmt_sql[STMT_MAX] = {
+    "INSERT INTO bins (path, format, version, ever_existed, index_hash,"
+    " filtered) VALUES (?, ?, ?, ?, ?, ?)",
+    "INSERT INTO records (bin_id, idx, filetime, time, gone, size, path,"
+    " hash, index_hash) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    "INSERT INTO errors (bin_id, source, domain, code, message)"
+    " VALUES (?, ?, ?, ?, ?)",
+};
+
+struct _sqlite_out
+{
+    char          *path;
+    sqlite3       *handle;
+    sqlite3_stmt  *stmt[STMT_MAX];
+    sqlite3_int64  bin_id;
+};
+
+
+static void
+_set_db_error   (sqlite_out   *db,
+                 GError      **error)
+{
+    g_set_error (error, R2_FATAL_ERROR, R2_FATAL_ERROR_SQLITE,
+        _("Can not write database '%s': %s"), db->path,
+        db->handle ? sqlite3_errmsg (db->handle) : "out of memory");
+}
+
+
+static void
+_free_db   (sqlite_out   *db)
+{
+    for (int i = 0; i < STMT_MAX; i++)
+        sqlite3_finalize (db->stmt[i]);
+    sqlite3_close (db->handle);
+    g_free (db->path);
+    g_free (db);
+}
+
+
+/**
+ * @brief Create database for output, and start loading data
+ * @param path Location of database file, which must not exist
+ * @param error Location to store error upon failure
+ * @return The database, or `NULL` upon failure
+ * @note Nothing is visible to other readers until
+ * `sqlite_out_close()` commits the load
+ */
+sqlite_out *
+sqlite_out_open   (const char   *path,
+                   GError      **error)
+{
+    sqlite_out *db;
+
+    g_return_val_if_fail (path != NULL, NULL);
+
+    db = g_malloc0 (sizeof (sqlite_out));
+    db->path = g_strdup (path);
+
+    if (sqlite3_open_v2 (path, &db->handle,
+            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK ||
+        sqlite3_exec (db->handle, "BEGIN", NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_exec (db->handle, schema_sql, NULL, NULL, NULL) != SQLITE_OK)
+        goto open_fail;
+
+    for (int i = 0; i < STMT_MAX; i++)
+        if (sqlite3_prepare_v2 (db->handle, stmt_sql[i], -1,
+                &db->stmt[i], NULL) != SQLITE_OK)
+            goto open_fail;
+
+    return db;
+
+    open_fail:
+
+    _set_db_error (db, error);
+    _free_db (db);
+    g_unlink (path);
+    return NULL;
+}
+
+
+static void
+_bind_text_or_null   (sqlite3_stmt   *stmt,
+                      int             col,
+                      const char     *text)
+{
+    if (text)
+        sqlite3_bind_text (stmt, col, text, -1, SQLITE_STATIC);
+    else
+        sqlite3_bind_null (stmt, col);
+}
+
+
+static bool
+_step   (sqlite_out     *db,
+         sqlite3_stmt   *stmt,
+         GError        **error)
+{
+    bool result = (sqlite3_step (stmt) == SQLITE_DONE);
+
+    if (! result)
+        _set_db_error (db, error);
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    return result;
+}
+
+
+/**
+ * @brief Add recycle bin, which later records and errors belong to
+ * @param db The database
+ * @param meta Metadata of recycle bin
+ * @param error Location to store error upon failure
+ * @return `true` on success
+ */
+bool
+sqlite_out_add_bin   (sqlite_out         *db,
+                      const metarecord   *meta,
+                      GError            **error)
+{
+    sqlite3_stmt  *stmt = db->stmt[STMT_BIN];
+    char          *path = g_filename_display_name (meta->filename);
+    bool           result;
+
+    sqlite3_bind_text (stmt, 1, path, -1, SQLITE_STATIC);
+    sqlite3_bind_text (stmt, 2,
+        (meta->type == RECYCLE_BIN_TYPE_FILE) ? "file" : "dir", -1,
+        SQLITE_STATIC);
+    if (meta->version >= 0)  /* can be found and not error */
+        sqlite3_bind_int64 (stmt, 3, meta->version);
+    if (meta->type == RECYCLE_BIN_TYPE_FILE && meta->total_entry > 0)
+        sqlite3_bind_int64 (stmt, 4, meta->total_entry);
+    _bind_text_or_null (stmt, 5, meta->index_hash);
+    sqlite3_bind_int64 (stmt, 6, meta->filtered);
+
+    if ((result = _step (db, stmt, error)))
+        db->bin_id = sqlite3_last_insert_rowid (db->handle);
+
+    g_free (path);
+    return result;
+}
+
+
+/**
+ * @brief Add record to last recycle bin
+ * @param db The database
+ * @param record The record
+ * @param meta Metadata of recycle bin
+ * @param time Formatted deletion time
+ * @param path Formatted path, or `NULL` if it can't be converted
+ * @param error Location to store error upon failure
+ * @return `true` on success
+ */
+bool
+sqlite_out_add_record   (sqlite_out          *db,
+                         const rbin_struct   *record,
+                         const metarecord    *meta,
+                         const char          *time,
+                         const char          *path,
+                         GError             **error)
+{
+    sqlite3_stmt *stmt = db->stmt[STMT_RECORD];
+
+    sqlite3_bind_int64 (stmt, 1, db->bin_id);
+    if (meta->type == RECYCLE_BIN_TYPE_FILE)
+        sqlite3_bind_int64 (stmt, 2, record->index_n);
+    else
+        sqlite3_bind_text (stmt, 2, record->index_s, -1, SQLITE_STATIC);
+    sqlite3_bind_int64 (stmt, 3, record->winfiletime);
+    _bind_text_or_null (stmt, 4, time);
+    if (record->gone != FILESTATUS_UNKNOWN)
+        sqlite3_bind_int (stmt, 5, record->gone == FILESTATUS_GONE);
+    if (record->filesize != G_MAXUINT64)  // faulty
+        sqlite3_bind_int64 (stmt, 6, (sqlite3_int64) record->filesize);
+    _bind_text_or_null (stmt, 7, path);
+    _bind_text_or_null (stmt, 8, record->payload_hash);
+    _bind_text_or_null (stmt, 9, record->index_hash);
+
+    return _step (db, stmt, error);
+}
+
+
+/**
+ * @brief Add error of last recycle bin
+ * @param db The database
+ * @param source Index file or record which error belongs to
+ * @param err The error to be kept
+ * @param error Location to store error upon failure
+ * @return `true` on success
+ */
+bool
+sqlite_out_add_error   (sqlite_out     *db,
+                        const char     *source,
+                        const GError   *err,
+                        GError        **error)
+{
+    sqlite3_stmt *stmt = db->stmt[STMT_ERROR];
+
+    sqlite3_bind_int64 (stmt, 1, db->bin_id);
+    sqlite3_bind_text (stmt, 2, source, -1, SQLITE_STATIC);
+    sqlite3_bind_text (stmt, 3, g_quark_to_string (err->domain), -1,
+        SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 4, err->code);
+    sqlite3_bind_text (stmt, 5, err->message, -1, SQLITE_STATIC);
+
+    return _step (db, stmt, error);
+}
+
+
+/**
+ * @brief Finish loading data and close database
+ * @param db The database, which is always freed
+ * @param commit Whether loaded data is kept; otherwise database
+ * file is removed
+ * @param error Location to store error upon failure
+ * @return `true` if data is committed
+ */
+bool
+sqlite_out_close   (sqlite_out   *db,
+                    bool          commit,
+                    GError      **error)
+{
+    bool  result = false;
+    char *path;
+
+    g_return_val_if_fail (db != NULL, false);
+
+    if (commit)
+    {
+        result =
+            sqlite3_exec (db->handle, index_sql, NULL, NULL, NULL) == SQLITE_OK &&
+            sqlite3_exec (db->handle, "COMMIT", NULL, NULL, NULL) == SQLITE_OK;
+        if (! result)
+            _set_db_error (db, error);
+    }
+
+    path = db->path;
+    db->path = NULL;
+    if (! result)
+        sqlite3_exec (db->handle, "ROLLBACK", NULL, NULL, NULL);
+    _free_db (db);
+
+    // Database is only created by us, and partial load is useless
+    if (! result)
+        g_unlink (path);
+    g_free (path);
+    return result;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "utils.h"
+
+typedef struct _sqlite_out sqlite_out;
+
+sqlite_out *  sqlite_out_open         (const char          *path,
+                                       GError             **error);
+
+bool          sqlite_out_add_bin      (sqlite_out          *db,
+                                       const metarecord    *meta,
+                                       GError             **error);
+
+bool          sqlite_out_add_record   (sqlite_out          *db,
+                                       const rbin_struct   *record,
+                                       const metarecord    *meta,
+                                       const char          *time,
+                                       const char          *path,
+                                       GError             **error);
+
+bool          sqlite_out_add_error    (sqlite_out          *db,
+                                       const char          *source,
+                                       const GError        *err,
+                                       GError             **error);
+
+bool          sqlite_out_close        (sqlite_out          *db,
+                                       bool                 commit,
+                                       GError             **error);
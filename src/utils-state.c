@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <string.h>
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "utils-conv.h"
+#include "utils-error.h"
+#include "utils-stats.h"
+#include "utils-state.h"
+
+/*
+ * State file is a key file, with one group per `$Recycle.bin` index
+ * file named after its path. Besides file identity (inode, size and
+ * mtime), the whole index file content is kept, so that unchanged
+ * index files need not be opened nor read again in later scans.
+ */
+
+struct _scan_state
+{
+    char      *path;
+    GKeyFile  *kf;
+    bool       dirty;
+};
+
+
+/**
+ * @brief Load scan state from file
+ * @param path Location of state file
+ * @param error Location to store error upon failure
+ * @return The state, or `NULL` if file exists but is unusable
+ * @note Non-existent state file is treated as empty state
+ */
+scan_state *
+scan_state_load   (const char   *path,
+                   GError      **error)
+{
+    scan_state  *state;
+    GError      *err = NULL;
+
+    g_return_val_if_fail (path != NULL, NULL);
+
+    state = g_malloc0 (sizeof (scan_state));
+    state->path = g_strdup (path);
+    state->kf = g_key_file_new ();
+
+    if (! g_key_file_load_from_file (state->kf, path, G_KEY_FILE_NONE, &err))
+    {
+        if (! g_error_matches (err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+            g_set_error (error, R2_FATAL_ERROR, R2_FATAL_ERROR_STATE_FILE,
+                _("Can not load state file '%s': %s"), path, err->message);
+            g_error_free (err);
+            scan_state_free (state);
+            return NULL;
+        }
+        g_clear_error (&err);
+    }
+
+    return state;
+}
+
+
+/* Group names in key file can't contain these */
+static bool
+_usable_group_name   (const char   *name)
+{
+    return strpbrk (name, "[]\r\n") == NULL;
+}
+
+
+/**
+ * @brief Fetch cached content of index file if it is unchanged
+ * @return Index file content, or `NULL` if not usable
+ */
+static guchar *
+_cached_content   (GKeyFile         *kf,
+                   const char       *group,
+                   const GStatBuf   *st,
+                   gsize            *size)
+{
+    GError  *err = NULL;
+    char    *data;
+    guchar  *buf;
+    bool     same;
+
+    if (! g_key_file_has_group (kf, group))
+        return NULL;
+
+    same = (g_key_file_get_uint64 (kf, group, "inode", &err) ==
+            (guint64) st->st_ino) && ! err;
+    same = same && (g_key_file_get_uint64 (kf, group, "size", &err) ==
+            (guint64) st->st_size) && ! err;
+    same = same && (g_key_file_get_int64 (kf, group, "mtime", &err) ==
+            (gint64) st->st_mtime) && ! err;
+    g_clear_error (&err);
+
+    if (! same)
+        return NULL;
+
+    if (NULL == (data = g_key_file_get_string (kf, group, "data", NULL)))
+        return NULL;
+
+    buf = g_base64_decode (data, size);
+    g_free (data);
+
+    if (*size != (gsize) st->st_size)
+    {
+        g_free (buf);
+        return NULL;
+    }
+    return buf;
+}
+
+
+/**
+ * @brief Parse single index file, reusing cached content if possible
+ * @return `true` if cached content is used
+ */
+static bool
+_parse_index_file   (scan_state   *state,
+                     const char   *path,
+                     metarecord   *meta)
+{
+    GStatBuf   st;
+    guchar    *cached;
+    char      *buf = NULL;
+    char      *data;
+    gsize      size = 0;
+    stats_time mark;
+    bool       ok;
+
+    // Empty files are not cached, but they are invalid anyway
+    if (! _usable_group_name (path) || g_stat (path, &st) != 0 ||
+        st.st_size == 0)
+    {
+        parse_vista_index (path, meta);
+        return false;
+    }
+
+    if (NULL != (cached = _cached_content (state->kf, path, &st, &size)))
+    {
+        parse_vista_buffer (path, cached, size, meta);
+        g_free (cached);
+        return true;
+    }
+
+    stats_mark (meta->opts->stats, &mark);
+    ok = g_file_get_contents (path, &buf, &size, NULL);
+    stats_add_since (meta->opts->stats, STATS_PHASE_READ, &mark);
+
+    if (! ok)
+    {
+        // Let parser record the error
+        g_key_file_remove_group (state->kf, path, NULL);
+        state->dirty = true;
+        parse_vista_index (path, meta);
+        return false;
+    }
+
+    stats_add_read (meta->opts->stats, size);
+
+    data = g_base64_encode ((const guchar *) buf, size);
+    g_key_file_set_uint64 (state->kf, path, "inode", (guint64) st.st_ino);
+    g_key_file_set_uint64 (state->kf, path, "size", (guint64) size);
+    g_key_file_set_int64  (state->kf, path, "mtime", (gint64) st.st_mtime);
+    g_key_file_set_string (state->kf, path, "data", data);
+    state->dirty = true;
+    g_free (data);
+
+    parse_vista_buffer (path, buf, size, meta);
+    g_free (buf);
+
+    return false;
+}
+
+
+/**
+ * @brief Get original path of trashed file from cached index file
+ * @return Path in UTF-8, or `NULL` if not decodable
+ */
+static char *
+_cached_trash_path   (GKeyFile     *kf,
+                      const char   *group)
+{
+    static const parse_opts  all_fields = { .fields = ~0u };
+    metarecord  *m;
+    char        *data, *result = NULL;
+    guchar      *buf;
+    gsize        size;
+
+    if (NULL == (data = g_key_file_get_string (kf, group, "data", NULL)))
+        return NULL;
+    buf = g_base64_decode (data, &size);
+    g_free (data);
+
+    m = meta_new (RECYCLE_BIN_TYPE_DIR, &all_fields);
+    m->isolated_index = true;  // skip checking trashed file
+    if (size)
+        parse_vista_buffer (group, buf, size, m);
+
+    if (m->records->len)
+    {
+        GString        *full = NULL;
+        const GString  *src = record_get_raw_path (m,
+            g_ptr_array_index (m->records, 0), &full);
+
+        if (src)
+            result = conv_path_to_utf8_with_tmpl (src, NULL,
+                FORMAT_TEXT, NULL, NULL, NULL);
+        if (full)
+            g_string_free (full, TRUE);
+    }
+
+    meta_free (m);
+    g_free (buf);
+    return result;
+}
+
+
+static void
+_removal_free   (gpointer   data)
+{
+    state_removal *r = data;
+
+    g_free (r->index_s);
+    g_free (r->path);
+    g_free (r);
+}
+
+
+/**
+ * @brief Parse all index files of recycle bin with help of saved state
+ * @param state The scan state, which is updated for later saving
+ * @param meta The metadata, whose index files are all parsed and
+ * removed from list afterwards
+ * @return Array of `state_removal`, for index files which were seen
+ * in previous scans of same folder but are now gone
+ */
+GPtrArray *
+scan_state_apply   (scan_state   *state,
+                    metarecord   *meta)
+{
+    GHashTable  *dirs, *seen;
+    GPtrArray   *removals;
+    char       **groups;
+    guint        reused = 0;
+    bool         whole_dir;
+
+    g_return_val_if_fail (state != NULL, NULL);
+    g_return_val_if_fail (
+        meta != NULL && meta->type == RECYCLE_BIN_TYPE_DIR, NULL);
+
+    removals = g_ptr_array_new_with_free_func (_removal_free);
+
+    dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+    // Recycle bin may be empty now; normalize folder name the same
+    // way as index file paths are constructed
+    if (meta->filename && g_file_test (meta->filename, G_FILE_TEST_IS_DIR))
+    {
+        char *probe = g_build_filename (meta->filename, "x", NULL);
+        g_hash_table_add (dirs, g_path_get_dirname (probe));
+        g_free (probe);
+    }
+
+    // Single index file doesn't tell anything about its siblings
+    whole_dir = ! (meta->filename &&
+        g_file_test (meta->filename, G_FILE_TEST_IS_REGULAR));
+
+    for (guint i = 0; i < meta->idxfiles->len; i++)
+    {
+        const char *path = g_ptr_array_index (meta->idxfiles, i);
+
+        g_hash_table_add (seen, (gpointer) path);
+        if (whole_dir)
+            g_hash_table_add (dirs, g_path_get_dirname (path));
+        if (_parse_index_file (state, path, meta))
+            reused++;
+    }
+
+    g_debug ("%u of %u index files reused from state",
+        reused, meta->idxfiles->len);
+
+    groups = g_key_file_get_groups (state->kf, NULL);
+    for (char **g = groups; *g; g++)
+    {
+        char *dir = g_path_get_dirname (*g);
+        bool removed = ! g_hash_table_contains (seen, *g) &&
+            g_hash_table_contains (dirs, dir);
+        g_free (dir);
+
+        if (! removed)
+            continue;
+
+        char *base = g_path_get_basename (*g);
+        state_removal *r = g_new0 (state_removal, 1);
+
+        r->index_s = g_filename_display_name (base);
+        r->path = _cached_trash_path (state->kf, *g);
+        g_ptr_array_add (removals, r);
+        g_free (base);
+        g_key_file_remove_group (state->kf, *g, NULL);
+        state->dirty = true;
+    }
+    g_strfreev (groups);
+
+    g_hash_table_destroy (seen);
+    g_hash_table_destroy (dirs);
+
+    // All parsed, leave nothing to parse_recycle_bin()
+    g_ptr_array_set_size (meta->idxfiles, 0);
+
+    return removals;
+}
+
+
+/**
+ * @brief Write scan state back to its file if it is changed
+ * @param state The scan state
+ * @param error Location to store error upon failure
+ * @return `true` on success, `false` otherwise
+ * @note File is replaced atomically
+ */
+bool
+scan_state_save   (scan_state   *state,
+                   GError      **error)
+{
+    GError *err = NULL;
+
+    g_return_val_if_fail (state != NULL, false);
+
+    if (! state->dirty)
+        return true;
+
+    if (! g_key_file_save_to_file (state->kf, state->path, &err))
+    {
+        g_set_error (error, R2_FATAL_ERROR, R2_FATAL_ERROR_STATE_FILE,
+            _("Can not save state file '%s': %s"), state->path, err->message);
+        g_error_free (err);
+        return false;
+    }
+
+    state->dirty = false;
+    return true;
+}
+
+
+void
+scan_state_free   (scan_state   *state)
+{
+    if (state == NULL)
+        return;
+
+    g_key_file_free (state->kf);
+    g_free (state->path);
+    g_free (state);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "utils.h"
+
+typedef struct _scan_state scan_state;
+
+/**
+ * @brief Index file seen in previous scan but gone now
+ */
+typedef struct _state_removal
+{
+    char  *index_s;  /* Index file name, in UTF-8 for display */
+    char  *path;  /* Original path of trashed file, `NULL` if unknown */
+} state_removal;
+
+scan_state *  scan_state_load       (const char      *path,
+                                     GError         **error);
+
+GPtrArray *   scan_state_apply      (scan_state      *state,
+                                     metarecord      *meta);
+
+bool          scan_state_save       (scan_state      *state,
+                                     GError         **error);
+
+void          scan_state_free       (scan_state      *state);
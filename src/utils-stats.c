@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib/gi18n.h>
+
+#include "utils-stats.h"
+
+static const char *phase_names[STATS_PHASE_MAX] = {
+    "enumerate", "read", "parse", "convert", "format", "write"
+};
+
+
+static gint64
+_cpu_time   (void)
+{
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+    struct timespec ts;
+
+    if (clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts) == 0)
+        return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+#endif
+    return (gint64) clock () * G_USEC_PER_SEC / CLOCKS_PER_SEC;
+}
+
+
+void
+stats_init   (run_stats   *stats)
+{
+    g_return_if_fail (stats != NULL);
+
+    memset (stats, 0, sizeof (run_stats));
+    stats_mark (stats, &stats->start);
+}
+
+
+/**
+ * @brief Remember current time as start of a timed phase
+ * @param stats The statistics, can be `NULL` in which case
+ * nothing is done
+ * @param mark Location to store current time
+ */
+void
+stats_mark   (const run_stats   *stats,
+              stats_time        *mark)
+{
+    if (stats == NULL)
+        return;
+
+    mark->wall = g_get_monotonic_time ();
+    mark->cpu  = _cpu_time ();
+}
+
+
+/**
+ * @brief Add time elapsed since mark to phase
+ * @param stats The statistics, can be `NULL` in which case
+ * nothing is done
+ * @param phase The phase to be charged
+ * @param mark Start of phase as set by `stats_mark()`
+ * @note Called once per record in some phases, so it doesn't
+ * write trace; see `stats_trace_phases()`
+ */
+void
+stats_add_since   (run_stats          *stats,
+                   stats_phase         phase,
+                   const stats_time   *mark)
+{
+    if (stats == NULL)
+        return;
+
+    g_return_if_fail (phase < STATS_PHASE_MAX);
+
+    stats->phase[phase].wall += g_get_monotonic_time () - mark->wall;
+    stats->phase[phase].cpu  += _cpu_time () - mark->cpu;
+}
+
+
+/**
+ * @brief Record time spent in each phase since last call in trace
+ * @param stats The statistics, can be `NULL` in which case
+ * nothing is done
+ * @param detail Extra info attached to every span, can be `NULL`
+ * @note Phases are interleaved during processing, so each one is
+ * recorded as a single span of its accumulated time. Spans are
+ * placed one after another in phase order, ending at current time.
+ * Counter of bytes read is updated along with them.
+ */
+void
+stats_trace_phases   (run_stats    *stats,
+                      const char   *detail)
+{
+    gint64 delta[STATS_PHASE_MAX];
+    gint64 start, total = 0;
+
+    if (stats == NULL || stats->trace == NULL)
+        return;
+
+    for (int i = 0; i < STATS_PHASE_MAX; i++)
+    {
+        delta[i] = stats->phase[i].wall - stats->traced[i];
+        stats->traced[i] = stats->phase[i].wall;
+        total += delta[i];
+    }
+    if (total == 0)
+        return;
+
+    start = g_get_monotonic_time () - total;
+    for (int i = 0; i < STATS_PHASE_MAX; i++)
+    {
+        if (delta[i] == 0)
+            continue;
+        trace_span (stats->trace, phase_names[i], "phase",
+            start, start + delta[i], detail);
+        start += delta[i];
+    }
+    trace_counter (stats->trace, "bytes_read", (gint64) stats->bytes_read);
+}
+
+
+/**
+ * @brief Count bytes read from index files
+ */
+void
+stats_add_read   (run_stats   *stats,
+                  uint64_t     bytes)
+{
+    if (stats == NULL)
+        return;
+
+    stats->bytes_read += bytes;
+}
+
+
+/**
+ * @brief Record span of time in trace, without touching statistics
+ * @param stats The statistics, can be `NULL` in which case
+ * nothing is done
+ * @param name Name of span
+ * @param cat Category of span
+ * @param mark Start of span as set by `stats_mark()`
+ * @param detail Extra text shown with span, or `NULL`
+ * @note Safe to be called from worker threads
+ */
+void
+stats_span   (const run_stats    *stats,
+              const char         *name,
+              const char         *cat,
+              const stats_time   *mark,
+              const char         *detail)
+{
+    if (stats == NULL)
+        return;
+
+    trace_span (stats->trace, name, cat, mark->wall,
+        g_get_monotonic_time (), detail);
+}
+
+
+/**
+ * @brief Record value of counter in trace
+ * @note Safe to be called from worker threads
+ */
+void
+stats_counter   (const run_stats   *stats,
+                 const char        *name,
+                 gint64             value)
+{
+    if (stats == NULL)
+        return;
+
+    trace_counter (stats->trace, name, value);
+}
+
+
+/**
+ * @brief Count records of a parsed recycle bin
+ */
+void
+stats_add_bin   (run_stats          *stats,
+                 const metarecord   *meta)
+{
+    if (stats == NULL)
+        return;
+
+    stats->records += meta->records->len + meta->filtered;
+    stats->invalid_records += g_hash_table_size (meta->invalid_records);
+}
+
+
+const char *
+stats_phase_name   (stats_phase   phase)
+{
+    g_return_val_if_fail (phase < STATS_PHASE_MAX, NULL);
+    return phase_names[phase];
+}
+
+
+/**
+ * @brief Summarize statistics for display
+ * @param stats The statistics
+ * @param json Whether result is JSON or human readable text
+ * @return Newly allocated string with trailing newline
+ * @note Time is in milliseconds. Total is measured from
+ * `stats_init()` till now.
+ */
+char *
+stats_to_string   (const run_stats   *stats,
+                   bool               json)
+{
+    GString    *s;
+    stats_time  total;
+    double      rate = 0;
+
+    g_return_val_if_fail (stats != NULL, NULL);
+
+    stats_mark (stats, &total);
+    total.wall -= stats->start.wall;
+    total.cpu  -= stats->start.cpu;
+    if (total.wall > 0)
+        rate = (double) stats->records * G_USEC_PER_SEC / total.wall;
+
+    s = g_string_new (NULL);
+
+    if (json)
+    {
+        // JSON numbers always use '.' regardless of locale
+        char wall[G_ASCII_DTOSTR_BUF_SIZE], cpu[G_ASCII_DTOSTR_BUF_SIZE],
+             rate_s[G_ASCII_DTOSTR_BUF_SIZE];
+
+        s = g_string_append (s, "{\"phases\": {");
+        for (stats_phase p = 0; p < STATS_PHASE_MAX; p++)
+            g_string_append_printf (s,
+                "%s\"%s\": {\"wall_ms\": %s, \"cpu_ms\": %s}",
+                p ? ", " : "", phase_names[p],
+                g_ascii_formatd (wall, sizeof (wall), "%.3f",
+                    stats->phase[p].wall / 1000.0),
+                g_ascii_formatd (cpu, sizeof (cpu), "%.3f",
+                    stats->phase[p].cpu / 1000.0));
+        g_string_append_printf (s, "}, "
+            "\"total\": {\"wall_ms\": %s, \"cpu_ms\": %s}, "
+            "\"bytes_read\": %" PRIu64 ", "
+            "\"bytes_written\": %" PRIu64 ", "
+            "\"records\": %" PRIu64 ", "
+            "\"records_per_sec\": %s, "
+            "\"invalid_records\": %" PRIu64 ", "
+            "\"conv_fallbacks\": %" PRIu64 ", "
+            "\"escaped_chars\": %" PRIu64 "}\n",
+            g_ascii_formatd (wall, sizeof (wall), "%.3f", total.wall / 1000.0),
+            g_ascii_formatd (cpu, sizeof (cpu), "%.3f", total.cpu / 1000.0),
+            stats->bytes_read, stats->bytes_written, stats->records,
+            g_ascii_formatd (rate_s, sizeof (rate_s), "%.1f", rate),
+            stats->invalid_records,
+            stats->conv_fallbacks, stats->escaped_chars);
+        return g_string_free (s, FALSE);
+    }
+
+    g_string_append_printf (s, "%s\n%-12s%12s%12s\n", _("Statistics:"),
+        _("Phase"), _("Wall (ms)"), _("CPU (ms)"));
+    for (stats_phase p = 0; p < STATS_PHASE_MAX; p++)
+        g_string_append_printf (s, "%-12s%12.3f%12.3f\n", phase_names[p],
+            stats->phase[p].wall / 1000.0, stats->phase[p].cpu / 1000.0);
+    g_string_append_printf (s, "%-12s%12.3f%12.3f\n", _("total"),
+        total.wall / 1000.0, total.cpu / 1000.0);
+
+    g_string_append_printf (s, _("Bytes read: %" PRIu64 "\n"),
+        stats->bytes_read);
+    g_string_append_printf (s, _("Bytes written: %" PRIu64 "\n"),
+        stats->bytes_written);
+    g_string_append_printf (s, _("Records: %" PRIu64 " (%.1f per second)\n"),
+        stats->records, rate);
+    g_string_append_printf (s, _("Invalid records: %" PRIu64 "\n"),
+        stats->invalid_records);
+    g_string_append_printf (s, _("Path conversion fallbacks: %" PRIu64 "\n"),
+        stats->conv_fallbacks);
+    g_string_append_printf (s, _("Escaped characters: %" PRIu64 "\n"),
+        stats->escaped_chars);
+
+    return g_string_free (s, FALSE);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+
+#include "utils.h"
+#include "utils-trace.h"
+
+/* Phases of processing that are timed separately */
+typedef enum
+{
+    STATS_PHASE_ENUMERATE = 0,  /* listing index files in folder */
+    STATS_PHASE_READ,           /* reading index files */
+    STATS_PHASE_PARSE,          /* populating records from buffer */
+    STATS_PHASE_CONVERT,        /* converting paths to UTF-8 */
+    STATS_PHASE_FORMAT,         /* formatting output */
+    STATS_PHASE_WRITE,          /* writing output */
+    STATS_PHASE_MAX
+} stats_phase;
+
+/* Time elapsed in microseconds */
+typedef struct _stats_time
+{
+    gint64    wall;
+    gint64    cpu;
+} stats_time;
+
+struct _run_stats
+{
+    stats_time   start;
+    stats_time   phase[STATS_PHASE_MAX];
+    uint64_t     bytes_read;
+    uint64_t     bytes_written;
+    uint64_t     records;          /* kept or filtered */
+    uint64_t     invalid_records;
+    uint64_t     conv_fallbacks;   /* illegal sequences in paths */
+    uint64_t     escaped_chars;    /* unprintable chars in paths */
+    trace_sink  *trace;            /* phases also go here if not NULL */
+    gint64       traced[STATS_PHASE_MAX];  /* phase time already in trace */
+};
+
+void          stats_init            (run_stats         *stats);
+
+void          stats_mark            (const run_stats   *stats,
+                                     stats_time        *mark);
+
+void          stats_add_since       (run_stats         *stats,
+                                     stats_phase        phase,
+                                     const stats_time  *mark);
+
+void          stats_add_bin         (run_stats         *stats,
+                                     const metarecord  *meta);
+
+void          stats_add_read        (run_stats         *stats,
+                                     uint64_t           bytes);
+
+void          stats_trace_phases    (run_stats         *stats,
+                                     const char        *detail);
+
+void          stats_span            (const run_stats   *stats,
+                                     const char        *name,
+                                     const char        *cat,
+                                     const stats_time  *mark,
+                                     const char        *detail);
+
+void          stats_counter         (const run_stats   *stats,
+                                     const char        *name,
+                                     gint64             value);
+
+const char *  stats_phase_name      (stats_phase        phase);
+
+char *        stats_to_string       (const run_stats   *stats,
+                                     bool               json);
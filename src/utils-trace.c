@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "utils-conv.h"
+#include "utils-error.h"
+#include "utils-trace.h"
+
+/*
+ * Events are written as soon as they happen, in the JSON object
+ * format of Chrome trace events, which is understood by Perfetto
+ * and chrome://tracing. All timestamps are in microseconds, relative
+ * to opening of trace. Threads get small sequential IDs in order
+ * of their first event, with the first one named "main".
+ */
+
+struct _trace_sink
+{
+    GMutex       lock;
+    FILE        *fh;
+    char        *path;
+    gint64       epoch;
+    GHashTable  *tids;   // GThread * -> thread ID
+    bool         empty;  // no event written yet
+};
+
+
+trace_sink *
+trace_open   (const char   *path,
+              GError      **error)
+{
+    trace_sink  *sink;
+    FILE        *fh;
+
+    g_return_val_if_fail (path != NULL, NULL);
+
+    if (NULL == (fh = g_fopen (path, "wb")))
+    {
+        int e = errno;
+        g_set_error (error, R2_FATAL_ERROR, R2_FATAL_ERROR_TRACE_FILE,
+            _("Can not open trace file '%s': %s"), path, g_strerror (e));
+        return NULL;
+    }
+
+    sink = g_malloc0 (sizeof (trace_sink));
+    g_mutex_init (&sink->lock);
+    sink->fh = fh;
+    sink->path = g_strdup (path);
+    sink->epoch = g_get_monotonic_time ();
+    sink->tids = g_hash_table_new (g_direct_hash, g_direct_equal);
+    sink->empty = true;
+
+    fputs ("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", fh);
+    return sink;
+}
+
+
+/* Must be called with lock held */
+static void
+_begin_event   (trace_sink   *sink)
+{
+    fputs (sink->empty ? "\n" : ",\n", sink->fh);
+    sink->empty = false;
+}
+
+
+/* Must be called with lock held */
+static guint
+_thread_id   (trace_sink   *sink)
+{
+    GThread  *self = g_thread_self ();
+    guint     tid;
+
+    tid = GPOINTER_TO_UINT (g_hash_table_lookup (sink->tids, self));
+    if (tid)
+        return tid;
+
+    tid = g_hash_table_size (sink->tids) + 1;
+    g_hash_table_insert (sink->tids, self, GUINT_TO_POINTER (tid));
+
+    _begin_event (sink);
+    if (tid == 1)
+        fprintf (sink->fh, "{\"name\": \"thread_name\", \"ph\": \"M\", "
+            "\"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"main\"}}");
+    else
+        fprintf (sink->fh, "{\"name\": \"thread_name\", \"ph\": \"M\", "
+            "\"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"worker-%u\"}}",
+            tid, tid - 1);
+    return tid;
+}
+
+
+/**
+ * @brief Record a completed span of time
+ * @param sink The trace, can be `NULL` in which case nothing is done
+ * @param name Name of span
+ * @param cat Category of span
+ * @param start Start time from `g_get_monotonic_time()`
+ * @param end End time from `g_get_monotonic_time()`
+ * @param detail Extra text shown with span, or `NULL`
+ */
+void
+trace_span   (trace_sink   *sink,
+              const char   *name,
+              const char   *cat,
+              gint64        start,
+              gint64        end,
+              const char   *detail)
+{
+    guint tid;
+
+    if (sink == NULL)
+        return;
+
+    // Spans may begin before trace is opened, such as initialization
+    start = MAX (start, sink->epoch);
+
+    g_mutex_lock (&sink->lock);
+
+    tid = _thread_id (sink);
+    _begin_event (sink);
+    fprintf (sink->fh, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+        "\"pid\": 1, \"tid\": %u, \"ts\": %" PRId64 ", \"dur\": %" PRId64,
+        name, cat, tid, start - sink->epoch, end - start);
+
+    if (detail)
+    {
+        char *s = g_filename_display_name (detail);
+        char *escaped = json_escape (s);
+        fprintf (sink->fh, ", \"args\": {\"detail\": \"%s\"}", escaped);
+        g_free (escaped);
+        g_free (s);
+    }
+    fputs ("}", sink->fh);
+
+    g_mutex_unlock (&sink->lock);
+}
+
+
+/**
+ * @brief Record current value of a counter
+ * @param sink The trace, can be `NULL` in which case nothing is done
+ */
+void
+trace_counter   (trace_sink   *sink,
+                 const char   *name,
+                 gint64        value)
+{
+    gint64 now;
+
+    if (sink == NULL)
+        return;
+
+    now = g_get_monotonic_time ();
+    g_mutex_lock (&sink->lock);
+
+    _begin_event (sink);
+    fprintf (sink->fh, "{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, "
+        "\"ts\": %" PRId64 ", \"args\": {\"value\": %" PRId64 "}}",
+        name, now - sink->epoch, value);
+
+    g_mutex_unlock (&sink->lock);
+}
+
+
+/**
+ * @brief Finish and close trace
+ * @return `false` if trace could not be fully written
+ */
+bool
+trace_close   (trace_sink   *sink,
+               GError      **error)
+{
+    bool ok;
+
+    if (sink == NULL)
+        return true;
+
+    fputs ("\n]}\n", sink->fh);
+    ok = ! ferror (sink->fh);
+    ok = (fclose (sink->fh) == 0) && ok;
+
+    if (! ok)
+        g_set_error (error, R2_FATAL_ERROR, R2_FATAL_ERROR_TRACE_FILE,
+            _("Can not write trace file '%s'"), sink->path);
+
+    g_hash_table_destroy (sink->tids);
+    g_mutex_clear (&sink->lock);
+    g_free (sink->path);
+    g_free (sink);
+    return ok;
+}
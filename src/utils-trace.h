@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <glib.h>
+
+/* Writer of Chrome trace event JSON, usable from multiple threads */
+typedef struct _trace_sink trace_sink;
+
+trace_sink *  trace_open            (const char   *path,
+                                     GError      **error);
+
+bool          trace_close           (trace_sink   *sink,
+                                     GError      **error);
+
+void          trace_span            (trace_sink   *sink,
+                                     const char   *name,
+                                     const char   *cat,
+                                     gint64        start,
+                                     gint64        end,
+                                     const char   *detail);
+
+void          trace_counter         (trace_sink   *sink,
+                                     const char   *name,
+                                     gint64        value);
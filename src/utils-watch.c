@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "utils.h"
+#include "utils-watch.h"
+
+#define WATCH_EVENT_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | \
+    IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static volatile sig_atomic_t  stop_watching = 0;
+
+
+static void
+_on_stop_signal   (int   sig)
+{
+    UNUSED (sig);
+    stop_watching = 1;
+}
+
+
+/**
+ * @brief Read all pending inotify events, and merge them into changes
+ * @return `false` if watched folder itself is gone
+ */
+static bool
+_collect_events   (int           fd,
+                   GHashTable   *changes)
+{
+    // Aligned as required by inotify(7)
+    char buf[8192]
+        __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    ssize_t  len;
+    bool     alive = true;
+
+    while ((len = read (fd, buf, sizeof (buf))) > 0)
+    {
+        const struct inotify_event *ev;
+
+        for (char *p = buf; p < buf + len;
+            p += sizeof (struct inotify_event) + ev->len)
+        {
+            ev = (const struct inotify_event *) p;
+
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            {
+                alive = false;
+                continue;
+            }
+            if (! ev->len)
+                continue;
+
+            // Latest event decides final state of file
+            g_hash_table_replace (changes, g_strdup (ev->name),
+                GINT_TO_POINTER (
+                    (ev->mask & (IN_DELETE | IN_MOVED_FROM)) ?
+                    WATCH_FILE_REMOVED : WATCH_FILE_CHANGED));
+        }
+    }
+    return alive;
+}
+
+
+/**
+ * @brief Watch folder for changes until terminated
+ * @param dir The folder to watch
+ * @param func Handler of each batch of changes
+ * @param data User data passed to handler
+ * @param error Location to store error upon failure
+ * @return `true` if watch is stopped by `SIGINT`, `SIGTERM` or
+ * removal of folder, `false` if watch can't be set up
+ * @note Events happening in quick succession are coalesced, so
+ * that handler sees the final state of each file only once.
+ */
+bool
+watch_folder   (const char       *dir,
+                WatchBatchFunc    func,
+                gpointer          data,
+                GError          **error)
+{
+    struct sigaction  sa;
+    struct pollfd     pfd;
+    GHashTable       *changes;
+    int               fd, e;
+    bool              alive = true;
+
+    if ((fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+        inotify_add_watch (fd, dir, WATCH_EVENT_MASK | IN_ONLYDIR) < 0)
+    {
+        e = errno;
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (e),
+            _("Can not watch folder '%s': %s"), dir, g_strerror (e));
+        if (fd >= 0)
+            close (fd);
+        return false;
+    }
+
+    // No SA_RESTART, so that poll() is interrupted
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = _on_stop_signal;
+    sigemptyset (&sa.sa_mask);
+    sigaction (SIGINT,  &sa, NULL);
+    sigaction (SIGTERM, &sa, NULL);
+
+    // Anything changed from now on is caught by watch
+    func (NULL, data);
+
+    changes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (alive && ! stop_watching)
+    {
+        gint64 first;
+
+        if (poll (&pfd, 1, -1) <= 0)
+            continue;
+
+        first = g_get_monotonic_time ();
+        alive = _collect_events (fd, changes);
+
+        // Wait for burst to settle down
+        while (alive && ! stop_watching && (g_get_monotonic_time () - first)
+            < WATCH_MAX_DELAY_MSEC * G_TIME_SPAN_MILLISECOND)
+        {
+            if (poll (&pfd, 1, WATCH_SETTLE_MSEC) <= 0)
+                break;
+            alive = _collect_events (fd, changes);
+        }
+
+        if (g_hash_table_size (changes))
+        {
+            func (changes, data);
+            g_hash_table_remove_all (changes);
+        }
+    }
+
+    g_hash_table_destroy (changes);
+    close (fd);
+
+    return true;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2024, Abel Cheung.
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <glib.h>
+
+/* Final state of a file after a burst of filesystem events */
+typedef enum
+{
+    WATCH_FILE_CHANGED = 1,  /* created, or written and closed */
+    WATCH_FILE_REMOVED,
+
+} watch_change;
+
+/* Events are collected until folder is quiet for this long */
+#define WATCH_SETTLE_MSEC    50
+/* ... but a busy folder is reported at least this often */
+#define WATCH_MAX_DELAY_MSEC 250
+
+/**
+ * @brief Handle a batch of coalesced changes in watched folder
+ * @param changes Hash table mapping file name (not full path) to
+ * `watch_change` stored with `GINT_TO_POINTER()`, or `NULL` for the
+ * initial call right after watch is established
+ * @param data User data
+ */
+typedef void (*WatchBatchFunc)   (GHashTable   *changes,
+                                  gpointer      data);
+
+bool              watch_folder               (const char       *dir,
+                                              WatchBatchFunc    func,
+                                              gpointer          data,
+                                              GError          **error);
@@ -7,19 +7,34 @@
 #include "config.h"
 
 #include <locale.h>
+#include <math.h>
 #include <glib/gi18n.h>
 
 #include "utils-conv.h"
 #include "utils-error.h"
 #include "utils-io.h"
-#include "utils.h"
+#include "utils-memstats.h"
+#include "utils-metrics.h"
+#include "utils-arrow.h"
+#include "utils-msgpack.h"
+#include "utils-filter.h"
+#include "utils-hash.h"
+#include "utils-pathmatch.h"
+#include "utils-probes.h"
+#include "utils-state.h"
+#include "utils-stats.h"
+#include "utils-cli.h"
+#ifdef G_OS_UNIX
+#include "utils-serve.h"
+#ifdef ENABLE_SQLITE
+#include "utils-sqlite.h"
+#endif
+#endif
+#ifdef __linux__
+#include "utils-watch.h"
+#endif
 #include "utils-platform.h"
 
-/* Our own error domain */
-
-G_DEFINE_QUARK (rifiuti-fatal-error-quark, rifiuti_fatal_error)
-G_DEFINE_QUARK (rifiuti-record-error-quark, rifiuti_record_error)
-
 /* Common function signature for option callbacks */
 #define DECL_OPT_CALLBACK(func)          \
 static gboolean func (       \
@@ -34,16 +49,27 @@ DECL_OPT_CALLBACK(_option_deprecated);
 DECL_OPT_CALLBACK(_set_opt_delim);
 DECL_OPT_CALLBACK(_set_opt_noheading);
 DECL_OPT_CALLBACK(_set_opt_format);
+DECL_OPT_CALLBACK(_set_opt_sort);
+DECL_OPT_CALLBACK(_set_opt_fields);
+DECL_OPT_CALLBACK(_set_opt_hash);
+DECL_OPT_CALLBACK(_set_opt_stats);
+DECL_OPT_CALLBACK(_set_opt_trace);
+DECL_OPT_CALLBACK(_set_opt_metrics);
 DECL_OPT_CALLBACK(_show_ver_and_exit);
 
 /* pre-declared out of laziness */
 
-static int
-_check_file_args (const char  *path,
-                  GPtrArray   *list,
-                  rbin_type    type,
-                  bool        *isolated_index,
-                  GError     **error);
+exitcode _get_exit_code    (const GError  *error);
+static bool _parse_args    (rbin_type      type,
+                            char        ***argv,
+                            GError       **error);
+#ifdef G_OS_UNIX
+static void _serve         (GError       **error);
+#endif
+#ifdef __linux__
+static void _watch         (GError       **error);
+#endif
+bool     _has_record_error (void);
 
 
 /**
@@ -89,12 +115,58 @@ static out_fmt      output_format      = FORMAT_UNKNOWN;
 static bool         no_heading         = false;
 static gboolean     use_localtime      = FALSE;
 static gboolean     live_mode          = FALSE;
+static gboolean     intern_paths       = FALSE;
+static sort_field   sort_by            = SORT_NATURAL;
+static bool         sort_desc          = false;
+static int          record_limit       = 0;
+static out_field    out_fields[OUT_FIELD_MAX];
+static int          n_out_fields       = 0;
 static char        *delim              = NULL;
 static char        *output_loc         = NULL;
+static char        *where_expr         = NULL;
+static char       **path_globs         = NULL;
+static char       **path_substrs       = NULL;
 static char       **fileargs           = NULL;
-       GPtrArray   *allidxfiles        = NULL;
-       bool         isolated_index     = false;
-       char        *legacy_encoding    = NULL; /*!< INFO2 only, or upon request */
+static char        *files0_from        = NULL;
+static char        *output_dir         = NULL;
+static char        *state_loc          = NULL;
+static scan_state  *rescan_state       = NULL;
+static GPtrArray   *state_removals     = NULL;
+static bool         hash_payload       = false;
+static GChecksumType hash_type         = G_CHECKSUM_SHA256;
+static int          hash_jobs          = HASH_DEFAULT_JOBS;
+static bool         hash_index         = false;
+static GChecksumType index_hash_type   = G_CHECKSUM_SHA256;
+static bool         show_stats         = false;
+static bool         stats_json         = false;
+static run_stats    stats_data;
+static bool         stats_started      = false;
+static char        *trace_loc          = NULL;
+static char        *metrics_loc        = NULL;
+static run_metrics *metrics            = NULL;
+static int          bench_runs         = 0;
+static gboolean     show_mem_stats     = FALSE;
+static uint64_t     mem_records        = 0;
+static char        *watch_dir          = NULL;
+static GHashTable  *watch_known        = NULL;
+static GPtrArray   *batch_paths        = NULL;
+static char        *batch_tag          = NULL;
+static char        *ndjson_rbin        = NULL;
+static arrow_stream *arrow_out         = NULL;
+#ifdef ENABLE_SQLITE
+static sqlite_out  *sqlite_db          = NULL;
+static GError      *sqlite_err         = NULL;
+#endif
+static exitcode     batch_code         = EXIT_OK;
+static guint        batch_dumped       = 0;
+static char        *serve_socket       = NULL;
+static char        *usage_param_s      = NULL;
+static char        *usage_summary_s    = NULL;
+static ProcessBinFunc bin_func         = NULL;
+static parse_opts   cli_opts           = { 0 };
+static char        *legacy_encoding    = NULL; /*!< INFO2 only, or upon request */
+static record_filter *where_filter     = NULL;
+static path_matcher *path_filter       = NULL;
        metarecord  *meta               = NULL;
 
 
@@ -118,7 +190,17 @@ static const GOptionEntry out_options[] = {
     {
         "format", 'f', 0,
         G_OPTION_ARG_CALLBACK, _set_opt_format,
-        N_("'text' (default), 'xml' or 'json'"), N_("FORMAT")
+        N_("'text' (default), 'xml', 'json', 'ndjson', 'msgpack', "
+           "'arrow', 'sqlite' or 'bodyfile'"),
+        N_("FORMAT")
+    },
+    {
+        "fields", 0, 0,
+        G_OPTION_ARG_CALLBACK, _set_opt_fields,
+        N_("Comma separated list of fields to output, out of 'index', "
+           "'time', 'gone', 'size', 'path', 'hash' and 'index_hash' "
+           "[all fields if not given]"),
+        N_("LIST")
     },
     { 0 }
 };
@@ -136,6 +218,117 @@ static const GOptionEntry main_options[] = {
         N_("Present deletion time in time zone of local system (default is UTC)"),
         NULL
     },
+    {
+        "intern-paths", 0, 0,
+        G_OPTION_ARG_NONE, &intern_paths,
+        N_("Share common directory prefixes of paths in memory, "
+           "which saves memory for huge recycle bins"),
+        NULL
+    },
+    {
+        "stats", 0, G_OPTION_FLAG_NO_ARG,
+        G_OPTION_ARG_CALLBACK, _set_opt_stats,
+        N_("Print time spent in each phase of processing and other "
+           "statistics to stderr"),
+        NULL
+    },
+    {
+        "stats-json", 0, G_OPTION_FLAG_NO_ARG,
+        G_OPTION_ARG_CALLBACK, _set_opt_stats,
+        N_("Same as '--stats', but print as single line of JSON"),
+        NULL
+    },
+    {
+        "trace", 0, 0,
+        G_OPTION_ARG_CALLBACK, _set_opt_trace,
+        N_("Write timeline of processing phases to FILE, in Chrome "
+           "trace event format viewable with Perfetto"),
+        N_("FILE")
+    },
+    {
+        "metrics-file", 0, 0,
+        G_OPTION_ARG_CALLBACK, _set_opt_metrics,
+        N_("Write counters and timings to FILE in Prometheus text "
+           "format, for use with node_exporter textfile collector"),
+        N_("FILE")
+    },
+    {
+        "benchmark", 0, 0,
+        G_OPTION_ARG_INT, &bench_runs,
+        N_("Load recycle bin into memory, then parse and format it "
+           "N times with output discarded, and report time spent in "
+           "each phase"),
+        N_("N")
+    },
+#ifdef ENABLE_MEM_STATS
+    {
+        "mem-stats", 0, 0,
+        G_OPTION_ARG_NONE, &show_mem_stats,
+        N_("Print memory allocations of each phase of processing "
+           "and peak memory usage to stderr"),
+        NULL
+    },
+#endif
+    {
+        "hash-index", 0, 0,
+        G_OPTION_ARG_CALLBACK, _set_opt_hash,
+        N_("Compute digest of index files with ALGO, either 'sha256' "
+           "or 'md5', while they are read for parsing"),
+        N_("ALGO")
+    },
+    {
+        "where", 0, 0,
+        G_OPTION_ARG_STRING, &where_expr,
+        N_("Only show records matching EXPR, such as "
+           "'time >= 2024-01-01 && size > 1e8 && gone'. "
+           "Fields are 'time', 'size', 'gone' and 'index' (INFO2 only)"),
+        N_("EXPR")
+    },
+    {
+        "sort", 0, 0,
+        G_OPTION_ARG_CALLBACK, _set_opt_sort,
+        N_("Sort records by 'time', 'size' or 'index', optionally "
+           "followed by ':desc' for descending order"),
+        N_("FIELD[:desc]")
+    },
+    {
+        "limit", 0, 0,
+        G_OPTION_ARG_INT, &record_limit,
+        N_("Only show first N records in sorted order"),
+        N_("N")
+    },
+    {
+        "path-glob", 0, 0,
+        G_OPTION_ARG_STRING_ARRAY, &path_globs,
+        N_("Only show records whose full path matches PATTERN, "
+           "such as '*.pst' (case-insensitive for ASCII letters). "
+           "Can be specified multiple times"),
+        N_("PATTERN")
+    },
+    {
+        "path-substr", 0, 0,
+        G_OPTION_ARG_STRING_ARRAY, &path_substrs,
+        N_("Only show records whose path contains STRING "
+           "(case-insensitive for ASCII letters). "
+           "Can be specified multiple times"),
+        N_("STRING")
+    },
+    {
+        "files0-from", 0, 0,
+        G_OPTION_ARG_FILENAME, &files0_from,
+        N_("Read NUL separated list of recycle bins to process "
+           "from FILE, or standard input if FILE is '-'"),
+        N_("FILE")
+    },
+    {
+        "output-dir", 0, 0,
+        G_OPTION_ARG_FILENAME, &output_dir,
+        N_("Write output of each recycle bin to separate file "
+           "inside DIR, instead of a single combined output. "
+           "Required for multiple recycle bins in XML, JSON "
+           "or Arrow format"),
+        N_("DIR")
+    },
     {
         "version", 'v', G_OPTION_FLAG_NO_ARG,
         G_OPTION_ARG_CALLBACK, _show_ver_and_exit,
@@ -144,7 +337,7 @@ static const GOptionEntry main_options[] = {
     {
         G_OPTION_REMAINING, 0, 0,
         G_OPTION_ARG_FILENAME_ARRAY, &fileargs,
-        N_("INFO2 file name"), NULL
+        N_("Recycle bins to process"), NULL
     },
     { 0 }
 };
@@ -160,6 +353,31 @@ static const GOptionEntry rbinfile_options[] = {
     { 0 }
 };
 
+/* Options only intended for $Recycle.bin reader */
+static const GOptionEntry rdir_options[] = {
+    {
+        "state", 0, 0,
+        G_OPTION_ARG_FILENAME, &state_loc,
+        N_("Remember index files in FILE, so that only new or "
+           "changed ones are parsed in later runs"),
+        N_("FILE")
+    },
+    {
+        "hash-payload", 0, 0,
+        G_OPTION_ARG_CALLBACK, _set_opt_hash,
+        N_("Compute digest of trashed files and folders with "
+           "ALGO, either 'sha256' or 'md5'"),
+        N_("ALGO")
+    },
+    {
+        "hash-jobs", 0, 0,
+        G_OPTION_ARG_INT, &hash_jobs,
+        N_("Hash up to N trashed files concurrently [4 if not given]"),
+        N_("N")
+    },
+    { 0 }
+};
+
 /* Options only intended for live system probation */
 static const GOptionEntry live_options[] = {
     {
@@ -170,6 +388,33 @@ static const GOptionEntry live_options[] = {
     { 0 }
 };
 
+/* Options for server mode */
+static const GOptionEntry serve_options[] = {
+    {
+        "serve", 0, 0,
+        G_OPTION_ARG_FILENAME, &serve_socket,
+        N_("Listen on Unix SOCKET and process requests from clients, "
+           "until terminated. Must not be used with other options. "
+           "Output is always sent back to client, which may only use "
+           "format, filter and field options"),
+        N_("SOCKET")
+    },
+    { 0 }
+};
+
+/* Options for watch mode */
+static const GOptionEntry watch_options[] = {
+    {
+        "watch", 0, 0,
+        G_OPTION_ARG_FILENAME, &watch_dir,
+        N_("Print records in DIR, then keep watching it and print "
+           "changes as they happen, until terminated. Output is "
+           "always one JSON object per line"),
+        N_("DIR")
+    },
+    { 0 }
+};
+
 /* Following routines are command argument handling related */
 
 static gboolean
@@ -214,6 +459,24 @@ _set_opt_format   (const gchar *opt_name,
         return _set_out_format (FORMAT_XML, error);
     else if (g_strcmp0 (format, "json") == 0)
         return _set_out_format (FORMAT_JSON, error);
+    else if (g_strcmp0 (format, "ndjson") == 0)
+        return _set_out_format (FORMAT_NDJSON, error);
+    else if (g_strcmp0 (format, "msgpack") == 0)
+        return _set_out_format (FORMAT_MSGPACK, error);
+    else if (g_strcmp0 (format, "arrow") == 0)
+        return _set_out_format (FORMAT_ARROW, error);
+    else if (g_strcmp0 (format, "bodyfile") == 0)
+        return _set_out_format (FORMAT_BODYFILE, error);
+    else if (g_strcmp0 (format, "sqlite") == 0)
+    {
+#ifdef ENABLE_SQLITE
+        return _set_out_format (FORMAT_SQLITE, error);
+#else
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+            _("SQLite output is not supported in this build."));
+        return FALSE;
+#endif
+    }
     else {
         g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
             "Illegal output format '%s'", format);
@@ -222,6 +485,307 @@ _set_opt_format   (const gchar *opt_name,
 }
 
 
+/**
+ * @brief Option callback for setting sort order of records
+ * @return `FALSE` if sort field is unknown, `TRUE` otherwise
+ */
+static gboolean
+_set_opt_sort   (const gchar *opt_name,
+                 const gchar *value,
+                 gpointer     data,
+                 GError     **error)
+{
+    UNUSED(opt_name);
+    UNUSED(data);
+
+    const char  *colon = strchr (value, ':');
+    size_t       len = colon ? (size_t) (colon - value) : strlen (value);
+
+    sort_desc = false;
+    if (colon)
+    {
+        if (g_strcmp0 (colon + 1, "desc") == 0)
+            sort_desc = true;
+        else if (g_strcmp0 (colon + 1, "asc") != 0)
+            goto bad_sort;
+    }
+
+    if (len == 4 && strncmp (value, "time", len) == 0)
+        sort_by = SORT_TIME;
+    else if (len == 4 && strncmp (value, "size", len) == 0)
+        sort_by = SORT_SIZE;
+    else if (len == 5 && strncmp (value, "index", len) == 0)
+        sort_by = SORT_INDEX;
+    else
+        goto bad_sort;
+
+    return TRUE;
+
+    bad_sort:
+
+    g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+        _("Illegal sort order '%s'"), value);
+    return FALSE;
+}
+
+
+/* Names of output fields, in the same order as `out_field` */
+static const char *out_field_names[OUT_FIELD_MAX] = {
+    "index", "time", "gone", "size", "path", "hash", "index_hash"
+};
+
+
+/**
+ * @brief Option callback for selecting output fields and their order
+ * @return `FALSE` if field is unknown or duplicated, `TRUE` otherwise
+ */
+static gboolean
+_set_opt_fields   (const gchar *opt_name,
+                   const gchar *value,
+                   gpointer     data,
+                   GError     **error)
+{
+    UNUSED(opt_name);
+    UNUSED(data);
+
+    char **list;
+    bool   result = TRUE;
+
+    if (n_out_fields)
+    {
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("Multiple field options disallowed."));
+        return FALSE;
+    }
+
+    list = g_strsplit (value, ",", -1);
+    for (char **p = list; *p && result; p++)
+    {
+        out_field f;
+
+        g_strstrip (*p);
+        for (f = 0; f < OUT_FIELD_MAX; f++)
+            if (strcmp (*p, out_field_names[f]) == 0)
+                break;
+
+        if (f == OUT_FIELD_MAX)
+        {
+            g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                _("Unknown output field '%s'"), *p);
+            result = FALSE;
+        }
+        else if (field_is_wanted (f))
+        {
+            g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                _("Output field '%s' specified more than once"), *p);
+            result = FALSE;
+        }
+        else
+            out_fields[n_out_fields++] = f;
+    }
+    g_strfreev (list);
+
+    if (result && ! n_out_fields)
+    {
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+            _("No output field specified"));
+        result = FALSE;
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief Option callback for choosing digest algorithm of trashed
+ * files or index files
+ * @return `FALSE` if algorithm is unsupported, `TRUE` otherwise
+ */
+static gboolean
+_set_opt_hash   (const gchar *opt_name,
+                 const gchar *value,
+                 gpointer     data,
+                 GError     **error)
+{
+    GChecksumType type;
+
+    UNUSED(data);
+
+    if (! hash_type_from_name (value, &type))
+    {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+            _("Unsupported hash algorithm '%s'"), value);
+        return FALSE;
+    }
+
+    if (strcmp (opt_name, "--hash-index") == 0)
+    {
+        hash_index = true;
+        index_hash_type = type;
+    }
+    else
+    {
+        hash_payload = true;
+        hash_type = type;
+    }
+    return TRUE;
+}
+
+
+/**
+ * @brief Start collecting statistics, unless already done
+ * @note Shared by options which need timing hooks
+ */
+static void
+_start_stats   (void)
+{
+    if (stats_started)
+        return;
+
+    stats_started = true;
+    stats_init (&stats_data);
+    cli_opts.stats = &stats_data;
+    io_set_stats (&stats_data);
+}
+
+
+/**
+ * @brief Option callback for enabling statistics
+ * @return `FALSE` if statistics are requested twice, `TRUE` otherwise
+ * @note Statistics are started right away, so that recycle bin
+ * scanned while options are still being parsed is accounted too
+ */
+static gboolean
+_set_opt_stats   (const gchar *opt_name,
+                  const gchar *value,
+                  gpointer     data,
+                  GError     **error)
+{
+    UNUSED(value);
+    UNUSED(data);
+
+    if (show_stats)
+    {
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("Multiple statistics options disallowed."));
+        return FALSE;
+    }
+
+    stats_json = (strcmp (opt_name, "--stats-json") == 0);
+    show_stats = true;
+    _start_stats ();
+    return TRUE;
+}
+
+
+/**
+ * @brief Option callback for writing trace events
+ * @return `FALSE` if trace file can't be created, `TRUE` otherwise
+ * @note Trace file is opened right away, for the same reason
+ * as statistics
+ */
+static gboolean
+_set_opt_trace   (const gchar *opt_name,
+                  const gchar *value,
+                  gpointer     data,
+                  GError     **error)
+{
+    UNUSED(opt_name);
+    UNUSED(data);
+
+    if (trace_loc)
+    {
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("Multiple trace files disallowed."));
+        return FALSE;
+    }
+
+    _start_stats ();
+    if (NULL == (stats_data.trace = trace_open (value, error)))
+        return FALSE;
+
+    trace_loc = g_strdup (value);
+    return TRUE;
+}
+
+
+/**
+ * @brief Option callback for writing metrics file
+ * @return `FALSE` if metrics file is specified twice, `TRUE` otherwise
+ * @note File is only written when recycle bins are processed
+ */
+static gboolean
+_set_opt_metrics   (const gchar *opt_name,
+                    const gchar *value,
+                    gpointer     data,
+                    GError     **error)
+{
+    UNUSED(opt_name);
+    UNUSED(data);
+
+    if (metrics_loc)
+    {
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("Multiple metrics files disallowed."));
+        return FALSE;
+    }
+
+    _start_stats ();
+    metrics = metrics_new (g_get_prgname ());
+    metrics_loc = g_strdup (value);
+    return TRUE;
+}
+
+
+/**
+ * @brief Replace metrics file with current metrics
+ * @param finished Whether program is about to exit
+ * @param code Exit status of program, only used when finished
+ * @param error Location to store error upon failure
+ * @return `true` on success, `false` otherwise
+ */
+static bool
+_write_metrics   (bool       finished,
+                  exitcode   code,
+                  GError   **error)
+{
+    GError  *err = NULL;
+    char    *s;
+    bool     result;
+
+    if (metrics_loc == NULL)
+        return true;
+
+    s = metrics_to_string (metrics, &stats_data, finished, code);
+    // Written to temp file then renamed, so partial file is never seen
+    if (! (result = g_file_set_contents (metrics_loc, s, -1, &err)))
+    {
+        g_set_error (error, R2_FATAL_ERROR, R2_FATAL_ERROR_METRICS_FILE,
+            _("Can not write metrics file '%s': %s"),
+            metrics_loc, err->message);
+        g_error_free (err);
+    }
+    g_free (s);
+    return result;
+}
+
+
+/**
+ * @brief Check if field is selected for output
+ * @param field The field to check
+ * @return `true` if field would be printed
+ * @note Parsers can skip decoding of unwanted fields entirely
+ */
+bool
+field_is_wanted   (out_field   field)
+{
+    for (int i = 0; i < n_out_fields; i++)
+        if (out_fields[i] == field)
+            return true;
+    return false;
+}
+
+
 /**
  * @brief Option callback for setting TSV header visibility
  * @return `FALSE` if option conflict exists, `TRUE` otherwise
@@ -429,36 +993,198 @@ _show_ver_and_exit (const gchar *opt_name,
 
 
 /**
- * @brief File argument check callback, after handling all arguments
- * @return `TRUE` if a unique file argument is used under common scenario,
- * or no file argument is provided in live mode. `FALSE` otherwise.
+ * @brief Read NUL separated list of recycle bin paths
+ * @param path File containing the list, or `-` for standard input
+ * @param error Location to store error upon failure
+ * @return `true` on success, `false` otherwise
+ * @note Paths are appended to `batch_paths`. Empty entries are
+ * ignored, so trailing NUL is optional.
  */
-static gboolean
-_fileargs_handler (GOptionContext *context,
-                   GOptionGroup   *group,
-                   metarecord     *meta,
-                   GError        **error)
+static bool
+_read_files0_list   (const char   *path,
+                     GError      **error)
 {
-    UNUSED (context);
-    UNUSED (group);
-
-    gsize fileargs_len = fileargs ? g_strv_length (fileargs) : 0;
+    char   *content = NULL;
+    gsize   len = 0;
 
-    if (!live_mode)
+    if (strcmp (path, "-") == 0)
     {
-        if (fileargs_len != 1)
+        GString  *s = g_string_new (NULL);
+        char      buf[4096];
+        size_t    n;
+
+        while ((n = fread (buf, 1, sizeof (buf), stdin)) > 0)
+            g_string_append_len (s, buf, n);
+
+        if (ferror (stdin))
         {
-            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
-                _("Must specify exactly one file or folder argument."));
-            return FALSE;
+            g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_IO,
+                _("Failed to read file list from standard input"));
+            g_string_free (s, TRUE);
+            return false;
         }
-        meta->filename = g_strdup (fileargs[0]);
-
-        return _check_file_args (meta->filename, allidxfiles,
-            meta->type, &isolated_index, error);
+        len = s->len;
+        content = g_string_free (s, FALSE);
     }
+    else if (! g_file_get_contents (path, &content, &len, error))
+        return false;
 
-    if (fileargs_len)
+    if (batch_paths == NULL)
+        batch_paths = g_ptr_array_new_with_free_func (g_free);
+
+    for (gsize start = 0, i = 0; i <= len; i++)
+    {
+        if (i < len && content[i] != '\0')
+            continue;
+        if (i > start)
+            g_ptr_array_add (batch_paths,
+                g_strndup (content + start, i - start));
+        start = i + 1;
+    }
+
+    g_free (content);
+    return true;
+}
+
+
+/**
+ * @brief File argument check callback, after handling all arguments
+ * @return `TRUE` if a unique file argument is used under common scenario,
+ * or no file argument is provided in live mode. `FALSE` otherwise.
+ */
+static gboolean
+_fileargs_handler (GOptionContext *context,
+                   GOptionGroup   *group,
+                   metarecord     *meta,
+                   GError        **error)
+{
+    UNUSED (context);
+    UNUSED (group);
+
+    gsize fileargs_len = fileargs ? g_strv_length (fileargs) : 0;
+
+    if (bench_runs < 0)
+    {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+            _("Number of benchmark runs must be positive, got %d"),
+            bench_runs);
+        return FALSE;
+    }
+
+    if (bench_runs)
+    {
+        if (serve_socket || watch_dir || live_mode || files0_from ||
+            fileargs_len != 1 || output_dir || output_loc || state_loc)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Benchmark mode requires a single file or folder "
+                  "argument, and can't be used with other modes or "
+                  "output file options."));
+            return FALSE;
+        }
+        if (show_stats || show_mem_stats || trace_loc || metrics_loc)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Statistics are unavailable in benchmark mode."));
+            return FALSE;
+        }
+        _start_stats ();
+    }
+
+    if (serve_socket)
+    {
+        if (fileargs_len || files0_from || live_mode)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Server mode must not be used together "
+                    "with file arguments."));
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    if (watch_dir)
+    {
+        if (fileargs_len || files0_from || live_mode ||
+            output_dir || output_loc || state_loc)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Watch mode must not be used together with file "
+                  "arguments, live mode or output file options."));
+            return FALSE;
+        }
+        if (show_stats || show_mem_stats || trace_loc)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Statistics are unavailable in watch mode."));
+            return FALSE;
+        }
+        // Records are printed as they come
+        if (sort_by != SORT_NATURAL || record_limit)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Sorting and record limit can't be used in watch mode."));
+            return FALSE;
+        }
+        if (! g_file_test (watch_dir, G_FILE_TEST_IS_DIR))
+        {
+            g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                _("'%s' is not a folder."), watch_dir);
+            return FALSE;
+        }
+
+        meta->filename = g_strdup (watch_dir);
+
+        return find_index_files (meta, meta->filename, error);
+    }
+
+    if (!live_mode)
+    {
+        if (files0_from)
+        {
+            if (! _read_files0_list (files0_from, error))
+                return FALSE;
+            fileargs_len += batch_paths->len;
+        }
+
+        if (fileargs_len == 0)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Must specify at least one file or folder argument."));
+            return FALSE;
+        }
+
+        if (output_dir && output_loc)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Output file and output folder can't be used together."));
+            return FALSE;
+        }
+
+        if (output_dir && ! g_file_test (output_dir, G_FILE_TEST_IS_DIR))
+        {
+            g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                _("Output folder '%s' does not exist."), output_dir);
+            return FALSE;
+        }
+
+        // Batch mode: recycle bins are only checked when processed,
+        // so that a bad one doesn't prevent processing of others
+        if (fileargs_len > 1 || files0_from || output_dir)
+        {
+            if (batch_paths == NULL)
+                batch_paths = g_ptr_array_new_with_free_func (g_free);
+            for (gsize i = 0; fileargs && fileargs[i]; i++)
+                g_ptr_array_insert (batch_paths, i, g_strdup (fileargs[i]));
+            return TRUE;
+        }
+
+        meta->filename = g_strdup (fileargs[0]);
+
+        return find_index_files (meta, meta->filename, error);
+    }
+
+    if (fileargs_len || files0_from)
     {
         g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
             _("Live system probation must not be used together "
@@ -488,8 +1214,8 @@ _fileargs_handler (GOptionContext *context,
         {
             // Ignore errors, pretty common that some folders don't
             // exist or are empty.
-            _check_file_args ((const char *)(bindirs->pdata[i]),
-                allidxfiles, meta->type, NULL, NULL);
+            find_index_files (meta,
+                (const char *) bindirs->pdata[i], NULL);
         }
         g_ptr_array_free (bindirs, TRUE);
     }
@@ -499,9 +1225,32 @@ _fileargs_handler (GOptionContext *context,
 }
 
 
+/**
+ * @brief Check if no option other than `--serve` is used
+ * @return `true` if all other options are still at default
+ * @note Must be checked before fallback values are filled
+ */
+static bool
+_opts_at_default   (void)
+{
+    return
+        delim == NULL && ! no_heading &&
+        output_format == FORMAT_UNKNOWN && n_out_fields == 0 &&
+        ! output_loc && ! output_dir && ! state_loc &&
+        ! use_localtime && ! intern_paths && ! live_mode &&
+        ! show_stats && ! trace_loc && ! metrics_loc &&
+        bench_runs == 0 && ! show_mem_stats &&
+        ! hash_index && ! hash_payload && hash_jobs == HASH_DEFAULT_JOBS &&
+        ! where_expr && sort_by == SORT_NATURAL && ! sort_desc &&
+        record_limit == 0 && ! path_globs && ! path_substrs &&
+        ! files0_from && ! fileargs && ! legacy_encoding && ! watch_dir;
+}
+
+
 /**
  * @brief post-callback after handling all output related args
- * @return Always `TRUE`, denoting success. It never fails.
+ * @return `FALSE` if output format is unsupported in watch mode,
+ * `TRUE` otherwise
  */
 static gboolean
 _set_def_output_opts    (GOptionContext *context,
@@ -512,36 +1261,62 @@ _set_def_output_opts    (GOptionContext *context,
     UNUSED (context);
     UNUSED (group);
     UNUSED (data);
-    UNUSED (error);
+
+    // Options of server can't be changed afterwards, so leave
+    // them all to individual requests
+    if (serve_socket && ! _opts_at_default ())
+    {
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("Server mode must not be used with other options. "
+              "Send them along with each request instead."));
+        return FALSE;
+    }
 
     /* Fallback values after successful option parsing */
     if (delim == NULL)
         delim = g_strdup ("\t");
 
+    if (watch_dir)
+    {
+        if (output_format != FORMAT_UNKNOWN && output_format != FORMAT_JSON)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Only JSON output is supported in watch mode."));
+            return FALSE;
+        }
+        output_format = FORMAT_JSON;
+    }
+
     if (output_format == FORMAT_UNKNOWN)
         output_format = FORMAT_TEXT;
 
-    return TRUE;
-}
-
-
-/**
- * @brief Converts Windows FILETIME number to glib counterpart
- * @param win_filetime The FILETIME integer to be converted
- * @return `GDateTime` with UTC timezone
- */
-GDateTime *
-win_filetime_to_gdatetime (int64_t win_filetime)
-{
-    int64_t t;
+    // All recycle bins are loaded into the same database
+    if (output_format == FORMAT_SQLITE && ! output_loc)
+    {
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("SQLite output requires '-o' option."));
+        return FALSE;
+    }
 
-    /* Let's assume we don't need subsecond time resolution */
-    t = (win_filetime - 116444736000000000LL) / 10000000;
+    // Each recycle bin is a complete document or stream, and
+    // concatenating them doesn't make a valid one
+    if ((output_format == FORMAT_XML || output_format == FORMAT_JSON ||
+        output_format == FORMAT_ARROW) && ! output_dir &&
+        (files0_from || (fileargs && g_strv_length (fileargs) > 1)))
+    {
+        extern struct _fmt_data fmt[];
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("Output of multiple recycle bins in %s requires '--output-dir'."),
+            fmt[output_format].friendly_name);
+        return FALSE;
+    }
 
-    g_debug ("FileTime -> Epoch: %" PRId64
-        " -> %" PRId64, win_filetime, t);
+    // Files are always written in binary mode
+    if ((output_format == FORMAT_MSGPACK || output_format == FORMAT_ARROW)
+        && ! output_loc && ! output_dir)
+        return io_set_binary (error);
 
-    return g_date_time_new_from_unix_utc (t);
+    return TRUE;
 }
 
 
@@ -579,6 +1354,12 @@ _opt_ctxt_setup (GOptionContext **context,
             g_option_group_add_entries (main_group, rbinfile_options);
             break;
         case RECYCLE_BIN_TYPE_DIR:
+            g_option_group_add_entries (main_group, rdir_options);
+#ifdef __linux__
+            g_option_group_add_entries (main_group, watch_options);
+#else
+            UNUSED (watch_options);
+#endif
 #if (defined G_OS_WIN32 || defined __linux__)
             g_option_group_add_entries (main_group, live_options);
 #else
@@ -588,6 +1369,12 @@ _opt_ctxt_setup (GOptionContext **context,
         default: break;
     }
 
+#ifdef G_OS_UNIX
+    g_option_group_add_entries (main_group, serve_options);
+#else
+    UNUSED (serve_options);
+#endif
+
     g_option_group_set_parse_hooks (main_group, NULL,
         (GOptionParseFunc) _fileargs_handler);
     g_option_context_set_main_group (*context, main_group);
@@ -648,25 +1435,16 @@ _opt_ctxt_parse (GOptionContext **context,
     g_option_context_free (*context);
     g_strfreev (argv_u8);
 
-    return (*error == NULL);
-}
-
+    // String arguments not convertible from locale charset
+    if (*error && (*error)->domain == G_CONVERT_ERROR)
+    {
+        GError *err = g_error_new (G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+            _("Argument not valid in current locale: %s"), (*error)->message);
+        g_error_free (*error);
+        *error = err;
+    }
 
-/**
- * @brief Free all fields used in a single recycle bin record
- * @param record Pointer to the record structure
- */
-static void
-_free_record_cb (rbin_struct *record)
-{
-    g_free (record->index_s);
-    g_date_time_unref (record->deltime);
-    if (record->raw_uni_path)
-        g_string_free (record->raw_uni_path, TRUE);
-    if (record->raw_legacy_path)
-        g_string_free (record->raw_legacy_path, TRUE);
-    g_clear_error (&record->error);
-    g_free (record);
+    return (*error == NULL);
 }
 
 
@@ -680,113 +1458,139 @@ rifiuti_init (rbin_type  type,
               char    ***argv,
               GError   **error)
 {
-    GOptionContext *context;
-
     setlocale (LC_ALL, "");
     init_handles ();
 
     /* Initialize metadata struct */
-    meta = g_malloc0 (sizeof (metarecord));
-    meta->records = g_ptr_array_new ();
-    g_ptr_array_set_free_func (meta->records, (GDestroyNotify) _free_record_cb);
-    meta->invalid_records = g_hash_table_new_full (
-        g_str_hash,
-        g_str_equal,
-        (GDestroyNotify) g_free,
-        (GDestroyNotify) g_error_free
-    );
-
-    // Other global structures
-    allidxfiles = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+    meta = meta_new (type, &cli_opts);
 
-    /* Parse command line arguments and generate help */
-    context = g_option_context_new (usage_param);
-    g_option_context_set_summary (context, usage_summary);
-    _opt_ctxt_setup (&context, type);
+    // Kept for parsing arguments of each request in server mode
+    usage_param_s = usage_param;
+    usage_summary_s = usage_summary;
+
+    if (! _parse_args (type, argv, error))
+        return false;
 
-    return _opt_ctxt_parse (&context, argv, error);
+    stats_span (cli_opts.stats, "init", "main", &stats_data.start, NULL);
+    return true;
 }
 
 
 /**
- * @brief Scan folder and add all index files for parsing
- * @param list Pointer to file list to be modified
- * @param path The folder to scan
- * @param error Pointer to `GError` for error reporting
- * @return `TRUE` on success, `FALSE` if folder can't be opened
+ * @brief Parse command line arguments and set up global filters
+ * @param type Recycle bin type
+ * @param argv Reference of command line `argv`
+ * @param error Location to store error upon failure
+ * @return `true` on success, `false` otherwise
  */
 static bool
-_populate_index_file_list (GPtrArray   *list,
-                           const char  *path,
-                           GError     **error)
+_parse_args   (rbin_type    type,
+               char      ***argv,
+               GError     **error)
 {
-    GDir           *dir;
-    const char     *direntry;
-    GPatternSpec   *pattern1, *pattern2;
+    GOptionContext *context;
 
-    // g_dir_open() returns cryptic error message or even succeeds on Windows,
-    // when in fact the directory content is inaccessible.
-#ifdef G_OS_WIN32
-    if ( !can_list_win32_folder (path, error) ) {
-        return false;
-    }
-#endif
+    /* Parse command line arguments and generate help */
+    context = g_option_context_new (usage_param_s);
+    g_option_context_set_summary (context, usage_summary_s);
+    _opt_ctxt_setup (&context, type);
 
-    if (NULL == (dir = g_dir_open (path, 0, error)))
+    if (! _opt_ctxt_parse (&context, argv, error))
         return false;
 
-    pattern1 = g_pattern_spec_new ("$I??????.*");
-    pattern2 = g_pattern_spec_new ("$I??????");
-
-    while ((direntry = g_dir_read_name (dir)) != NULL)
+    // Bodyfile columns are fixed by its format
+    if (n_out_fields && output_format == FORMAT_BODYFILE)
     {
-#if GLIB_CHECK_VERSION (2, 70, 0)
-        if (!g_pattern_spec_match_string (pattern1, direntry) &&
-            !g_pattern_spec_match_string (pattern2, direntry))
-            continue;
-#else /* glib < 2.70 */
-        if (!g_pattern_match_string (pattern1, direntry) &&
-            !g_pattern_match_string (pattern2, direntry))
-            continue;
-#endif
-        g_ptr_array_add (list,
-            g_build_filename (path, direntry, NULL));
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("Output fields can't be chosen for bodyfile format."));
+        return false;
     }
 
-    g_dir_close (dir);
+    if (n_out_fields == 0)
+    {
+        for (out_field f = 0; f < OUT_FIELD_MAX; f++)
+        {
+            if (f == OUT_FIELD_HASH && ! hash_payload)
+                continue;
+            if (f == OUT_FIELD_INDEX_HASH &&
+                ! (hash_index && type == RECYCLE_BIN_TYPE_DIR))
+                continue;
+            out_fields[n_out_fields++] = f;
+        }
+    }
+    else if (field_is_wanted (OUT_FIELD_HASH) && ! hash_payload)
+    {
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+            _("Output field 'hash' requires '--hash-payload' option."));
+        return false;
+    }
+    else if (field_is_wanted (OUT_FIELD_INDEX_HASH))
+    {
+        if (type == RECYCLE_BIN_TYPE_FILE)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Output field 'index_hash' is unavailable for INFO2, "
+                "whose digest is shown in header instead."));
+            return false;
+        }
+        if (! hash_index)
+        {
+            g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                _("Output field 'index_hash' requires '--hash-index' option."));
+            return false;
+        }
+    }
 
-    g_pattern_spec_free (pattern1);
-    g_pattern_spec_free (pattern2);
+    if (hash_jobs < 1)
+    {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+            _("Number of hash jobs must be positive, got %d"), hash_jobs);
+        return false;
+    }
 
-    return true;
-}
+    if (intern_paths && ! meta->paths)
+        meta->paths = path_store_new ();
 
+    if (where_expr)
+    {
+        where_filter = record_filter_compile (where_expr,
+            type, use_localtime, error);
+        if (where_filter == NULL)
+            return false;
+    }
 
-/**
- * @brief Search for desktop.ini in folder for hint of recycle bin
- * @param path The searched path
- * @return `TRUE` if `desktop.ini` found to contain recycle bin
- *         identifier, `FALSE` otherwise
- */
-static bool
-_found_desktop_ini (const char *path)
-{
-    char *filename = NULL, *content = NULL, *found = NULL;
+    path_filter = path_matcher_compile (path_globs, path_substrs,
+        legacy_encoding, error);
+    if (*error)
+        return false;
 
-    filename = g_build_filename (path, "desktop.ini", NULL);
-    if (!g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+    if (record_limit < 0)
     {
-        g_free (filename);
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+            _("Record limit must not be negative, got %d"), record_limit);
         return false;
     }
 
-    if (g_file_get_contents (filename, &content, NULL, NULL))
-        /* Don't bother parsing, we don't use the content at all */
-        found = strstr (content, RECYCLE_BIN_CLSID);
+    if (state_loc && ! (rescan_state = scan_state_load (state_loc, error)))
+        return false;
 
-    g_free (content);
-    g_free (filename);
-    return (found != NULL);
+    cli_opts.legacy_encoding = legacy_encoding;
+    cli_opts.where_filter    = where_filter;
+    cli_opts.path_filter     = path_filter;
+    cli_opts.fields          = 0;
+    for (int i = 0; i < n_out_fields; i++)
+        cli_opts.fields |= 1u << out_fields[i];
+    cli_opts.sort_by         = sort_by;
+    cli_opts.sort_desc       = sort_desc;
+    cli_opts.record_limit    = record_limit;
+    cli_opts.intern_paths    = intern_paths;
+    cli_opts.hash_payload    = hash_payload;
+    cli_opts.payload_hash_type = hash_type;
+    cli_opts.hash_jobs       = hash_jobs;
+    cli_opts.hash_index      = hash_index;
+    cli_opts.index_hash_type = index_hash_type;
+
+    return true;
 }
 
 
@@ -824,7 +1628,7 @@ _guess_windows_ver (const metarecord *meta)
             if (meta->recordsize == 280)
                 return OS_GUESS_ME;
 
-            if (meta->records->len == 0)
+            if (meta->records->len == 0 && meta->filtered == 0)
                 return OS_GUESS_2K_03;
 
             return meta->fill_junk ? OS_GUESS_2K : OS_GUESS_XP_03;
@@ -840,113 +1644,683 @@ _guess_windows_ver (const metarecord *meta)
 }
 
 /**
- * @brief Add potentially valid file(s) to list
- * @param path The file or folder to be checked
- * @param list A `GPtrArray` to store potential index files
- * @param type Recycle bin type
- * @param isolated_index Pointer to `gboolean`, indicating whether
- * the concerned `path` is a single `$Recycle.bin` type index
- * taken out of its original folder. Can be `NULL`, which means
- * this check is not performed.
- * @param error A `GError` pointer to store potential problems
- * @return `TRUE` if input file/dir is valid, `FALSE` otherwise
- * @attention Successful result does not imply files are appended
- * to list, which is the case for empty recycle bin
+ * @brief Determine output file name of a recycle bin in batch mode
+ * @param seq Sequence number of recycle bin, starting from 1
+ * @param path Path of recycle bin
+ * @return Newly allocated path inside output folder
+ * @note Sequence number keeps names unique, even when different
+ * recycle bins share the same base name (like `INFO2`)
  */
-static gboolean
-_check_file_args (const char  *path,
-                  GPtrArray   *list,
-                  rbin_type    type,
-                  bool        *isolated_index,
-                  GError     **error)
+static char *
+_batch_output_path   (guint         seq,
+                      const char   *path)
 {
-    g_debug ("Start checking path '%s'...", path);
-
-    g_return_val_if_fail (path != NULL, FALSE);
-    g_return_val_if_fail (list != NULL, FALSE);
+    static const char *ext[] = { "txt", "xml", "json", "ndjson", "msgpack",
+                                 "arrow", "db", "body" };
+    char *base, *name, *result;
 
-    if (!g_file_test (path, G_FILE_TEST_EXISTS))
-    {
-        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
-            _("'%s' does not exist."), path);
-        return FALSE;
-    }
+    base = g_path_get_basename (path);
+    for (char *p = base; *p; p++)
+        if (! g_ascii_isalnum (*p) && ! strchr ("-_.$", *p))
+            *p = '_';
 
-    if ((type == RECYCLE_BIN_TYPE_DIR) &&
-        g_file_test (path, G_FILE_TEST_IS_DIR))
-    {
-        if ( ! _populate_index_file_list (list, path, error) )
-            return FALSE;
-        /*
-         * last ditch effort: search for desktop.ini. Just print empty content
-         * representing empty recycle bin if found.
-         */
-        if (list->len == 0 && ! _found_desktop_ini (path))
-        {
-            g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
-                _("No files with name pattern '%s' "
-                "are found in directory."), "$Ixxxxxx.*");
-            return FALSE;
-        }
-    }
-    else if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
-    {
-        if (isolated_index && (type == RECYCLE_BIN_TYPE_DIR)) {
-            char *parent_dir = g_path_get_dirname (path);
-            *isolated_index = ! _found_desktop_ini (parent_dir);
-            g_free (parent_dir);
-        }
-        g_ptr_array_add (list, g_strdup (path));
-    }
-    else
-    {
-        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
-            (type == RECYCLE_BIN_TYPE_DIR) ?
-            _("'%s' is not a normal file or directory.") :
-            _("'%s' is not a normal file."), path);
-        return FALSE;
-    }
-    return TRUE;
-}
+    name = g_strdup_printf ("%06u-%s.%s", seq, base, ext[output_format]);
+    result = g_build_filename (output_dir, name, NULL);
 
-void
-do_parse_records (ParseIdxFunc func)
-{
-    g_ptr_array_foreach (allidxfiles, (GFunc) func, meta);
+    g_free (base);
+    g_free (name);
+    return result;
 }
 
 
 /**
- * @brief Print preamble and column header for TSV output
- * @param meta Pointer to metadata structure
+ * @brief Report fatal and record errors of a single recycle bin
+ * @param path Path of recycle bin
+ * @param error The fatal error, can point to `NULL`
+ * @return Exit code corresponding to errors
  */
-static void
-_print_text_header (const metarecord *meta)
+static exitcode
+_report_bin_errors   (const char   *path,
+                      GError      **error)
 {
-    {
-        char *rbin_path = g_filename_display_name (meta->filename);
-        g_print (_("Recycle bin path: '%s'\n"), rbin_path);
-        g_free (rbin_path);
-    }
+    exitcode code;
 
-    if (meta->version == VERSION_NOT_FOUND) {
-        g_print ("%s\n", _("Version: ??? (empty folder)"));
-    } else {
-        g_print (_("Version: %" PRIu64 "\n"), meta->version);
-    }
-
-    if (( meta->type == RECYCLE_BIN_TYPE_FILE ) && meta->total_entry)
+    if (*error)
     {
-        g_print (_("Total entries ever existed: %d"), meta->total_entry);
-        g_print ("\n");
+        char *display = g_filename_display_name (path);
+        g_prefix_error (error, "%s: ", display);
+        g_free (display);
     }
 
-#if (defined G_OS_WIN32 || defined __linux__)
-    if (live_mode)
-    {
-        char *product_name = windows_product_name();
+    code = _get_exit_code ((const GError *) (*error));
+    g_clear_error (error);
 
-        if (product_name) {
+    if (_has_record_error () && code == EXIT_OK)
+        code = EXIT_ERR_DUBIOUS_DATA;
+
+    return code;
+}
+
+
+#ifdef G_OS_UNIX
+
+/**
+ * @brief Options which clients may use in server mode
+ * @note Only format, filter and field options are allowed. Output
+ * always goes back through client connection, so any option which
+ * writes file or changes program mode is rejected.
+ */
+static const struct
+{
+    const char  *name;
+    char         short_name;
+    bool         has_arg;
+} client_opts[] = {
+    { "delimiter"      , 't' , true  },
+    { "no-heading"     , 'n' , false },
+    { "xml"            , 'x' , false },
+    { "format"         , 'f' , true  },
+    { "fields"         , 0   , true  },
+    { "localtime"      , 'z' , false },
+    { "intern-paths"   , 0   , false },
+    { "hash-index"     , 0   , true  },
+    { "hash-payload"   , 0   , true  },
+    { "where"          , 0   , true  },
+    { "sort"           , 0   , true  },
+    { "limit"          , 0   , true  },
+    { "path-glob"      , 0   , true  },
+    { "path-substr"    , 0   , true  },
+    { "legacy-filename", 'l' , true  },
+};
+
+
+/**
+ * @brief Check if client request only uses allowed options
+ * @param args Arguments of request, same as command line
+ * @param error Location to store error upon failure
+ * @return `true` if all options are allowed
+ * @note Must be done before parsing, as some option callbacks
+ * already write files during parsing.
+ */
+static bool
+_check_client_args   (char      **args,
+                      GError    **error)
+{
+    char       **p;
+    const char  *opt;
+    size_t       len, i;
+    int          n_values = 0;
+
+    for (p = args; *p; p++)
+    {
+        opt = *p;
+        if (n_values > 0)
+        {
+            n_values--;
+            continue;
+        }
+        if (opt[0] != '-' || opt[1] == '\0')
+            continue;
+        if (strcmp (opt, "--") == 0)
+            break;
+
+        if (opt[1] == '-')
+        {
+            opt += 2;
+            len = strcspn (opt, "=");
+            for (i = 0; i < G_N_ELEMENTS (client_opts); i++)
+                if (strlen (client_opts[i].name) == len &&
+                    strncmp (client_opts[i].name, opt, len) == 0)
+                    break;
+            if (i == G_N_ELEMENTS (client_opts))
+                goto bad_option;
+            if (client_opts[i].has_arg && opt[len] == '\0')
+                n_values++;
+            continue;
+        }
+
+        // Short options may be grouped, and each of them taking
+        // argument consumes next argument in turn
+        for (const char *c = opt + 1; *c; c++)
+        {
+            for (i = 0; i < G_N_ELEMENTS (client_opts); i++)
+                if (client_opts[i].short_name == *c)
+                    break;
+            if (i == G_N_ELEMENTS (client_opts))
+                goto bad_option;
+            if (client_opts[i].has_arg)
+                n_values++;
+        }
+    }
+    return true;
+
+    bad_option:
+
+    g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+        _("Option '%s' can't be used by client in server mode."), *p);
+    return false;
+}
+
+
+/**
+ * @brief Restore all options and state derived from them to default
+ * @note Server has only parsed `--serve` option, but fallback
+ * values and filters are still filled after parsing. Everything
+ * is reset anyway, so that no request depends on server setup.
+ */
+static void
+_reset_opts   (void)
+{
+    g_clear_pointer (&delim, g_free);
+    g_clear_pointer (&serve_socket, g_free);
+    g_clear_pointer (&output_loc, g_free);
+    g_clear_pointer (&output_dir, g_free);
+    g_clear_pointer (&state_loc, g_free);
+    g_clear_pointer (&trace_loc, g_free);
+    g_clear_pointer (&metrics_loc, g_free);
+    g_clear_pointer (&where_expr, g_free);
+    g_clear_pointer (&files0_from, g_free);
+    g_clear_pointer (&legacy_encoding, g_free);
+    g_clear_pointer (&watch_dir, g_free);
+    g_clear_pointer (&path_globs, g_strfreev);
+    g_clear_pointer (&path_substrs, g_strfreev);
+    g_clear_pointer (&fileargs, g_strfreev);
+    g_clear_pointer (&where_filter, record_filter_free);
+    g_clear_pointer (&path_filter, path_matcher_free);
+
+    output_format   = FORMAT_UNKNOWN;
+    n_out_fields    = 0;
+    no_heading      = false;
+    use_localtime   = FALSE;
+    intern_paths    = FALSE;
+    live_mode       = FALSE;
+    show_stats      = false;
+    stats_json      = false;
+    bench_runs      = 0;
+    show_mem_stats  = FALSE;
+    hash_payload    = false;
+    hash_type       = G_CHECKSUM_SHA256;
+    hash_jobs       = HASH_DEFAULT_JOBS;
+    hash_index      = false;
+    index_hash_type = G_CHECKSUM_SHA256;
+    sort_by         = SORT_NATURAL;
+    sort_desc       = false;
+    record_limit    = 0;
+}
+
+
+/**
+ * @brief Process a single request in server mode
+ * @param args Arguments of request, same as command line
+ * @return Exit status of request
+ * @note Runs in dedicated child process of server
+ */
+static int
+_serve_request   (char   **args)
+{
+    GError     *error = NULL;
+    GPtrArray  *argv;
+    char      **argv_p;
+
+    _reset_opts ();
+
+    argv = g_ptr_array_new ();
+    g_ptr_array_add (argv, (gpointer) g_get_prgname ());
+    for (char **p = args; *p; p++)
+        g_ptr_array_add (argv, *p);
+    g_ptr_array_add (argv, NULL);
+    argv_p = (char **) argv->pdata;
+
+    if (_check_client_args (args, &error) &&
+        _parse_args (meta->type, &argv_p, &error))
+        process_bins (bin_func, &error);
+    g_ptr_array_free (argv, TRUE);
+
+    return rifiuti_cleanup (&error);
+}
+
+
+/**
+ * @brief Run server, which processes requests from Unix socket
+ * @param error Location to store error upon failure
+ */
+static void
+_serve (GError   **error)
+{
+    GIConv      conv;
+    GDateTime  *dt;
+
+    // Loading converter modules and time zone data is costly, do
+    // it once so that every forked request inherits them
+    conv = g_iconv_open ("UTF-8", "UTF-16LE");
+    dt = g_date_time_new_now_local ();
+    g_date_time_unref (dt);
+
+    serve_requests (serve_socket, &_serve_request, error);
+
+    if (conv != (GIConv) -1)
+        g_iconv_close (conv);
+}
+
+#endif
+
+
+/**
+ * @brief Report index files removed since last scan on stderr
+ * @note For output formats which can't hold removals, or when
+ * recycle bin is not dumped at all
+ */
+static void
+_print_removals_stderr   (void)
+{
+    if (state_removals == NULL || state_removals->len == 0)
+        return;
+
+    g_printerr ("%s\n", _("Removed since last scan:"));
+    for (guint i = 0; i < state_removals->len; i++)
+    {
+        state_removal *r = g_ptr_array_index (state_removals, i);
+        g_printerr ("%s: %s\n", r->index_s, r->path ? r->path : "???");
+    }
+}
+
+
+/**
+ * @brief Parse and dump current recycle bin, reusing scan state if any
+ */
+static bool
+_run_bin_func   (ProcessBinFunc   func,
+                 GError         **error)
+{
+    bool        result;
+    stats_time  mark;
+    gint64      start = g_get_monotonic_time ();
+
+    stats_mark (cli_opts.stats, &mark);
+
+    // Output functions switch phase on their own
+    mem_stats_set_phase (MEM_PHASE_PARSE);
+    if (rescan_state)
+        state_removals = scan_state_apply (rescan_state, meta);
+    result = func (error);
+    mem_stats_set_phase (MEM_PHASE_OTHER);
+
+    // Left over if output format can't hold them
+    _print_removals_stderr ();
+    g_clear_pointer (&state_removals, g_ptr_array_unref);
+
+    stats_add_bin (cli_opts.stats, meta);
+    stats_trace_phases (cli_opts.stats, meta->filename);
+    stats_span (cli_opts.stats, "bin", "main", &mark, meta->filename);
+    if (metrics)
+        metrics_add_bin (metrics, meta, g_get_monotonic_time () - start);
+    mem_records += meta->records->len + meta->filtered;
+    return result;
+}
+
+
+/* Print statistics after all output is written */
+static void
+_print_stats   (void)
+{
+    char *s;
+
+    if (show_stats)
+    {
+        io_flush ();
+        s = stats_to_string (&stats_data, stats_json);
+        g_printerr ("%s", s);
+        g_free (s);
+    }
+
+#ifdef ENABLE_MEM_STATS
+    if (show_mem_stats)
+    {
+        s = mem_stats_to_string (mem_records);
+        g_printerr ("%s", s);
+        g_free (s);
+    }
+#else
+    UNUSED (show_mem_stats);
+#endif
+}
+
+
+/**
+ * @brief Write back scan state after all recycle bins are processed
+ * @note State is saved even if some recycle bin failed, since
+ * index files parsed are still valid. Error is only reported if
+ * no other error happened.
+ */
+static void
+_save_state   (GError   **error)
+{
+    if (rescan_state)
+        scan_state_save (rescan_state, (error && *error) ? NULL : error);
+}
+
+
+/**
+ * @brief Fresh metadata for a benchmark run, sharing loaded index data
+ */
+static metarecord *
+_bench_meta_new   (const metarecord   *loaded)
+{
+    metarecord *m = meta_new (loaded->type, &cli_opts);
+
+    m->filename = g_strdup (loaded->filename);
+    m->isolated_index = loaded->isolated_index;
+    for (guint i = 0; i < loaded->idxfiles->len; i++)
+        g_ptr_array_add (m->idxfiles,
+            g_strdup (g_ptr_array_index (loaded->idxfiles, i)));
+    m->idxdata = g_ptr_array_ref (loaded->idxdata);
+
+    return m;
+}
+
+
+/* Print mean time, its variation and throughput of a phase */
+static void
+_print_bench_row   (const char     *name,
+                    const gint64   *samples,
+                    uint64_t        records,
+                    gsize           bytes)
+{
+    double  sum = 0, sq = 0, mean, sd;
+    gint64  min = samples[0];
+
+    for (int i = 0; i < bench_runs; i++)
+    {
+        sum += samples[i];
+        min = MIN (min, samples[i]);
+    }
+    mean = sum / bench_runs;
+    for (int i = 0; i < bench_runs; i++)
+        sq += (samples[i] - mean) * (samples[i] - mean);
+    sd = (bench_runs > 1) ? sqrt (sq / (bench_runs - 1)) : 0;
+
+    g_print ("%-9s %10.3f %10.3f %6.1f%% %10.3f", name, mean / 1000,
+        sd / 1000, (mean > 0) ? sd * 100 / mean : 0, min / 1000.0);
+    if (mean > 0)
+        // bytes per microsecond is MB/s
+        g_print (" %12.0f %10.2f\n", records * 1e6 / mean, bytes / mean);
+    else
+        g_print (" %12s %10s\n", "-", "-");
+}
+
+
+/**
+ * @brief Parse and dump recycle bin repeatedly from memory, then
+ * report time spent in each phase
+ * @param func Function to parse and dump a single recycle bin
+ * @param error Location to store fatal error
+ * @note Index files are read only once beforehand, and output goes
+ * to null device, so that figures reflect processing cost without
+ * disk access. Status of trashed files may still be checked on disk.
+ */
+static void
+_benchmark   (ProcessBinFunc   func,
+              GError         **error)
+{
+    static const stats_phase phases[] = {
+        STATS_PHASE_PARSE, STATS_PHASE_CONVERT,
+        STATS_PHASE_FORMAT, STATS_PHASE_WRITE,
+    };
+    const gsize  n_phases = G_N_ELEMENTS (phases);
+    metarecord  *loaded = meta;
+    gint64      *samples;  // one row per phase, plus total
+    gint64       load_time;
+    gsize        bytes;
+    uint64_t     records = 0;
+    int          done;
+
+    if (! load_index_files (loaded, error))
+        return;
+    bytes = stats_data.bytes_read;
+    load_time = stats_data.phase[STATS_PHASE_READ].wall;
+
+    if (! io_discard_output (true, error))
+        return;
+
+    samples = g_new0 (gint64, (n_phases + 1) * bench_runs);
+    meta = NULL;
+    for (done = 0; done < bench_runs; done++)
+    {
+        gint64  start;
+        bool    ok;
+
+        meta_free (meta);
+        meta = _bench_meta_new (loaded);
+        stats_init (&stats_data);
+        batch_dumped = 0;
+
+        start = g_get_monotonic_time ();
+        ok = func (error);
+        io_flush ();
+        samples[n_phases * bench_runs + done] =
+            g_get_monotonic_time () - start;
+        if (! ok)
+            break;
+
+        for (gsize i = 0; i < n_phases; i++)
+            samples[i * bench_runs + done] = stats_data.phase[phases[i]].wall;
+        records = meta->records->len + meta->filtered;
+    }
+    io_discard_output (false, NULL);
+
+    // Metadata of last run is kept, for final error report
+    meta_free (loaded);
+
+    if (done == bench_runs)
+    {
+        g_print (_("Runs: %d, records per run: %" PRIu64 ", index data: "
+            "%zu bytes loaded in %.3f ms\n\n"),
+            bench_runs, records, bytes, load_time / 1000.0);
+        g_print ("%-9s %10s %10s %7s %10s %12s %10s\n", _("phase"),
+            _("mean(ms)"), _("sd(ms)"), _("cv"), _("min(ms)"),
+            _("records/s"), _("MB/s"));
+        for (gsize i = 0; i < n_phases; i++)
+            _print_bench_row (stats_phase_name (phases[i]),
+                samples + i * bench_runs, records, bytes);
+        _print_bench_row (_("total"),
+            samples + n_phases * bench_runs, records, bytes);
+    }
+    g_free (samples);
+}
+
+
+/**
+ * @brief Commit database of SQLite output, if any
+ * @param error Location of error so far, which is also used
+ * to store error upon failure
+ * @note Nothing is kept if there is error already
+ */
+static void
+_close_sqlite   (GError   **error)
+{
+#ifdef ENABLE_SQLITE
+    if (sqlite_db == NULL)
+        return;
+
+    sqlite_out_close (sqlite_db, *error == NULL, *error ? NULL : error);
+    sqlite_db = NULL;
+#else
+    UNUSED (error);
+#endif
+}
+
+
+/**
+ * @brief Process all recycle bins requested on command line
+ * @param func Function to parse and dump a single recycle bin
+ * @param error Location to store fatal error in single bin mode
+ * @note In batch mode, every recycle bin gets fresh metadata, and
+ * errors of each recycle bin are reported on its own without stopping
+ * others. Output of all recycle bins goes to a combined stream,
+ * unless output folder is specified.
+ */
+void
+process_bins   (ProcessBinFunc   func,
+                GError         **error)
+{
+    char  *combined_loc = NULL;
+
+#ifdef G_OS_UNIX
+    if (serve_socket)
+    {
+        bin_func = func;
+        _serve (error);
+        return;
+    }
+#endif
+
+#ifdef __linux__
+    if (watch_dir)
+    {
+        _watch (error);
+        return;
+    }
+#endif
+
+    if (bench_runs)
+    {
+        _benchmark (func, error);
+        return;
+    }
+
+#ifdef ENABLE_SQLITE
+    if (output_format == FORMAT_SQLITE &&
+        ! (sqlite_db = sqlite_out_open (output_loc, error)))
+        return;
+#endif
+
+    if (batch_paths == NULL)
+    {
+        _run_bin_func (func, error);
+        _close_sqlite (error);
+        _save_state (error);
+        _print_stats ();
+        return;
+    }
+
+    // Combined output goes into single temp file, which is moved
+    // to destination only when all recycle bins are done. Database
+    // is written in place instead, as it is loaded in one transaction.
+    if (output_loc && output_format != FORMAT_SQLITE)
+    {
+        if (! get_tempfile (error))
+            return;
+        combined_loc = output_loc;
+        output_loc = NULL;
+    }
+
+    // Rows need tagging when there is no heading to tell them apart
+    bool tag_rows = (! output_dir && output_format == FORMAT_TEXT && no_heading);
+
+    for (guint i = 0; i < batch_paths->len; i++)
+    {
+        const char  *path = g_ptr_array_index (batch_paths, i);
+        GError      *bin_err = NULL;
+        exitcode     code;
+
+        if (i > 0)
+        {
+            rbin_type type = meta->type;
+            meta_free (meta);
+            meta = meta_new (type, &cli_opts);
+        }
+        meta->filename = g_strdup (path);
+
+        if (output_dir)
+            output_loc = _batch_output_path (i + 1, path);
+
+        if (tag_rows)
+        {
+            g_free (batch_tag);
+            batch_tag = g_filename_display_name (path);
+        }
+
+        if (output_dir && g_file_test (output_loc, G_FILE_TEST_EXISTS))
+            g_set_error (&bin_err, G_FILE_ERROR, G_FILE_ERROR_EXIST,
+                _("Output destination '%s' already exists."), output_loc);
+        else if (find_index_files (meta, path, &bin_err))
+            _run_bin_func (func, &bin_err);
+
+        if (output_dir)
+            g_clear_pointer (&output_loc, g_free);
+
+        code = _report_bin_errors (path, &bin_err);
+        if (metrics)
+            metrics_add_result (metrics, code);
+        if (batch_code == EXIT_OK)
+            batch_code = code;
+    }
+
+    g_clear_pointer (&batch_tag, g_free);
+
+    // Errors were reported already, don't repeat during cleanup
+    {
+        rbin_type type = meta->type;
+        meta_free (meta);
+        meta = meta_new (type, &cli_opts);
+    }
+
+    if (combined_loc)
+    {
+        if (! clean_tempfile (combined_loc, error))
+        {
+            GError *new_err = g_error_new_literal (
+                R2_FATAL_ERROR, R2_FATAL_ERROR_TEMPFILE,
+                (*error)->message);
+            g_error_free (*error);
+            *error = new_err;
+        }
+        output_loc = combined_loc;
+    }
+
+    _close_sqlite (error);
+    _save_state (error);
+    _print_stats ();
+}
+
+
+/**
+ * @brief Print preamble and column header for TSV output
+ * @param meta Pointer to metadata structure
+ */
+static void
+_print_text_header (const metarecord *meta)
+{
+    {
+        char *rbin_path = g_filename_display_name (meta->filename);
+        g_print (_("Recycle bin path: '%s'\n"), rbin_path);
+        g_free (rbin_path);
+    }
+
+    if (meta->version == VERSION_NOT_FOUND) {
+        g_print ("%s\n", _("Version: ??? (empty folder)"));
+    } else {
+        g_print (_("Version: %" PRIu64 "\n"), meta->version);
+    }
+
+    if (( meta->type == RECYCLE_BIN_TYPE_FILE ) && meta->total_entry)
+    {
+        g_print (_("Total entries ever existed: %d"), meta->total_entry);
+        g_print ("\n");
+    }
+
+    if (meta->index_hash)
+    {
+        g_print (_("Index file digest: %s"), meta->index_hash);
+        g_print ("\n");
+    }
+
+#if (defined G_OS_WIN32 || defined __linux__)
+    if (live_mode)
+    {
+        char *product_name = windows_product_name();
+
+        if (product_name) {
             g_print (_("OS: %s"), product_name);
             g_free (product_name);
         } else {
@@ -987,271 +2361,1168 @@ _print_text_header (const metarecord *meta)
         g_print (_("Time zone: %s [%s]"), tzname, tznumeric);
         g_print ("\n");
 
-        g_date_time_unref (now);
-        g_free (tzname);
-        g_free (tznumeric);
-    }
+        g_date_time_unref (now);
+        g_free (tzname);
+        g_free (tznumeric);
+    }
+
+    g_print ("\n");
+
+    {
+        const char *fields[] = {
+            /* TRANSLATOR COMMENT: appears in column header */
+            N_("Index"), N_("Deleted Time"), N_("Gone?"), N_("Size"), N_("Path"),
+            N_("Hash"), N_("Index Hash")
+        };
+        char **header = g_malloc0_n (n_out_fields + 1, sizeof (gpointer));
+        char  *headerline;
+
+        for (int i = 0; i < n_out_fields; i++)
+            header[i] = (char *) fields[out_fields[i]];
+        headerline = g_strjoinv (delim, header);
+        g_print ("%s\n", headerline);
+        g_free (headerline);
+        g_free (header);
+    }
+}
+
+
+/**
+ * @brief Print preamble for XML output
+ * @param meta Pointer to metadata structure
+ */
+static void
+_print_xml_header (const metarecord *meta)
+{
+    GString *result;
+
+    result = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+
+    g_string_append_printf (result,
+        "<recyclebin format=\"%s\"",
+        ( meta->type == RECYCLE_BIN_TYPE_FILE ) ? "file" : "dir");
+
+    if (meta->version >= 0)  /* can be found and not error */
+        g_string_append_printf (result,
+            " version=\"%" PRId64 "\"",
+            meta->version);
+
+    if (meta->type == RECYCLE_BIN_TYPE_FILE && meta->total_entry > 0)
+        g_string_append_printf (result,
+            " ever_existed=\"%" PRIu32 "\"",
+            meta->total_entry);
+
+    if (meta->index_hash)
+        g_string_append_printf (result,
+            " index_hash=\"%s\"", meta->index_hash);
+
+    result = g_string_append (result, ">\n");
+
+    {
+        char *rbin_path = g_filename_display_name (meta->filename);
+        g_string_append_printf (result,
+            "  <filename><![CDATA[%s]]></filename>\n",
+            rbin_path);
+        g_free (rbin_path);
+    }
+
+    g_print ("%s", result->str);
+    g_string_free (result, TRUE);
+}
+
+
+/**
+ * @brief Print preamble for JSON output
+ * @param meta Pointer to metadata structure
+ */
+static void
+_print_json_header (const metarecord *meta)
+{
+    g_print ("{\n  \"format\": \"%s\",\n",
+        (meta->type == RECYCLE_BIN_TYPE_FILE) ? "file" : "dir");
+
+    if (meta->version >= 0)  /* can be found and not error */
+        g_print ("  \"version\": %" PRId64 ",\n", meta->version);
+    else
+        g_print ("  \"version\": null,\n");
+
+    if (meta->type == RECYCLE_BIN_TYPE_FILE && meta->total_entry > 0)
+        g_print ("  \"ever_existed\": %" PRIu32 ",\n", meta->total_entry);
+
+    if (meta->index_hash)
+        g_print ("  \"index_hash\": \"%s\",\n", meta->index_hash);
+
+    {
+        char *s = g_filename_display_name (meta->filename);
+        char *rbin_path = json_escape (s);
+        g_print ("  \"path\": \"%s\",\n", rbin_path);
+        g_free (s);
+        g_free (rbin_path);
+    }
+
+    g_print ("  \"records\": [\n");
+}
+
+
+/**
+ * @brief Format deletion time of record for output
+ * @param record The record to format
+ * @param iso Whether to use ISO 8601 form with time zone suffix
+ * @return Newly allocated time string
+ */
+static char *
+_format_deltime   (const rbin_struct   *record,
+                   bool                 iso)
+{
+    GDateTime  *dt;
+    char       *result;
+
+    dt = use_localtime ? g_date_time_to_local (record->deltime):
+                         g_date_time_ref      (record->deltime);
+    result = g_date_time_format (dt, ! iso         ? "%F %T"   :
+                                      use_localtime ? "%FT%T%z" :
+                                                      "%FT%TZ"  );
+    g_date_time_unref (dt);
+    return result;
+}
+
+
+/**
+ * @brief Convert path of record to UTF-8 for output
+ * @return Newly allocated path, or `NULL` if conversion fails
+ * in which case error is stored in record
+ */
+static char *
+_format_path   (rbin_struct        *record,
+                out_fmt             format,
+                StrTransformFunc    func)
+{
+    const GString  *src;
+    GString        *full_path = NULL;
+    char           *result;
+    conv_counts     counts = { 0 };
+    stats_time      mark;
+
+    mem_phase       prev_phase;
+
+    prev_phase = mem_stats_set_phase (MEM_PHASE_CONVERT);
+    stats_mark (cli_opts.stats, &mark);
+    src = record_get_raw_path (meta, record, &full_path);
+    result = conv_path_to_utf8_with_tmpl (src, legacy_encoding, format,
+        func, cli_opts.stats ? &counts : NULL, &record->error);
+    if (full_path)
+        g_string_free (full_path, TRUE);
+    stats_add_since (cli_opts.stats, STATS_PHASE_CONVERT, &mark);
+    mem_stats_set_phase (prev_phase);
+
+    if (cli_opts.stats)
+    {
+        cli_opts.stats->conv_fallbacks += counts.fallbacks;
+        cli_opts.stats->escaped_chars += counts.escaped;
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief Print columns of a record as one line
+ * @param cols `NULL` terminated list of columns
+ * @param sep Column separator
+ * @note In batch mode, rows may be tagged with recycle bin path
+ */
+static void
+_print_columns   (char         **cols,
+                  const char    *sep)
+{
+    char *output = g_strjoinv (sep, cols);
+
+    if (batch_tag)
+        g_print ("%s%s%s\n", batch_tag, sep, output);
+    else
+        g_print ("%s\n", output);
+
+    g_free (output);
+}
+
+
+static void
+_print_text_record   (rbin_struct        *record,
+                      const metarecord   *meta)
+{
+    char         **cols;
+    extern struct _fmt_data fmt[];
+
+    g_return_if_fail (record != NULL);
+
+    cols = (char **) g_malloc0_n (n_out_fields + 1, sizeof(gpointer));
+
+    for (int i = 0; i < n_out_fields; i++)
+    {
+        switch (out_fields[i])
+        {
+            case OUT_FIELD_INDEX:
+                cols[i] = (meta->type == RECYCLE_BIN_TYPE_FILE) ?
+                    g_strdup_printf ("%" PRIu32, record->index_n) :
+                    g_strdup (record->index_s);
+                break;
+
+            case OUT_FIELD_TIME:
+                cols[i] = _format_deltime (record, false);
+                break;
+
+            case OUT_FIELD_GONE:
+                cols[i] = g_strdup (fmt[FORMAT_TEXT].gone_outtext[record->gone]);
+                break;
+
+            case OUT_FIELD_SIZE:
+                cols[i] = (record->filesize == G_MAXUINT64) ?  // faulty
+                    g_strdup ("???") :
+                    g_strdup_printf ("%" PRIu64, record->filesize);
+                break;
+
+            case OUT_FIELD_PATH:
+                cols[i] = _format_path (record, FORMAT_TEXT, NULL);
+                if (! cols[i])
+                    cols[i] = g_strdup ("???");
+                break;
+
+            case OUT_FIELD_HASH:
+                cols[i] = g_strdup (record->payload_hash ?
+                    record->payload_hash : "???");
+                break;
+
+            case OUT_FIELD_INDEX_HASH:
+                cols[i] = g_strdup (record->index_hash ?
+                    record->index_hash : "???");
+                break;
+
+            default: g_assert_not_reached ();
+        }
+    }
+
+    _print_columns (cols, delim);
+    g_strfreev (cols);
+}
+
+
+/**
+ * @brief Print record in bodyfile format of The Sleuth Kit
+ * @note Deletion time is placed in ctime column, which `mactime`
+ * shows as metadata change; other times are left as 0 (unknown).
+ * Columns are MD5, name, inode, mode, UID, GID, size, atime, mtime,
+ * ctime and crtime. Record index takes place of inode.
+ */
+static void
+_print_bodyfile_record   (rbin_struct        *record,
+                          const metarecord   *meta)
+{
+    char *cols[12] = { NULL };
+
+    g_return_if_fail (record != NULL);
+
+    if (record->payload_hash && g_str_has_prefix (record->payload_hash, "md5:"))
+        cols[0] = g_strdup (record->payload_hash + 4);
+    else
+        cols[0] = g_strdup ("0");
+
+    cols[1] = _format_path (record, FORMAT_BODYFILE, NULL);
+    if (! cols[1])
+        cols[1] = g_strdup ("???");
+
+    cols[2] = (meta->type == RECYCLE_BIN_TYPE_FILE) ?
+        g_strdup_printf ("%" PRIu32, record->index_n) :
+        g_strdup (record->index_s);
+
+    for (int i = 3; i <= 5; i++)  // mode, UID and GID
+        cols[i] = g_strdup ("0");
+
+    cols[6] = g_strdup_printf ("%" PRIu64,
+        (record->filesize == G_MAXUINT64) ? 0 : record->filesize);
+    cols[7] = g_strdup ("0");
+    cols[8] = g_strdup ("0");
+    cols[9] = g_strdup_printf ("%" PRId64,
+        g_date_time_to_unix (record->deltime));
+    cols[10] = g_strdup ("0");
+
+    _print_columns (cols, "|");
+
+    for (int i = 0; i < 11; i++)
+        g_free (cols[i]);
+}
+
+
+static void
+_print_xml_record   (rbin_struct        *record,
+                     const metarecord   *meta)
+{
+    extern struct _fmt_data fmt[];
+    char         *path = NULL, *dt_str;
+    GString      *s;
+    bool          want_path = false;
+
+    g_return_if_fail (record != NULL);
+
+    s = g_string_new ("  <record");
+
+    for (int i = 0; i < n_out_fields; i++)
+    {
+        switch (out_fields[i])
+        {
+            case OUT_FIELD_INDEX:
+                if (meta->type == RECYCLE_BIN_TYPE_FILE)
+                    g_string_append_printf (s,
+                        " index=\"%" PRIu32 "\"", record->index_n);
+                else
+                    g_string_append_printf (s,
+                        " index=\"%s\"", record->index_s);
+                break;
+
+            case OUT_FIELD_TIME:
+                dt_str = _format_deltime (record, true);
+                g_string_append_printf (s, " time=\"%s\"", dt_str);
+                g_free (dt_str);
+                break;
+
+            case OUT_FIELD_GONE:
+                g_string_append_printf (s, " gone=\"%s\"",
+                    fmt[FORMAT_XML].gone_outtext[record->gone]);
+                break;
+
+            case OUT_FIELD_SIZE:
+                if (record->filesize == G_MAXUINT64)  // faulty
+                    g_string_append_printf (s, " size=\"-1\"");
+                else
+                    g_string_append_printf (s,
+                        " size=\"%" PRIu64 "\"", record->filesize);
+                break;
+
+            case OUT_FIELD_PATH:
+                // Still need to be converted despite using CDATA,
+                // otherwise could be writing garbage output
+                want_path = true;
+                path = _format_path (record, FORMAT_XML, NULL);
+                break;
+
+            case OUT_FIELD_HASH:
+                if (record->payload_hash)
+                    g_string_append_printf (s,
+                        " hash=\"%s\"", record->payload_hash);
+                break;
+
+            case OUT_FIELD_INDEX_HASH:
+                if (record->index_hash)
+                    g_string_append_printf (s,
+                        " index_hash=\"%s\"", record->index_hash);
+                break;
+
+            default: g_assert_not_reached ();
+        }
+    }
+
+    if (! want_path)
+        s = g_string_append (s, "/>\n");
+    else if (path)
+        g_string_append_printf (s, ">\n"
+            "    <path><![CDATA[%s]]></path>\n"
+            "  </record>\n", path);
+    else
+        s = g_string_append (s, ">\n    <path/>\n  </record>\n");
+
+    g_print ("%s", s->str);
+    g_string_free (s, TRUE);
+    g_free (path);
+}
+
+
+/* Append member name of JSON object, with or without spacing */
+static void
+_append_json_key   (GString      *s,
+                    const char   *key,
+                    bool          compact)
+{
+    g_string_append_printf (s, compact ? "\"%s\":" : "\"%s\": ", key);
+}
+
+
+/**
+ * @brief Append selected fields of record as JSON object members
+ * @param s The string to append to
+ * @param record The record
+ * @param meta The metadata
+ * @param compact Whether to omit spaces between members
+ */
+static void
+_append_json_fields   (GString            *s,
+                       rbin_struct        *record,
+                       const metarecord   *meta,
+                       bool                compact)
+{
+    extern struct _fmt_data fmt[];
+    char         *str;
+
+    for (int i = 0; i < n_out_fields; i++)
+    {
+        if (i > 0)
+            s = g_string_append (s, compact ? "," : ", ");
+
+        switch (out_fields[i])
+        {
+            case OUT_FIELD_INDEX:
+                _append_json_key (s, "index", compact);
+                if (meta->type == RECYCLE_BIN_TYPE_FILE)
+                    g_string_append_printf (s, "%" PRIu32, record->index_n);
+                else
+                    g_string_append_printf (s, "\"%s\"", record->index_s);
+                break;
+
+            case OUT_FIELD_TIME:
+                str = _format_deltime (record, true);
+                _append_json_key (s, "time", compact);
+                g_string_append_printf (s, "\"%s\"", str);
+                g_free (str);
+                break;
+
+            case OUT_FIELD_GONE:
+                _append_json_key (s, "gone", compact);
+                s = g_string_append (s,
+                    fmt[FORMAT_JSON].gone_outtext[record->gone]);
+                break;
+
+            case OUT_FIELD_SIZE:
+                _append_json_key (s, "size", compact);
+                if (record->filesize == G_MAXUINT64)  // faulty
+                    s = g_string_append (s, "null");
+                else
+                    g_string_append_printf (s, "%" PRIu64, record->filesize);
+                break;
+
+            case OUT_FIELD_PATH:
+                str = _format_path (record, FORMAT_JSON, &json_escape);
+                _append_json_key (s, "path", compact);
+                if (str)
+                    g_string_append_printf (s, "\"%s\"", str);
+                else
+                    s = g_string_append (s, "null");
+                g_free (str);
+                break;
+
+            case OUT_FIELD_HASH:
+                _append_json_key (s, "hash", compact);
+                if (record->payload_hash)
+                    g_string_append_printf (s, "\"%s\"", record->payload_hash);
+                else
+                    s = g_string_append (s, "null");
+                break;
+
+            case OUT_FIELD_INDEX_HASH:
+                _append_json_key (s, "index_hash", compact);
+                if (record->index_hash)
+                    g_string_append_printf (s, "\"%s\"", record->index_hash);
+                else
+                    s = g_string_append (s, "null");
+                break;
+
+            default: g_assert_not_reached ();
+        }
+    }
+}
+
+
+static void
+_print_json_record   (rbin_struct        *record,
+                      const metarecord   *meta)
+{
+    GString      *s;
+
+    g_return_if_fail (record != NULL);
+
+    s = g_string_new ("    {");
+    _append_json_fields (s, record, meta, false);
+    s = g_string_append (s, "},\n");
+    g_print ("%s", s->str);
+    g_string_free (s, TRUE);
+}
+
+
+/**
+ * @brief Print metadata as first line of NDJSON output
+ * @param meta Pointer to metadata structure
+ */
+static void
+_print_ndjson_header (const metarecord *meta)
+{
+    GString *s = g_string_new ("{\"type\":\"recyclebin\"");
+
+    g_string_append_printf (s, ",\"format\":\"%s\"",
+        (meta->type == RECYCLE_BIN_TYPE_FILE) ? "file" : "dir");
+
+    if (meta->version >= 0)  /* can be found and not error */
+        g_string_append_printf (s, ",\"version\":%" PRId64, meta->version);
+    else
+        s = g_string_append (s, ",\"version\":null");
+
+    if (meta->type == RECYCLE_BIN_TYPE_FILE && meta->total_entry > 0)
+        g_string_append_printf (s, ",\"ever_existed\":%" PRIu32,
+            meta->total_entry);
+
+    if (meta->index_hash)
+        g_string_append_printf (s, ",\"index_hash\":\"%s\"",
+            meta->index_hash);
+
+    g_string_append_printf (s, ",\"path\":\"%s\"}\n", ndjson_rbin);
+    g_print ("%s", s->str);
+    g_string_free (s, TRUE);
+}
+
+
+/**
+ * @brief Print record as a self-contained line of NDJSON output
+ * @note Path of recycle bin is repeated in every line, so that
+ * output can be split and ingested in parallel
+ */
+static void
+_print_ndjson_record   (rbin_struct        *record,
+                        const metarecord   *meta)
+{
+    GString      *s;
+
+    g_return_if_fail (record != NULL);
+
+    s = g_string_new (NULL);
+    g_string_printf (s, "{\"type\":\"record\",\"recyclebin\":\"%s\",",
+        ndjson_rbin);
+    _append_json_fields (s, record, meta, true);
+    s = g_string_append (s, "}\n");
+    g_print ("%s", s->str);
+    g_string_free (s, TRUE);
+}
+
+
+/* Append key and value of a map to MessagePack output */
+#define _MSGPACK_APPEND(s, n, key, func, value) \
+    do {                                       \
+        msgpack_append_str (s, key);           \
+        func (s, value);                       \
+        n++;                                   \
+    } while (0)
+
+/* Append a string to MessagePack output, or nil if `NULL` */
+static void
+_msgpack_append_str_or_nil   (GString      *s,
+                              const char   *str)
+{
+    if (str)
+        msgpack_append_str (s, str);
+    else
+        msgpack_append_nil (s);
+}
+
+
+/**
+ * @brief Print metadata as first map of MessagePack output
+ * @param meta Pointer to metadata structure
+ * @note Map is identified by `type` key, which records lack
+ */
+static void
+_print_msgpack_header (const metarecord *meta)
+{
+    GString  *body = g_string_new (NULL), *s;
+    uint32_t  n = 0;
+    char     *path = g_filename_display_name (meta->filename);
+
+    _MSGPACK_APPEND (body, n, "type", msgpack_append_str, "recyclebin");
+    _MSGPACK_APPEND (body, n, "format", msgpack_append_str,
+        (meta->type == RECYCLE_BIN_TYPE_FILE) ? "file" : "dir");
+    msgpack_append_str (body, "version");
+    if (meta->version >= 0)  /* can be found and not error */
+        msgpack_append_int (body, meta->version);
+    else
+        msgpack_append_nil (body);
+    n++;
+    if (meta->type == RECYCLE_BIN_TYPE_FILE && meta->total_entry > 0)
+        _MSGPACK_APPEND (body, n, "ever_existed", msgpack_append_uint,
+            meta->total_entry);
+    if (meta->index_hash)
+        _MSGPACK_APPEND (body, n, "index_hash", msgpack_append_str,
+            meta->index_hash);
+    _MSGPACK_APPEND (body, n, "path", msgpack_append_str, path);
+
+    s = g_string_sized_new (body->len + 5);
+    msgpack_append_map (s, n);
+    s = g_string_append_len (s, body->str, body->len);
+    io_write (s->str, s->len);
+
+    g_string_free (s, TRUE);
+    g_string_free (body, TRUE);
+    g_free (path);
+}
+
+
+/**
+ * @brief Print record as MessagePack map
+ * @note Fields are the same as JSON, except deletion time
+ * is kept as raw FILETIME integer under `filetime` key
+ */
+static void
+_print_msgpack_record   (rbin_struct        *record,
+                         const metarecord   *meta)
+{
+    GString      *s;
+    char         *str;
+
+    g_return_if_fail (record != NULL);
+
+    s = g_string_new (NULL);
+    msgpack_append_map (s, n_out_fields);
+
+    for (int i = 0; i < n_out_fields; i++)
+    {
+        switch (out_fields[i])
+        {
+            case OUT_FIELD_INDEX:
+                msgpack_append_str (s, "index");
+                if (meta->type == RECYCLE_BIN_TYPE_FILE)
+                    msgpack_append_uint (s, record->index_n);
+                else
+                    msgpack_append_str (s, record->index_s);
+                break;
+
+            case OUT_FIELD_TIME:
+                msgpack_append_str (s, "filetime");
+                msgpack_append_int (s, record->winfiletime);
+                break;
+
+            case OUT_FIELD_GONE:
+                msgpack_append_str (s, "gone");
+                if (record->gone == FILESTATUS_UNKNOWN)
+                    msgpack_append_nil (s);
+                else
+                    msgpack_append_bool (s, record->gone == FILESTATUS_GONE);
+                break;
+
+            case OUT_FIELD_SIZE:
+                msgpack_append_str (s, "size");
+                if (record->filesize == G_MAXUINT64)  // faulty
+                    msgpack_append_nil (s);
+                else
+                    msgpack_append_uint (s, record->filesize);
+                break;
+
+            case OUT_FIELD_PATH:
+                str = _format_path (record, FORMAT_MSGPACK, NULL);
+                msgpack_append_str (s, "path");
+                _msgpack_append_str_or_nil (s, str);
+                g_free (str);
+                break;
+
+            case OUT_FIELD_HASH:
+                msgpack_append_str (s, "hash");
+                _msgpack_append_str_or_nil (s, record->payload_hash);
+                break;
+
+            case OUT_FIELD_INDEX_HASH:
+                msgpack_append_str (s, "index_hash");
+                _msgpack_append_str_or_nil (s, record->index_hash);
+                break;
+
+            default: g_assert_not_reached ();
+        }
+    }
+
+    io_write (s->str, s->len);
+    g_string_free (s, TRUE);
+}
+
+
+/**
+ * @brief Start Arrow IPC stream with schema derived from output fields
+ * @param meta Pointer to metadata structure
+ * @note Recycle bin metadata is kept as custom metadata of schema
+ */
+static void
+_print_arrow_header (const metarecord *meta)
+{
+    static const char * const gone_dict[] = { "unknown", "false", "true" };
+    arrow_field  fields[OUT_FIELD_MAX] = { { 0 } };
+    GPtrArray   *kv = g_ptr_array_new_with_free_func (g_free);
+    GString     *s;
+
+    for (int i = 0; i < n_out_fields; i++)
+    {
+        arrow_field *f = &fields[i];
+
+        f->name = out_field_names[out_fields[i]];
+        switch (out_fields[i])
+        {
+            case OUT_FIELD_INDEX:
+                f->type = (meta->type == RECYCLE_BIN_TYPE_FILE) ?
+                    ARROW_COL_UINT32 : ARROW_COL_UTF8;
+                break;
+            case OUT_FIELD_TIME:
+                f->type = ARROW_COL_TIMESTAMP_US;
+                break;
+            case OUT_FIELD_GONE:
+                f->type = ARROW_COL_DICT_UTF8;
+                f->dict = gone_dict;
+                f->dict_len = G_N_ELEMENTS (gone_dict);
+                break;
+            case OUT_FIELD_SIZE:
+                f->type = ARROW_COL_UINT64;
+                break;
+            case OUT_FIELD_PATH:
+            case OUT_FIELD_HASH:
+            case OUT_FIELD_INDEX_HASH:
+                f->type = ARROW_COL_UTF8;
+                break;
+            default: g_assert_not_reached ();
+        }
+    }
+
+    g_ptr_array_add (kv, g_strdup ("format"));
+    g_ptr_array_add (kv, g_strdup (
+        (meta->type == RECYCLE_BIN_TYPE_FILE) ? "file" : "dir"));
+    if (meta->version >= 0)  /* can be found and not error */
+    {
+        g_ptr_array_add (kv, g_strdup ("version"));
+        g_ptr_array_add (kv, g_strdup_printf ("%" PRId64, meta->version));
+    }
+    if (meta->type == RECYCLE_BIN_TYPE_FILE && meta->total_entry > 0)
+    {
+        g_ptr_array_add (kv, g_strdup ("ever_existed"));
+        g_ptr_array_add (kv, g_strdup_printf ("%u", meta->total_entry));
+    }
+    if (meta->index_hash)
+    {
+        g_ptr_array_add (kv, g_strdup ("index_hash"));
+        g_ptr_array_add (kv, g_strdup (meta->index_hash));
+    }
+    g_ptr_array_add (kv, g_strdup ("path"));
+    g_ptr_array_add (kv, g_filename_display_name (meta->filename));
+    g_ptr_array_add (kv, NULL);
+
+    arrow_stream_free (arrow_out);
+    arrow_out = arrow_stream_new (fields, n_out_fields, (char **) kv->pdata);
+
+    s = arrow_schema_message (arrow_out);
+    io_write (s->str, s->len);
+    g_string_free (s, TRUE);
+    g_ptr_array_free (kv, TRUE);
+}
+
 
-    g_print ("\n");
+static void
+_flush_arrow_batch (void)
+{
+    GString *s = arrow_batch_message (arrow_out);
 
-    {
-        char *fields[] = {
-            /* TRANSLATOR COMMENT: appears in column header */
-            N_("Index"), N_("Deleted Time"), N_("Gone?"), N_("Size"), N_("Path"), NULL
-        };
-        char *headerline = g_strjoinv (delim, fields);
-        g_print ("%s\n", headerline);
-        g_free (headerline);
-    }
+    io_write (s->str, s->len);
+    g_string_free (s, TRUE);
 }
 
 
 /**
- * @brief Print preamble for XML output
- * @param meta Pointer to metadata structure
+ * @brief Add record to pending Arrow record batch
+ * @note Batch is written once it is full, so memory use is bounded
  */
 static void
-_print_xml_header (const metarecord *meta)
+_print_arrow_record   (rbin_struct        *record,
+                       const metarecord   *meta)
 {
-    GString *result;
+    const char *str;
+    char       *path;
 
-    result = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    g_return_if_fail (record != NULL);
 
-    g_string_append_printf (result,
-        "<recyclebin format=\"%s\"",
-        ( meta->type == RECYCLE_BIN_TYPE_FILE ) ? "file" : "dir");
+    for (int i = 0; i < n_out_fields; i++)
+    {
+        switch (out_fields[i])
+        {
+            case OUT_FIELD_INDEX:
+                if (meta->type == RECYCLE_BIN_TYPE_FILE)
+                    arrow_append_int (arrow_out, i, record->index_n);
+                else
+                    arrow_append_str (arrow_out, i, record->index_s);
+                break;
+
+            case OUT_FIELD_TIME:
+                arrow_append_int (arrow_out, i,
+                    (record->winfiletime - 116444736000000000LL) / 10);
+                break;
+
+            case OUT_FIELD_GONE:
+                arrow_append_int (arrow_out, i, record->gone);
+                break;
+
+            case OUT_FIELD_SIZE:
+                if (record->filesize == G_MAXUINT64)  // faulty
+                    arrow_append_null (arrow_out, i);
+                else
+                    arrow_append_int (arrow_out, i, (int64_t) record->filesize);
+                break;
+
+            case OUT_FIELD_PATH:
+                path = _format_path (record, FORMAT_ARROW, NULL);
+                if (path)
+                    arrow_append_str (arrow_out, i, path);
+                else
+                    arrow_append_null (arrow_out, i);
+                g_free (path);
+                break;
+
+            case OUT_FIELD_HASH:
+            case OUT_FIELD_INDEX_HASH:
+                str = (out_fields[i] == OUT_FIELD_HASH) ?
+                    record->payload_hash : record->index_hash;
+                if (str)
+                    arrow_append_str (arrow_out, i, str);
+                else
+                    arrow_append_null (arrow_out, i);
+                break;
+
+            default: g_assert_not_reached ();
+        }
+    }
 
-    if (meta->version >= 0)  /* can be found and not error */
-        g_string_append_printf (result,
-            " version=\"%" PRId64 "\"",
-            meta->version);
+    if (arrow_pending_rows (arrow_out) >= ARROW_BATCH_ROWS)
+        _flush_arrow_batch ();
+}
 
-    if (meta->type == RECYCLE_BIN_TYPE_FILE && meta->total_entry > 0)
-        g_string_append_printf (result,
-            " ever_existed=\"%" PRIu32 "\"",
-            meta->total_entry);
 
-    result = g_string_append (result, ">\n");
+static void
+_print_arrow_footer (void)
+{
+    GString *s = g_string_new (NULL);
 
-    {
-        char *rbin_path = g_filename_display_name (meta->filename);
-        g_string_append_printf (result,
-            "  <filename><![CDATA[%s]]></filename>\n",
-            rbin_path);
-        g_free (rbin_path);
-    }
+    if (arrow_pending_rows (arrow_out))
+        _flush_arrow_batch ();
 
-    g_print ("%s", result->str);
-    g_string_free (result, TRUE);
+    arrow_append_eos (s);
+    io_write (s->str, s->len);
+    g_string_free (s, TRUE);
+
+    arrow_stream_free (arrow_out);
+    arrow_out = NULL;
 }
 
 
+#ifdef ENABLE_SQLITE
+
 /**
- * @brief Print preamble for JSON output
+ * @brief Add recycle bin to database of SQLite output
  * @param meta Pointer to metadata structure
+ * @note First error is kept, and later rows are skipped
  */
 static void
-_print_json_header (const metarecord *meta)
+_print_sqlite_header (const metarecord *meta)
 {
-    g_print ("{\n  \"format\": \"%s\",\n",
-        (meta->type == RECYCLE_BIN_TYPE_FILE) ? "file" : "dir");
+    sqlite_out_add_bin (sqlite_db, meta, &sqlite_err);
+}
 
-    if (meta->version >= 0)  /* can be found and not error */
-        g_print ("  \"version\": %" PRId64 ",\n", meta->version);
-    else
-        g_print ("  \"version\": null,\n");
 
-    if (meta->type == RECYCLE_BIN_TYPE_FILE && meta->total_entry > 0)
-        g_print ("  \"ever_existed\": %" PRIu32 ",\n", meta->total_entry);
+static void
+_print_sqlite_record   (rbin_struct        *record,
+                        const metarecord   *meta)
+{
+    char *time, *path, *source;
 
-    {
-        char *s = g_filename_display_name (meta->filename);
-        char *rbin_path = json_escape (s);
-        g_print ("  \"path\": \"%s\",\n", rbin_path);
-        g_free (s);
-        g_free (rbin_path);
-    }
+    g_return_if_fail (record != NULL);
 
-    g_print ("  \"records\": [\n");
+    if (sqlite_err)
+        return;
+
+    time = _format_deltime (record, true);
+    path = _format_path (record, FORMAT_SQLITE, NULL);
+    sqlite_out_add_record (sqlite_db, record, meta, time, path, &sqlite_err);
+    g_free (time);
+    g_free (path);
+
+    if (sqlite_err || ! record->error)
+        return;
+
+    source = record->index_n ? g_strdup_printf ("%u", record->index_n) :
+                               g_strdup (record->index_s);
+    sqlite_out_add_error (sqlite_db, source, record->error, &sqlite_err);
+    g_free (source);
 }
 
 
+/* Errors of invalid records are added last */
 static void
-_print_text_record   (rbin_struct        *record,
-                      const metarecord   *meta)
+_print_sqlite_footer (void)
 {
-    char         *output, **header;
-    GString      *src;
-    GDateTime    *dt;
-    extern struct _fmt_data fmt[];
+    GHashTableIter  iter;
+    gpointer        key, val;
 
-    g_return_if_fail (record != NULL);
+    g_hash_table_iter_init (&iter, meta->invalid_records);
+    while (! sqlite_err && g_hash_table_iter_next (&iter, &key, &val))
+        sqlite_out_add_error (sqlite_db, key, val, &sqlite_err);
+}
 
-    header = (char **) g_malloc0_n (6, sizeof(gpointer));
+#endif
 
-    header[0] = (meta->type == RECYCLE_BIN_TYPE_FILE) ?
-        g_strdup_printf ("%" PRIu32, record->index_n) :
-        g_strdup (record->index_s);
 
-    dt = use_localtime ? g_date_time_to_local (record->deltime):
-                         g_date_time_ref      (record->deltime);
-    header[1] = g_date_time_format (dt, "%F %T");
+static void
+_print_xml_footer (void)
+{
+    GString *s = g_string_new (NULL);
+
+    for (guint i = 0; state_removals && i < state_removals->len; i++)
+    {
+        state_removal *r = g_ptr_array_index (state_removals, i);
+        char *index_s = g_markup_escape_text (r->index_s, -1);
+
+        g_string_append_printf (s, "  <removed index=\"%s\"", index_s);
+        if (r->path)
+            g_string_append_printf (s, ">\n"
+                "    <path><![CDATA[%s]]></path>\n"
+                "  </removed>\n", r->path);
+        else
+            s = g_string_append (s, "/>\n");
+        g_free (index_s);
+    }
+    s = g_string_append (s, "</recyclebin>\n");
 
-    header[2] = g_strdup(fmt[FORMAT_TEXT].gone_outtext[record->gone]);
+    g_print ("%s", s->str);
+    g_string_free (s, TRUE);
+}
 
-    header[3] = (record->filesize == G_MAXUINT64) ?  // faulty
-        g_strdup ("???") :
-        g_strdup_printf ("%" PRIu64, record->filesize);
 
-    src = legacy_encoding ? record->raw_legacy_path :
-                            record->raw_uni_path    ;
-    header[4] = conv_path_to_utf8_with_tmpl (src,
-        legacy_encoding, FORMAT_TEXT, NULL, &record->error);
-    if (! header[4])
-        header[4] = g_strdup ("???");
+/* Append index file removed since last scan as JSON object members */
+static void
+_append_json_removal   (GString               *s,
+                        const state_removal   *r,
+                        bool                   compact)
+{
+    char *str = json_escape (r->index_s);
 
-    output = g_strjoinv (delim, header);
-    g_print ("%s\n", output);
+    _append_json_key (s, "index", compact);
+    g_string_append_printf (s, "\"%s\"%s", str, compact ? "," : ", ");
+    g_free (str);
 
-    g_free (output);
-    g_date_time_unref (dt);
-    g_strfreev (header);
+    _append_json_key (s, "path", compact);
+    if (r->path)
+    {
+        str = json_escape (r->path);
+        g_string_append_printf (s, "\"%s\"", str);
+        g_free (str);
+    }
+    else
+        s = g_string_append (s, "null");
 }
 
 
 static void
-_print_xml_record   (rbin_struct        *record,
-                     const metarecord   *meta)
+_print_json_footer (void)
 {
-    extern struct _fmt_data fmt[];
-    char         *path, *dt_str;
-    GDateTime    *dt;
-    GString      *s, *src;
+    GString *s = g_string_new ("  ]");
 
-    g_return_if_fail (record != NULL);
+    if (state_removals && state_removals->len)
+    {
+        s = g_string_append (s, ",\n  \"removed\": [\n");
+        for (guint i = 0; i < state_removals->len; i++)
+        {
+            s = g_string_append (s, "    {");
+            _append_json_removal (s,
+                g_ptr_array_index (state_removals, i), false);
+            s = g_string_append (s, "},\n");
+        }
+        s = g_string_append (s, "  ]");
+    }
+    s = g_string_append (s, "\n}\n");
 
-    s = g_string_new ("  <record");
+    g_print ("%s", s->str);
+    g_string_free (s, TRUE);
+}
 
-    if (meta->type == RECYCLE_BIN_TYPE_FILE)
-        g_string_append_printf (s, " index=\"%" PRIu32 "\"", record->index_n);
-    else
-        g_string_append_printf (s, " index=\"%s\"", record->index_s);
 
-    if (use_localtime)
+/* Removals since last scan are printed after all records */
+static void
+_print_ndjson_footer (void)
+{
+    GString *s = g_string_new (NULL);
+
+    for (guint i = 0; state_removals && i < state_removals->len; i++)
     {
-        dt = g_date_time_to_local (record->deltime);
-        dt_str = g_date_time_format (dt, "%FT%T%z");
+        g_string_append_printf (s,
+            "{\"type\":\"removed\",\"recyclebin\":\"%s\",", ndjson_rbin);
+        _append_json_removal (s, g_ptr_array_index (state_removals, i), true);
+        s = g_string_append (s, "}\n");
     }
-    else
+
+    g_print ("%s", s->str);
+    g_string_free (s, TRUE);
+}
+
+
+/* Removals since last scan are maps with `type` key, like metadata */
+static void
+_print_msgpack_footer (void)
+{
+    GString *s = g_string_new (NULL);
+
+    for (guint i = 0; state_removals && i < state_removals->len; i++)
     {
-        dt = g_date_time_ref (record->deltime);
-        dt_str = g_date_time_format (dt, "%FT%TZ");
+        state_removal *r = g_ptr_array_index (state_removals, i);
+
+        msgpack_append_map (s, 3);
+        msgpack_append_str (s, "type");
+        msgpack_append_str (s, "removed");
+        msgpack_append_str (s, "index");
+        msgpack_append_str (s, r->index_s);
+        msgpack_append_str (s, "path");
+        _msgpack_append_str_or_nil (s, r->path);
     }
-    g_string_append_printf (s, " time=\"%s\"", dt_str);
 
-    g_string_append_printf (s, " gone=\"%s\"",
-        fmt[FORMAT_XML].gone_outtext[record->gone]);
+    io_write (s->str, s->len);
+    g_string_free (s, TRUE);
+}
 
-    if (record->filesize == G_MAXUINT64)  // faulty
-        g_string_append_printf (s, " size=\"-1\"");
-    else
-        g_string_append_printf (s,
-            " size=\"%" PRIu64 "\"", record->filesize);
 
-    // Still need to be converted despite using CDATA,
-    // otherwise could be writing garbage output
-    src = legacy_encoding ? record->raw_legacy_path :
-                            record->raw_uni_path    ;
-    path = conv_path_to_utf8_with_tmpl (src,
-        legacy_encoding, FORMAT_XML, NULL, &record->error);
+#ifdef __linux__
 
-    if (path)
-        g_string_append_printf (s, ">\n"
-            "    <path><![CDATA[%s]]></path>\n"
-            "  </record>\n", path);
-    else
-        s = g_string_append (s, ">\n    <path/>\n  </record>\n");
+static void
+_print_watch_record   (const char    *event,
+                       rbin_struct   *record)
+{
+    GString *s = g_string_new (NULL);
 
+    g_string_printf (s, "{\"event\": \"%s\", ", event);
+    _append_json_fields (s, record, meta, false);
+    s = g_string_append (s, "}\n");
     g_print ("%s", s->str);
     g_string_free (s, TRUE);
+}
 
-    g_date_time_unref (dt);
-    g_free (path);
-    g_free (dt_str);
+
+static void
+_print_watch_removal   (const char   *event,
+                        const char   *index_s)
+{
+    char *name = g_filename_display_name (index_s);
+    char *escaped = json_escape (name);
+
+    g_print ("{\"event\": \"%s\", \"index\": \"%s\"}\n", event, escaped);
+    g_free (escaped);
+    g_free (name);
 }
 
 
+/**
+ * @brief Print records for a batch of changes in watched folder
+ * @note Records are printed with `event` member denoting what
+ * happened: `present` for initial content, `trashed` for new index
+ * file, `gone` if only trashed file is removed, and `removed` when
+ * index file is removed, which means either restoration or purge.
+ */
 static void
-_print_json_record   (rbin_struct        *record,
-                      const metarecord   *meta)
+_watch_batch   (GHashTable   *changes,
+                gpointer      data)
 {
-    extern struct _fmt_data fmt[];
-    char         *path, *dt_str;
-    GDateTime    *dt;
-    GString      *src, *s;
+    GHashTableIter  iter;
+    gpointer        key, val;
+    const char     *event = "trashed";
 
-    g_return_if_fail (record != NULL);
+    GError         *err = NULL;
+    gint64          start = g_get_monotonic_time ();
 
-    s = g_string_new ("    {");
+    UNUSED (data);
 
-    if (meta->type == RECYCLE_BIN_TYPE_FILE)
-        g_string_append_printf (s, "\"index\": %" PRIu32, record->index_n);
-    else
-        g_string_append_printf (s, "\"index\": \"%s\"", record->index_s);
+    // Records of previous batch were printed already
+    g_ptr_array_set_size (meta->records, 0);
+    g_hash_table_remove_all (meta->invalid_records);
 
-    if (use_localtime)
+    if (changes == NULL)
     {
-        dt = g_date_time_to_local (record->deltime);
-        dt_str = g_date_time_format (dt, "%FT%T%z");
+        event = "present";
+        for (guint i = 0; i < meta->idxfiles->len; i++)
+            parse_vista_index (g_ptr_array_index (meta->idxfiles, i), meta);
+        g_ptr_array_set_size (meta->idxfiles, 0);
     }
     else
     {
-        dt = g_date_time_ref (record->deltime);
-        dt_str = g_date_time_format (dt, "%FT%TZ");
-    }
-    g_string_append_printf (s, ", \"time\": \"%s\"", dt_str);
+        g_hash_table_iter_init (&iter, changes);
+        while (g_hash_table_iter_next (&iter, &key, &val))
+        {
+            const char    *name = key;
+            watch_change   change = GPOINTER_TO_INT (val);
 
-    g_string_append_printf (s, ", \"gone\": %s",
-        fmt[FORMAT_JSON].gone_outtext[record->gone]);
+            if (name[0] != '$' || name[1] == '\0')
+                continue;
 
-    if (record->filesize == G_MAXUINT64)  // faulty
-        g_string_append_printf (s, ", \"size\": null");
-    else
-        g_string_append_printf (s,
-            ", \"size\": %" PRIu64, record->filesize);
+            if (name[1] == 'I' && change == WATCH_FILE_CHANGED)
+            {
+                char *path = g_build_filename (watch_dir, name, NULL);
+                parse_vista_index (path, meta);
+                g_free (path);
+            }
+            else if (name[1] == 'I')
+            {
+                if (g_hash_table_remove (watch_known, name))
+                    _print_watch_removal ("removed", name);
+            }
+            else if (name[1] == 'R' && change == WATCH_FILE_REMOVED)
+            {
+                char *idx = g_strdup (name);
+                idx[1] = 'I';
+                // If index is removed too, it is reported above
+                if (GPOINTER_TO_INT (g_hash_table_lookup (changes, idx))
+                    != WATCH_FILE_REMOVED &&
+                    g_hash_table_contains (watch_known, idx))
+                    _print_watch_removal ("gone", idx);
+                g_free (idx);
+            }
+        }
+    }
 
-    src = legacy_encoding ? record->raw_legacy_path :
-                            record->raw_uni_path    ;
-    path = conv_path_to_utf8_with_tmpl (src, legacy_encoding,
-        FORMAT_JSON, &json_escape, &record->error);
+    if (cli_opts.hash_payload)
+        hash_payloads (meta);
 
-    if (path)
-        g_string_append_printf (s, ", \"path\": \"%s\"},\n", path);
-    else
-        s = g_string_append (s, ", \"path\": null},\n");
+    for (guint i = 0; i < meta->records->len; i++)
+    {
+        rbin_struct *record = g_ptr_array_index (meta->records, i);
+        _print_watch_record (event, record);
+        R2_PROBE2 (record__emitted, record->winfiletime, record->filesize);
+        g_hash_table_add (watch_known, g_strdup (record->index_s));
+    }
 
-    g_print ("%s", s->str);
+    g_hash_table_iter_init (&iter, meta->invalid_records);
+    while (g_hash_table_iter_next (&iter, &key, &val))
+        g_printerr ("%s: %s\n", (char *) key, ((GError *) val)->message);
 
-    g_date_time_unref (dt);
-    g_free (path);
-    g_free (dt_str);
-    g_string_free (s, TRUE);
+    fflush (stdout);
+
+    // Metrics file is refreshed for each batch, as program never exits
+    if (metrics)
+    {
+        metrics_add_bin (metrics, meta, g_get_monotonic_time () - start);
+        if (! _write_metrics (false, EXIT_OK, &err))
+        {
+            g_printerr ("%s\n", err->message);
+            g_clear_error (&err);
+        }
+    }
 }
 
 
+/**
+ * @brief Print content of folder, then follow its changes
+ * @param error Location to store error upon failure
+ */
 static void
-_print_xml_footer (void)
+_watch (GError   **error)
 {
-    g_print ("%s", "</recyclebin>\n");
-}
+    watch_known = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, NULL);
 
+    watch_folder (watch_dir, &_watch_batch, NULL, error);
 
-static void
-_print_json_footer (void)
-{
-    g_print ("  ]\n}\n");
+    // Nothing left for final error summary
+    g_hash_table_remove_all (meta->invalid_records);
 }
 
+#endif
+
 
 /**
  * @brief Dump all results to screen or designated output file
@@ -1264,9 +3535,11 @@ dump_content (GError **error)
     void (*print_header_func)(const metarecord *);
     void (*print_record_func)(rbin_struct *, const metarecord *);
     void (*print_footer_func)();
+    // Whether footer reports index files removed since last scan
+    bool    footer_has_removals = false;
 
     // TODO use g_file_set_contents_full in glib 2.66
-    if (output_loc && ! get_tempfile (error))
+    if (output_loc && output_format != FORMAT_SQLITE && ! get_tempfile (error))
             return false;
 
     switch (output_format)
@@ -1281,29 +3554,140 @@ dump_content (GError **error)
             print_header_func = &_print_xml_header;
             print_record_func = &_print_xml_record;
             print_footer_func = &_print_xml_footer;
+            footer_has_removals = true;
             break;
         case FORMAT_JSON:
             print_header_func = &_print_json_header;
             print_record_func = &_print_json_record;
             print_footer_func = &_print_json_footer;
+            footer_has_removals = true;
+            break;
+        case FORMAT_MSGPACK:
+            print_header_func = &_print_msgpack_header;
+            print_record_func = &_print_msgpack_record;
+            print_footer_func = &_print_msgpack_footer;
+            footer_has_removals = true;
+            break;
+        case FORMAT_ARROW:
+            print_header_func = &_print_arrow_header;
+            print_record_func = &_print_arrow_record;
+            print_footer_func = &_print_arrow_footer;
+            break;
+        case FORMAT_BODYFILE:
+            print_header_func = NULL;
+            print_record_func = &_print_bodyfile_record;
+            print_footer_func = NULL;
+            break;
+#ifdef ENABLE_SQLITE
+        case FORMAT_SQLITE:
+            print_header_func = &_print_sqlite_header;
+            print_record_func = &_print_sqlite_record;
+            print_footer_func = &_print_sqlite_footer;
+            break;
+#endif
+        case FORMAT_NDJSON:
+            print_header_func = &_print_ndjson_header;
+            print_record_func = &_print_ndjson_record;
+            print_footer_func = &_print_ndjson_footer;
+            footer_has_removals = true;
+            {
+                char *name = g_filename_display_name (meta->filename);
+                g_free (ndjson_rbin);
+                ndjson_rbin = json_escape (name);
+                g_free (name);
+            }
             break;
 
         default: g_assert_not_reached();
     }
 
-    if (print_header_func != NULL)
-        (*print_header_func) (meta);
-    g_ptr_array_foreach (meta->records, (GFunc) print_record_func, meta);
-    if (print_footer_func != NULL)
-        (*print_footer_func) ();
+    // Separate headings of recycle bins in combined output
+    if (batch_dumped++ && ! output_loc && print_header_func == _print_text_header)
+        g_print ("\n");
+
+    {
+        run_stats   *stats = cli_opts.stats;
+        stats_time   mark, nested = { 0 };
+        mem_phase    prev_phase = mem_stats_set_phase (MEM_PHASE_FORMAT);
+
+        // Conversion and writing happen within, but are timed separately
+        if (stats)
+        {
+            nested.wall = stats->phase[STATS_PHASE_CONVERT].wall +
+                          stats->phase[STATS_PHASE_WRITE].wall;
+            nested.cpu  = stats->phase[STATS_PHASE_CONVERT].cpu +
+                          stats->phase[STATS_PHASE_WRITE].cpu;
+        }
+        stats_mark (stats, &mark);
+
+        if (print_header_func != NULL)
+            (*print_header_func) (meta);
+        for (guint i = 0; i < meta->records->len; i++)
+        {
+            rbin_struct *record = g_ptr_array_index (meta->records, i);
+            (*print_record_func) (record, meta);
+            R2_PROBE2 (record__emitted, record->winfiletime, record->filesize);
+        }
+        if (print_footer_func != NULL)
+            (*print_footer_func) ();
+        if (footer_has_removals)
+            g_clear_pointer (&state_removals, g_ptr_array_unref);
+
+        // Trace shows whole span, with nested phases inside
+        stats_add_since (stats, STATS_PHASE_FORMAT, &mark);
+        if (stats)
+        {
+            stats->phase[STATS_PHASE_FORMAT].wall -=
+                stats->phase[STATS_PHASE_CONVERT].wall +
+                stats->phase[STATS_PHASE_WRITE].wall - nested.wall;
+            stats->phase[STATS_PHASE_FORMAT].cpu -=
+                stats->phase[STATS_PHASE_CONVERT].cpu +
+                stats->phase[STATS_PHASE_WRITE].cpu - nested.cpu;
+        }
+        mem_stats_set_phase (prev_phase);
+    }
+
+#ifdef ENABLE_SQLITE
+    if (sqlite_err)
+    {
+        g_propagate_error (error, sqlite_err);
+        sqlite_err = NULL;
+        return false;
+    }
+#endif
 
-    if (output_loc)
+    if (output_loc && output_format != FORMAT_SQLITE)
         return clean_tempfile (output_loc, error);
     else
         return true;
 }
 
 
+/**
+ * @brief Print all records of current recycle bin with emitter of
+ * given output format, without header and footer
+ * @param format Either `FORMAT_TEXT`, `FORMAT_XML` or `FORMAT_JSON`
+ * @note For timing record emitters in isolation; output options are
+ * those set up by `rifiuti_init()`
+ */
+void
+dump_records   (out_fmt   format)
+{
+    void (*print_record_func)(rbin_struct *, const metarecord *);
+
+    switch (format)
+    {
+        case FORMAT_TEXT: print_record_func = &_print_text_record; break;
+        case FORMAT_XML:  print_record_func = &_print_xml_record;  break;
+        case FORMAT_JSON: print_record_func = &_print_json_record; break;
+        default: g_return_if_reached ();
+    }
+
+    for (guint i = 0; i < meta->records->len; i++)
+        (*print_record_func) (g_ptr_array_index (meta->records, i), meta);
+}
+
+
 static void
 _dump_rec_error   (rbin_struct  *record,
                    bool         *flag)
@@ -1353,7 +3737,15 @@ _get_exit_code   (const GError   *error)
         R2_FATAL_ERROR, R2_FATAL_ERROR_ILLEGAL_DATA))
         code = EXIT_ERR_ILLEGAL_DATA;
     else if (g_error_matches (error,
-        R2_FATAL_ERROR, R2_FATAL_ERROR_TEMPFILE))
+        R2_FATAL_ERROR, R2_FATAL_ERROR_TEMPFILE) ||
+        g_error_matches (error,
+        R2_FATAL_ERROR, R2_FATAL_ERROR_STATE_FILE) ||
+        g_error_matches (error,
+        R2_FATAL_ERROR, R2_FATAL_ERROR_TRACE_FILE) ||
+        g_error_matches (error,
+        R2_FATAL_ERROR, R2_FATAL_ERROR_METRICS_FILE) ||
+        g_error_matches (error,
+        R2_FATAL_ERROR, R2_FATAL_ERROR_SQLITE))
         code = EXIT_ERR_WRITE_FILE;
     else if (g_error_matches (error,
         R2_FATAL_ERROR, R2_FATAL_ERROR_LIVE_UNSUPPORTED))
@@ -1413,29 +3805,85 @@ _has_record_error   (void)
 exitcode
 rifiuti_cleanup   (GError   **error)
 {
-    exitcode code = EXIT_OK;
+    exitcode    code = EXIT_OK;
+    stats_time  mark;
 
     g_return_val_if_fail (error != NULL, EXIT_ERR_UNHANDLED);
 
+    stats_mark (cli_opts.stats, &mark);
     code = _get_exit_code ((const GError *) (*error));
     g_clear_error (error);
 
     if (_has_record_error () && code == EXIT_OK)
         code = EXIT_ERR_DUBIOUS_DATA;
 
+    if (code == EXIT_OK)
+        code = batch_code;
+
+    // Batch mode counts each recycle bin separately
+    if (metrics && batch_paths == NULL && watch_dir == NULL &&
+        serve_socket == NULL)
+        metrics_add_result (metrics, code);
+
     g_debug ("Final cleanup...");
 
-    g_ptr_array_unref (meta->records);
-    g_hash_table_destroy (meta->invalid_records);
-    g_free (meta->filename);
-    g_free (meta);
+    meta_free (meta);
+    record_filter_free (where_filter);
+    path_matcher_free (path_filter);
 
-    g_ptr_array_free (allidxfiles, TRUE);
     g_strfreev (fileargs);
+    if (batch_paths)
+        g_ptr_array_free (batch_paths, TRUE);
+    g_free (files0_from);
+    g_free (output_dir);
+    scan_state_free (rescan_state);
+    g_free (state_loc);
+    g_free (trace_loc);
+    g_free (watch_dir);
+    if (watch_known)
+        g_hash_table_destroy (watch_known);
+    g_free (serve_socket);
     g_free (output_loc);
+    g_free (where_expr);
+    g_free (ndjson_rbin);
+    arrow_stream_free (arrow_out);
+#ifdef ENABLE_SQLITE
+    if (sqlite_db)
+        sqlite_out_close (sqlite_db, false, NULL);
+#endif
+    g_strfreev (path_globs);
+    g_strfreev (path_substrs);
     g_free (legacy_encoding);
     g_free (delim);
 
+    if (stats_data.trace)
+    {
+        exitcode trace_code;
+
+        // Combined output may still be written after last bin
+        stats_trace_phases (cli_opts.stats, NULL);
+        stats_span (cli_opts.stats, "cleanup", "main", &mark, NULL);
+        trace_close (stats_data.trace, error);
+        stats_data.trace = NULL;
+        trace_code = _get_exit_code ((const GError *) (*error));
+        g_clear_error (error);
+        if (code == EXIT_OK)
+            code = trace_code;
+    }
+
+    if (metrics)
+    {
+        exitcode metrics_code;
+
+        _write_metrics (true, code, error);
+        metrics_code = _get_exit_code ((const GError *) (*error));
+        g_clear_error (error);
+        if (code == EXIT_OK)
+            code = metrics_code;
+        metrics_free (metrics);
+        g_free (metrics_loc);
+    }
+
     close_handles ();
 
 #ifdef G_OS_WIN32
@@ -1445,29 +3893,3 @@ rifiuti_cleanup   (GError   **error)
     return code;
 }
 
-
-void
-hexdump    (void     *start,
-            size_t    size)
-{
-    GString *s = g_string_new ("");
-    size_t i = 0;
-    while (true)
-    {
-        if (i % 16 == 0)
-        {
-            if (s->len > 0)
-            {
-                g_debug ("%s", s->str);
-                s = g_string_assign (s, "");
-            }
-            g_string_append_printf (s, "%04zX    ", i);
-        }
-        if (i >= size)
-            break;
-        g_string_append_printf (s, "%02" PRIX8 " ", *(uint8_t *) (start+i));
-        i++;
-    }
-
-    g_string_free (s, TRUE);
-}
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2024, Abel Cheung
+# rifiuti2 is released under Revised BSD License.
+# Please see LICENSE file for more info.
+#
+# Run both programs over synthetic corpora written by gen_corpus,
+# once per output format, and report throughput and peak memory.
+# Corpora are kept in work folder and reused as long as generator
+# arguments stay the same.
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+FORMATS = ['text', 'xml', 'json', 'ndjson', 'msgpack', 'arrow', 'bodyfile']
+
+
+def prepare_corpora(args):
+    stamp = os.path.join(args.workdir, 'params.txt')
+    params = 'records={} codepage={} min-path={} max-path={}\n'.format(
+        args.records, args.codepage, args.min_path, args.max_path)
+
+    try:
+        with open(stamp) as f:
+            if f.read() == params:
+                return sorted(os.path.join(args.workdir, d)
+                              for d in os.listdir(args.workdir)
+                              if d != 'params.txt')
+    except OSError:
+        pass
+
+    shutil.rmtree(args.workdir, ignore_errors=True)
+    print('Generating corpora with {} records each...'.format(args.records),
+          flush=True)
+    out = subprocess.run(
+        [args.generator, '-n', str(args.records), '-l', args.codepage,
+         '--min-path', str(args.min_path), '--max-path', str(args.max_path),
+         args.workdir],
+        check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    with open(stamp, 'w') as f:
+        f.write(params)
+    return sorted(out.split())
+
+
+def run_once(cmd):
+    '''Return wall time in seconds and peak RSS in KiB, or None'''
+    start = time.perf_counter()
+    proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+    # Unlike wait(), this gives resource usage of this child only
+    _, status, usage = os.wait4(proc.pid, 0)
+    elapsed = time.perf_counter() - start
+    proc.returncode = status
+
+    # Record errors in corpus (exit status 5) are not expected either
+    if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+        return None
+    rss = usage.ru_maxrss
+    if sys.platform == 'darwin':
+        rss //= 1024
+    return elapsed, rss
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Benchmark rifiuti2 with synthetic recycle bins')
+    parser.add_argument('--generator', required=True)
+    parser.add_argument('--rifiuti', required=True)
+    parser.add_argument('--rifiuti-vista', required=True)
+    parser.add_argument('--records', type=int, default=100000)
+    parser.add_argument('--codepage', default='CP1252')
+    parser.add_argument('--min-path', type=int, default=16)
+    parser.add_argument('--max-path', type=int, default=120)
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='runs per case, fastest one is reported')
+    parser.add_argument('workdir')
+    args = parser.parse_args()
+
+    corpora = prepare_corpora(args)
+    failed = False
+
+    print('{:<16} {:<6} {:>10} {:>14} {:>12}'.format(
+        'Corpus', 'Format', 'Time (s)', 'Records/s', 'Peak RSS (MiB)'))
+    for corpus in corpora:
+        name = os.path.basename(corpus)
+        if name.startswith('INFO2'):
+            base = [args.rifiuti, '-l', args.codepage]
+        else:
+            base = [args.rifiuti_vista]
+
+        for fmt in FORMATS:
+            results = [run_once(base + ['-f', fmt, corpus])
+                       for _ in range(args.repeat)]
+            if None in results:
+                print('{:<16} {:<6} {:>10}'.format(name, fmt, 'FAILED'))
+                failed = True
+                continue
+            best = min(r[0] for r in results)
+            rss = max(r[1] for r in results)
+            print('{:<16} {:<6} {:>10.3f} {:>14.0f} {:>12.1f}'.format(
+                name, fmt, best, args.records / best, rss / 1024),
+                flush=True)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -130,7 +130,7 @@ function(addMultiInputTest name)
     set_tests_properties(d_MultiInputTest${name} f_MultiInputTest${name}
         PROPERTIES
             LABELS "arg;xfail"
-            PASS_REGULAR_EXPRESSION "Must specify exactly one")
+            PASS_REGULAR_EXPRESSION "does not exist")
     add_bintype_label(d_MultiInputTest${name} f_MultiInputTest${name})
 endfunction()
 
@@ -144,7 +144,7 @@ function(addMissingInputTest name)
     set_tests_properties(d_MissingInputTest${name} f_MissingInputTest${name}
         PROPERTIES
             LABELS "arg;xfail"
-            PASS_REGULAR_EXPRESSION "Must specify exactly one")
+            PASS_REGULAR_EXPRESSION "Must specify at least one")
     add_bintype_label(d_MissingInputTest${name} f_MissingInputTest${name})
 endfunction()
 
@@ -204,3 +204,492 @@ set_tests_properties(d_LiveProbeOpt
         SKIP_REGULAR_EXPRESSION "No such file or directory;Unknown option --live"
         PASS_REGULAR_EXPRESSION "\\(current system\\)")
 
+
+#
+# Record filter, compared with golden output filtered by awk
+#
+
+function(FilterCompareTest testid input awkcond)
+    if(IS_DIRECTORY ${sample_dir}/${input})
+        set(is_info2 0)
+        set(prefix d_${testid})
+    else()
+        set(is_info2 1)
+        set(prefix f_${testid})
+    endif()
+
+    set(ref ${bindir}/${prefix}_ref.txt)
+
+    # First 6 lines are metadata and column header
+    add_test_using_shell(${prefix}_PrepAlt
+        "awk -F '\\t' 'NR <= 6 || (${awkcond})' ${sample_dir}/${input}.txt > ${ref}")
+
+    generate_simple_comparison_test(${testid} ${is_info2}
+        "${input}" "${ref}" "arg" ${ARGN})
+
+endfunction()
+
+if(NOT WIN32)
+    FilterCompareTest(FilterGone "dir-sample1"
+        "$3 == \"TRUE\""
+        --where "gone")
+    FilterCompareTest(FilterSize "dir-sample1"
+        "$4 != \"???\" && (($4 > 100 && $3 == \"FALSE\") || $4 >= 5025829)"
+        --where "size > 100 && !gone || size >= 5025829")
+    FilterCompareTest(FilterTime "INFO2-sample1"
+        "$2 >= \"2008-11-13 12:00\" && $1 != 49"
+        --where "time >= 2008-11-13T12:00 && index != 49")
+    FilterCompareTest(PathGlob "dir-sample1"
+        "$5 ~ /\\.(exe|zip)$/"
+        --path-glob "*.EXE" --path-glob "*.zip")
+    FilterCompareTest(PathSubstr "dir-win10-01"
+        "tolower($5) ~ /\\\\temp\\\\/ && $4 < 1000"
+        --path-substr "\\TEMP\\" --where "size < 1000")
+    FilterCompareTest(PathGlob "INFO2-sample1"
+        "$5 ~ /^C:\\\\Documents and Settings\\\\Administrator\\\\Desktop\\\\.*\\.txt$/"
+        --path-glob "c:\\documents and settings\\administrator\\desktop\\*.txt")
+
+    # Unterminated UTF-8 sequence must not be read past its end
+    add_test_using_shell(d_PathGlobBadUtf8
+        "LC_ALL=C.UTF-8 $<TARGET_FILE:rifiuti-vista> --path-glob \"$(printf 'a*\\360')\" dir-sample1"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(d_PathGlobBadUtf8
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "^Fatal error: Argument not valid in current locale")
+endif()
+
+#
+# Record limit, compared with golden output sorted and truncated
+# by shell pipeline
+#
+
+function(LimitCompareTest testid input pipeline)
+    if(IS_DIRECTORY ${sample_dir}/${input})
+        set(is_info2 0)
+        set(prefix d_${testid})
+    else()
+        set(is_info2 1)
+        set(prefix f_${testid})
+    endif()
+
+    set(ref ${bindir}/${prefix}_ref.txt)
+    set(golden ${sample_dir}/${input}.txt)
+
+    add_test_using_shell(${prefix}_PrepAlt
+        "{ awk 'NR <= 6' ${golden}; awk 'NR > 6' ${golden} | ${pipeline}; } > ${ref}")
+
+    generate_simple_comparison_test(${testid} ${is_info2}
+        "${input}" "${ref}" "arg" ${ARGN})
+
+endfunction()
+
+if(NOT WIN32)
+    LimitCompareTest(LimitNatural "INFO2-sample1"
+        "head -n 5"
+        --limit 5)
+    LimitCompareTest(LimitNatural "dir-sample1"
+        "head -n 4"
+        --limit 4)
+    LimitCompareTest(LimitRecent "dir-win10-01"
+        "sort -t '	' -k 2,2r -k 1,1 | head -n 3"
+        --sort time:desc --limit 3)
+    LimitCompareTest(LimitLargest "INFO2-sample1"
+        "sort -t '	' -k 4,4nr -k 1,1n | head -n 4"
+        --sort size:desc --limit 4)
+endif()
+
+#
+# Output field selection, compared with golden output whose
+# columns are rearranged by awk
+#
+
+function(FieldsCompareTest testid input columns)
+    if(IS_DIRECTORY ${sample_dir}/${input})
+        set(is_info2 0)
+        set(prefix d_${testid})
+    else()
+        set(is_info2 1)
+        set(prefix f_${testid})
+    endif()
+
+    set(ref ${bindir}/${prefix}_ref.txt)
+
+    # First 5 lines are metadata, column header is rearranged too
+    add_test_using_shell(${prefix}_PrepAlt
+        "awk -F '\t' -v OFS='\t' 'NR <= 5 {print; next} {print ${columns}}' ${sample_dir}/${input}.txt > ${ref}")
+
+    generate_simple_comparison_test(${testid} ${is_info2}
+        "${input}" "${ref}" "arg" ${ARGN})
+
+endfunction()
+
+if(NOT WIN32)
+    FieldsCompareTest(FieldsNoPath "dir-sample1"
+        "$4, $1"
+        --fields size,index)
+    FieldsCompareTest(FieldsReorder "INFO2-sample1"
+        "$5, $3, $2"
+        --fields "path, gone, time")
+    FieldsCompareTest(FieldsNoPathBadUni "dir-bad-uni"
+        "$1, $2"
+        --fields index,time)
+endif()
+
+add_test(NAME f_BadField
+    COMMAND rifiuti --fields index,name ${sample_dir}/INFO2-sample1)
+add_test(NAME f_DupField
+    COMMAND rifiuti --fields index,time,index ${sample_dir}/INFO2-sample1)
+add_test(NAME f_BodyfileFields
+    COMMAND rifiuti -f bodyfile --fields path ${sample_dir}/INFO2-sample1)
+set_tests_properties(f_BadField f_DupField f_BodyfileFields
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "Unknown output field;specified more than once;can't be chosen")
+
+# Bodyfile has fixed columns, with deletion time as ctime
+generate_simple_comparison_test("Bodyfile" 1
+    "INFO2-sample1" "INFO2-sample1.body" "arg" -f bodyfile)
+generate_simple_comparison_test("Bodyfile" 0
+    "dir-sample1" "dir-sample1.body" "arg" -f bodyfile)
+
+add_test(NAME f_BadSortField
+    COMMAND rifiuti --sort name ${sample_dir}/INFO2-sample1)
+set_tests_properties(f_BadSortField
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "Illegal sort order")
+
+add_test(NAME f_FilterBadSyntax
+    COMMAND rifiuti --where "size >" ${sample_dir}/INFO2-sample1)
+add_test(NAME d_FilterIndexUnavail
+    COMMAND rifiuti-vista --where "index > 1" ${sample_dir}/dir-sample1)
+set_tests_properties(f_FilterBadSyntax d_FilterIndexUnavail
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "Invalid filter expression")
+
+# Deep nesting is refused before parser recursion exhausts stack
+if(UNIX)
+    add_test_using_shell(d_FilterDeepNot
+        "$<TARGET_FILE:rifiuti-vista> --where \"$(printf '%100000s' | tr ' ' '!')gone\" ${sample_dir}/dir-sample1")
+    add_test_using_shell(d_FilterDeepParen
+        "$<TARGET_FILE:rifiuti-vista> --where \"$(printf '%100000s' | tr ' ' '(')gone\" ${sample_dir}/dir-sample1")
+    set_tests_properties(d_FilterDeepNot d_FilterDeepParen
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "expression too complex")
+endif()
+
+
+function(BatchCompareTest testid)
+    list(GET ARGN 0 first)
+    if(IS_DIRECTORY ${sample_dir}/${first})
+        set(is_info2 0)
+        set(prefix d_${testid})
+    else()
+        set(is_info2 1)
+        set(prefix f_${testid})
+    endif()
+
+    set(ref ${bindir}/${prefix}_ref.txt)
+
+    # Combined text output separates each recycle bin with blank line
+    list(TRANSFORM ARGN APPEND ".txt" OUTPUT_VARIABLE reflist)
+    list(JOIN reflist "; echo; cat " catcmd)
+    add_test_using_shell(${prefix}_PrepAlt
+        "{ cat ${catcmd}; } > ${ref}"
+        WORKING_DIRECTORY ${sample_dir})
+
+    generate_simple_comparison_test(${testid} ${is_info2}
+        "${ARGN}" "${ref}" "arg")
+
+endfunction()
+
+if(NOT WIN32)
+    BatchCompareTest(BatchCombined INFO2-sample1 INFO2-2k-cht-1)
+    BatchCompareTest(BatchCombined dir-sample1 dir-win10-01)
+
+    add_test_using_shell(d_BatchOutputDir
+        "rm -rf ${bindir}/d_BatchOutputDir.d && mkdir ${bindir}/d_BatchOutputDir.d && $<TARGET_FILE:rifiuti-vista> --output-dir ${bindir}/d_BatchOutputDir.d dir-sample1 dir-win10-01 && cmp ${bindir}/d_BatchOutputDir.d/000001-dir-sample1.txt dir-sample1.txt && cmp ${bindir}/d_BatchOutputDir.d/000002-dir-win10-01.txt dir-win10-01.txt && rm -rf ${bindir}/d_BatchOutputDir.d"
+        WORKING_DIRECTORY ${sample_dir})
+    add_test_using_shell(f_BatchFilesFrom
+        "printf 'INFO2-sample1\\0\\0INFO2-2k-cht-1' | $<TARGET_FILE:rifiuti> --files0-from - -n | cut -f1 | uniq | tr '\\n' ' '"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(f_BatchFilesFrom
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "^INFO2-sample1 INFO2-2k-cht-1 ")
+    set_tests_properties(d_BatchOutputDir
+        PROPERTIES
+            LABELS "arg")
+endif()
+
+if(NOT WIN32)
+    # Second scan reuses state, and removal of index file is reported
+    set(statedir ${bindir}/d_StateRescan.d)
+    add_test_using_shell(d_StateRescan
+        "rm -rf ${statedir} && mkdir ${statedir} && cp -R dir-win10-01 ${statedir} && cd ${statedir} && $<TARGET_FILE:rifiuti-vista> --state state dir-win10-01 > 1.txt && $<TARGET_FILE:rifiuti-vista> --state state dir-win10-01 > 2.txt && cmp 1.txt ${sample_dir}/dir-win10-01.txt && cmp 2.txt ${sample_dir}/dir-win10-01.txt && rm dir-win10-01/\\$IKEGS1G && $<TARGET_FILE:rifiuti-vista> --state state dir-win10-01 2>&1 > /dev/null && cd .. && rm -rf ${statedir}"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(d_StateRescan
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "Removed since last scan:\n\\$IKEGS1G: C:")
+
+    # Structured output carries removals, instead of stderr
+    set(statedir ${bindir}/d_StateRescanNdjson.d)
+    add_test_using_shell(d_StateRescanNdjson
+        "rm -rf ${statedir} && mkdir ${statedir} && cp -R dir-win10-01 ${statedir} && cd ${statedir} && $<TARGET_FILE:rifiuti-vista> --state state dir-win10-01 > /dev/null && rm dir-win10-01/\\$IKEGS1G && $<TARGET_FILE:rifiuti-vista> --state state -f ndjson dir-win10-01 2> err.txt | tail -n 1 && test ! -s err.txt && cd .. && rm -rf ${statedir}"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(d_StateRescanNdjson
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "^{\"type\":\"removed\",\"recyclebin\":\"dir-win10-01\",\"index\":\"\\$IKEGS1G\",\"path\":\"C:[^\n]*\"}\n$")
+endif()
+
+# Digest of $RQ7LAXT.png, and of empty $RKEGS1G
+add_test(NAME d_HashPayload
+    COMMAND rifiuti-vista --hash-payload=sha256 --hash-jobs=2
+        --fields=index,hash ${sample_dir}/dir-win10-01)
+set_tests_properties(d_HashPayload
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "KEGS1G\tsha256:e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855\n\\$IQ7LAXT.png\tsha256:f7150d67122558b949eb78b50bf611043494b34f0804324512d1c9fd86a1459f\n")
+
+add_test(NAME f_HashIndex
+    COMMAND rifiuti --hash-index=sha256 ${sample_dir}/INFO2-sample1)
+add_test(NAME d_HashIndex
+    COMMAND rifiuti-vista --hash-index=sha256 --fields=index,index_hash
+        ${sample_dir}/dir-win10-01)
+set_tests_properties(f_HashIndex d_HashIndex
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "digest: sha256:c159ceab4223d3711d755bd5b42dc3ee6569679c0e046f7bcdd1965bb03a48b4\n;DNLPD4.exe\tsha256:6c7ad80382083846e52e552f5cbc9024693d16c7751bf93cfb930997241d0ce9\n")
+
+add_test(NAME d_HashFieldNoAlgo
+    COMMAND rifiuti-vista --fields=index,hash ${sample_dir}/dir-win10-01)
+add_test(NAME d_HashBadAlgo
+    COMMAND rifiuti-vista --hash-payload=crc32 ${sample_dir}/dir-win10-01)
+set_tests_properties(d_HashFieldNoAlgo d_HashBadAlgo
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "requires '--hash-payload' option;Unsupported hash algorithm 'crc32'")
+
+add_test(NAME f_Stats
+    COMMAND rifiuti --stats -l CP932 ${sample_dir}/INFO2-sample2)
+add_test(NAME d_StatsJson
+    COMMAND rifiuti-vista --stats-json ${sample_dir}/dir-win10-01)
+set_tests_properties(f_Stats d_StatsJson
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "Records: 7 .*fallbacks: 1\n;\"bytes_read\": 1004, .*\"records\": 7, ")
+
+# Numbers stay valid JSON under locale with decimal comma; skipped
+# if no such locale is installed
+if(UNIX AND PYTHON3)
+    add_test_using_shell(d_StatsJsonLocale
+        "locale -a | grep -qix 'de_DE.utf-\\?8' || exit 77; LC_ALL=de_DE.UTF-8 $<TARGET_FILE:rifiuti-vista> --stats-json ${sample_dir}/dir-win10-01 2>&1 > /dev/null | ${PYTHON3} -c \"import json, sys; print(json.load(sys.stdin)['records'])\"")
+    set_tests_properties(d_StatsJsonLocale
+        PROPERTIES
+            LABELS "arg"
+            SKIP_RETURN_CODE 77
+            PASS_REGULAR_EXPRESSION "^7\n")
+endif()
+
+if(NOT WIN32)
+    add_test_using_shell(d_Trace
+        "$<TARGET_FILE:rifiuti-vista> --trace ${bindir}/d_Trace.json --hash-payload=sha256 ${sample_dir}/dir-win10-01 > /dev/null && cat ${bindir}/d_Trace.json && rm -f ${bindir}/d_Trace.json")
+    add_test(NAME f_TraceBadFile
+        COMMAND rifiuti --trace ${sample_dir}/no-such-dir/trace.json ${sample_dir}/INFO2-sample1)
+    set_tests_properties(d_Trace f_TraceBadFile
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "\"traceEvents\": \\[.*\"name\": \"hash\", \"cat\": \"worker\".*\"name\": \"parse\", \"cat\": \"phase\", \"ph\": \"X\".*\n\\]}\n$;Can not open trace file")
+
+    # Phases and counters are written once per recycle bin, not
+    # once per record
+    add_test_using_shell(d_TracePerBin
+        "$<TARGET_FILE:rifiuti-vista> --trace ${bindir}/d_TracePerBin.json dir-sample1 dir-win10-01 > /dev/null && echo $(grep -c '\"cat\": \"phase\"' ${bindir}/d_TracePerBin.json) $(grep -c '\"bytes_read\"' ${bindir}/d_TracePerBin.json) && rm -f ${bindir}/d_TracePerBin.json"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(d_TracePerBin
+        PROPERTIES
+            LABELS "arg;recycledir"
+            PASS_REGULAR_EXPRESSION "^12 2\n")
+endif()
+
+if(NOT WIN32)
+    add_test_using_shell(f_Metrics
+        "$<TARGET_FILE:rifiuti> --metrics-file ${bindir}/f_Metrics.prom ${sample_dir}/INFO2-sample1 ${sample_dir}/no-such-file > /dev/null; cat ${bindir}/f_Metrics.prom && rm -f ${bindir}/f_Metrics.prom")
+    set_tests_properties(f_Metrics
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "rifiuti_bin_results_total{program=\"rifiuti\",code=\"0\"} 1\n.*rifiuti_records_parsed_total{program=\"rifiuti\"} 16\n.*_count{program=\"rifiuti\"} 1\n.*rifiuti_exit_code{program=\"rifiuti\"} [1-9]")
+
+    # Decimal comma of locale must not leak into numbers and labels;
+    # skipped if no such locale is installed
+    add_test_using_shell(f_MetricsLocale
+        "locale -a | grep -qix 'de_DE.utf-\\?8' || exit 77; LC_ALL=de_DE.UTF-8 $<TARGET_FILE:rifiuti> --metrics-file ${bindir}/f_MetricsLocale.prom ${sample_dir}/INFO2-sample1 > /dev/null; cat ${bindir}/f_MetricsLocale.prom && rm -f ${bindir}/f_MetricsLocale.prom")
+    set_tests_properties(f_MetricsLocale
+        PROPERTIES
+            LABELS "arg"
+            SKIP_RETURN_CODE 77
+            PASS_REGULAR_EXPRESSION "le=\"0\\.001\"} [0-9]+\n"
+            FAIL_REGULAR_EXPRESSION "[0-9],[0-9]")
+endif()
+
+add_test(NAME f_Benchmark
+    COMMAND rifiuti --benchmark 3 ${sample_dir}/INFO2-sample1)
+add_test(NAME d_Benchmark
+    COMMAND rifiuti-vista --benchmark 3 ${sample_dir}/dir-win10-01)
+add_test(NAME f_BenchmarkBatch
+    COMMAND rifiuti --benchmark 3 ${sample_dir}/INFO2-sample1 ${sample_dir}/INFO2-sample2)
+set_tests_properties(f_Benchmark d_Benchmark f_BenchmarkBatch
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "^Runs: 3, records per run: 16, .*\nparse .*\ntotal  +[0-9.]+ ;^Runs: 3, records per run: 7, ;requires a single file or folder argument")
+
+if(ENABLE_MEM_STATS)
+    add_test(NAME f_MemStats
+        COMMAND rifiuti --mem-stats ${sample_dir}/INFO2-sample1)
+    set_tests_properties(f_MemStats
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "\nparse +[1-9][0-9]* .*Records: 16\nAllocations per record: ")
+endif()
+
+add_test(NAME f_BatchOutputConflict
+    COMMAND rifiuti --output-dir . -o file1 ${sample_dir}/INFO2-sample1)
+add_test(NAME f_BatchPartialFail
+    COMMAND rifiuti ${sample_dir}/INFO2-sample1 ${sample_dir}/no-such-file)
+set_tests_properties(f_BatchOutputConflict f_BatchPartialFail
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "can't be used together;no-such-file' does not exist")
+
+# Database is checked by counting rows of bins, records and errors
+if(ENABLE_SQLITE AND UNIX AND PYTHON3)
+    foreach(spec
+        "f_SqliteBatch|rifiuti|INFO2-sample1 INFO2-2k-cht-1|2 21 0"
+        "d_SqliteErrors|rifiuti-vista|dir-badfiles|1 3 3")
+        string(REPLACE "|" ";" spec "${spec}")
+        list(GET spec 0 id)
+        list(GET spec 1 prog)
+        list(GET spec 2 inputs)
+        list(GET spec 3 regex)
+        set(db ${bindir}/${id}.db)
+        add_test_using_shell(${id}
+            "rm -f ${db}; $<TARGET_FILE:${prog}> -f sqlite -o ${db} ${inputs}; ${PYTHON3} -c \"import sqlite3; c = sqlite3.connect('${db}'); print(*[c.execute('SELECT count(*) FROM ' + t).fetchone()[0] for t in ('bins', 'records', 'errors')])\" && rm -f ${db}"
+            WORKING_DIRECTORY ${sample_dir})
+        set_tests_properties(${id}
+            PROPERTIES
+                LABELS "arg"
+                PASS_REGULAR_EXPRESSION "(^|\n)${regex}\n")
+    endforeach()
+
+    add_test(NAME f_SqliteNoOutput
+        COMMAND rifiuti -f sqlite ${sample_dir}/INFO2-sample1)
+    set_tests_properties(f_SqliteNoOutput
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "requires '-o'")
+elseif(NOT ENABLE_SQLITE)
+    add_test(NAME f_SqliteUnsupported
+        COMMAND rifiuti -f sqlite ${sample_dir}/INFO2-sample1)
+    set_tests_properties(f_SqliteUnsupported
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "not supported in this build")
+endif()
+
+add_test(NAME f_BatchArrowCombined
+    COMMAND rifiuti -f arrow ${sample_dir}/INFO2-sample1 ${sample_dir}/INFO2-empty)
+add_test(NAME f_BatchXmlCombined
+    COMMAND rifiuti -f xml ${sample_dir}/INFO2-sample1 ${sample_dir}/INFO2-empty)
+add_test(NAME d_BatchJsonCombined
+    COMMAND rifiuti-vista -f json ${sample_dir}/dir-sample1 ${sample_dir}/dir-win10-01)
+set_tests_properties(f_BatchArrowCombined f_BatchXmlCombined d_BatchJsonCombined
+    PROPERTIES
+        LABELS "arg"
+        PASS_REGULAR_EXPRESSION "requires '--output-dir'")
+
+# Every document is well-formed, whether all recycle bins are
+# combined in one output, or each has its own file
+if(UNIX AND PYTHON3)
+    set(outdir ${bindir}/d_BatchWellFormed.d)
+    add_test_using_shell(d_BatchWellFormed
+        "rm -rf ${outdir} && mkdir ${outdir} && $<TARGET_FILE:rifiuti-vista> -f ndjson -o ${outdir}/all.ndjson dir-sample1 dir-win10-01 && $<TARGET_FILE:rifiuti-vista> -f xml --output-dir ${outdir} dir-sample1 dir-win10-01 && ${PYTHON3} -c \"import glob, json, sys, xml.dom.minidom as m; d = sys.argv[1]; print(len([json.loads(l) for l in open(d + '/all.ndjson')]), len([m.parse(f) for f in glob.glob(d + '/*.xml')]))\" ${outdir} && rm -rf ${outdir}"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(d_BatchWellFormed
+        PROPERTIES
+            LABELS "arg;recycledir"
+            PASS_REGULAR_EXPRESSION "^[1-9][0-9]* 2\n")
+endif()
+
+if(UNIX)
+    add_test(NAME f_ServeWithOption
+        COMMAND rifiuti --serve ${bindir}/f_ServeWithOption.sock -n)
+    add_test(NAME d_ServeWithFile
+        COMMAND rifiuti-vista --serve ${bindir}/d_ServeWithFile.sock
+            ${sample_dir}/dir-sample1)
+    # Option count doesn't tell, when value is attached to option
+    add_test(NAME d_ServeWithAttachedOption
+        COMMAND rifiuti-vista --output=${bindir}/d_ServeWithAttachedOption.out
+            --serve=${bindir}/d_ServeWithAttachedOption.sock)
+    add_test(NAME f_ServeWithFlag
+        COMMAND rifiuti -z --serve=${bindir}/f_ServeWithFlag.sock)
+    set_tests_properties(f_ServeWithOption d_ServeWithFile
+        d_ServeWithAttachedOption f_ServeWithFlag
+        PROPERTIES
+            LABELS "arg"
+            TIMEOUT 10
+            PASS_REGULAR_EXPRESSION "must not be used with other options;must not be used together with file")
+endif()
+
+# Server is started and stopped within same test, serving
+# multiple requests over one connection
+if(UNIX AND PYTHON3)
+    set(sock ${bindir}/d_ServeRequests.sock)
+    set(out ${bindir}/d_ServeRequests.output)
+    add_test_using_shell(d_ServeRequests
+        "rm -f ${sock}; $<TARGET_FILE:rifiuti-vista> --serve ${sock} & pid=$!; ${PYTHON3} ${CMAKE_CURRENT_SOURCE_DIR}/serve-client.py ${sock} -f xml dir-sample1 --next dir-win10-01 > ${out}; rc=$?; kill $pid; wait $pid; cat dir-sample1.xml dir-win10-01.txt | cmp - ${out} && test $rc -eq 0 && test ! -e ${sock} && rm -f ${out}"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(d_ServeRequests
+        PROPERTIES
+            LABELS "arg;recycledir")
+
+    # Options writing files or changing mode are refused before
+    # parsing, so not even empty files are left behind
+    set(sock ${bindir}/d_ServeClientOptions.sock)
+    set(err ${bindir}/d_ServeClientOptions.err)
+    set(f ${bindir}/d_ServeClientOptions)
+    add_test_using_shell(d_ServeClientOptions
+        "rm -f ${sock} ${f}.*; $<TARGET_FILE:rifiuti-vista> --serve ${sock} & pid=$!; ${PYTHON3} ${CMAKE_CURRENT_SOURCE_DIR}/serve-client.py ${sock} -o ${f}.1 dir-sample1 --next --trace=${f}.2 dir-sample1 --next -no ${f}.3 dir-sample1 --next --state ${f}.4 dir-sample1 --next --serve ${f}.5 --next -zf xml --limit 1 dir-sample1 > /dev/null 2> ${err}; rc=$?; kill $pid; wait $pid; test $rc -eq 0 && test $(grep -c 'by client in server mode' ${err}) -eq 5 && test ! -e ${f}.1 -a ! -e ${f}.2 -a ! -e ${f}.3 -a ! -e ${f}.4 -a ! -e ${f}.5 && rm -f ${err}"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(d_ServeClientOptions
+        PROPERTIES
+            LABELS "arg;recycledir")
+endif()
+
+# Socket is private to owner even with permissive umask
+if(CMAKE_SYSTEM_NAME STREQUAL "Linux")
+    set(sock ${bindir}/f_ServeSocketMode.sock)
+    add_test_using_shell(f_ServeSocketMode
+        "rm -f ${sock}; umask 0; $<TARGET_FILE:rifiuti> --serve ${sock} & pid=$!; for i in $(seq 50); do test -S ${sock} && break; sleep 0.1; done; stat -c %a ${sock}; kill $pid; wait $pid")
+    set_tests_properties(f_ServeSocketMode
+        PROPERTIES
+            LABELS "arg"
+            PASS_REGULAR_EXPRESSION "^600\n")
+endif()
+
+if(CMAKE_SYSTEM_NAME STREQUAL "Linux")
+    # Trash a file, remove its $R file, then restore another one.
+    # Each change waits until previous event shows up in output.
+    set(watchdir ${bindir}/d_WatchEvents.d)
+    add_test_using_shell(d_WatchEvents
+        "waitfor() { for i in $(seq 100); do test $(grep -c \\\"$1\\\" out) -ge $2 && return 0; sleep 0.1; done; return 1; }; rm -rf ${watchdir} && mkdir -p ${watchdir}/spare && cp -R dir-win10-01 ${watchdir}/bin && cd ${watchdir} && mv bin/\\$IKEGS1G bin/\\$RKEGS1G spare && { $<TARGET_FILE:rifiuti-vista> --watch bin > out & pid=$!; } && waitfor present 6 && cp spare/\\$RKEGS1G bin && cp spare/\\$IKEGS1G bin && waitfor trashed 1 && rm bin/\\$RKEGS1G && waitfor gone 1 && rm bin/\\$I7R52EG.txt bin/\\$R7R52EG.txt && waitfor removed 1 && kill $pid && wait $pid && grep -c present out && grep -v present out | cut -d, -f1-2 | tr -d '\"{}' | tr '\\n' ' ' && cd .. && rm -rf ${watchdir}"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(d_WatchEvents
+        PROPERTIES
+            LABELS "arg;recycledir"
+            PASS_REGULAR_EXPRESSION "^6\n.*trashed, index: .IKEGS1G event: gone, index: .IKEGS1G event: removed, index: .I7R52EG.txt")
+endif()
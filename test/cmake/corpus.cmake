@@ -0,0 +1,33 @@
+# Copyright (C) 2024, Abel Cheung
+# rifiuti2 is released under Revised BSD License.
+# Please see LICENSE file for more info.
+
+#
+# Small synthetic corpora must parse without any error, in every
+# variant written by generator
+#
+
+if(NOT WIN32)
+    set(corpusdir ${bindir}/corpus.d)
+    add_test_using_shell(f_Corpus_Prep
+        "rm -rf ${corpusdir} && $<TARGET_FILE:gen_corpus> -n 50 -l CP932 --max-path 300 ${corpusdir} && mkdir ${corpusdir}/out-info2 ${corpusdir}/out-dir")
+    add_test(NAME f_Corpus
+        COMMAND rifiuti -l CP932 --output-dir ${corpusdir}/out-info2
+            ${corpusdir}/INFO2-95 ${corpusdir}/INFO2-98
+            ${corpusdir}/INFO2-98-junk ${corpusdir}/INFO2-me
+            ${corpusdir}/INFO2-me-junk ${corpusdir}/INFO2-nt4
+            ${corpusdir}/INFO2-2k ${corpusdir}/INFO2-2k-junk)
+    add_test(NAME d_Corpus
+        COMMAND rifiuti-vista --output-dir ${corpusdir}/out-dir
+            ${corpusdir}/dir-v1 ${corpusdir}/dir-v1-payload
+            ${corpusdir}/dir-v2 ${corpusdir}/dir-v2-payload)
+    add_test(NAME f_Corpus_Clean
+        COMMAND ${CMAKE_COMMAND} -E rm -rf ${corpusdir})
+    set_tests_properties(f_Corpus_Prep PROPERTIES FIXTURES_SETUP CORPUS)
+    set_tests_properties(f_Corpus_Clean PROPERTIES FIXTURES_CLEANUP CORPUS)
+    set_tests_properties(f_Corpus d_Corpus
+        PROPERTIES
+            FIXTURES_REQUIRED CORPUS
+            LABELS "corpus")
+    add_bintype_label(f_Corpus d_Corpus)
+endif()
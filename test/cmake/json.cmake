@@ -39,3 +39,22 @@ endforeach()
 endfunction()
 
 createJsonOutputTests()
+
+
+# NDJSON carries the same records, one object per line
+generate_simple_comparison_test("NdjsonInfo2WinXP" 1
+    "INFO2-sample1" "INFO2-sample1.ndjson" "parse|json" -f ndjson)
+generate_simple_comparison_test("NdjsonRdirVista" 0
+    "dir-sample1" "dir-sample1.ndjson" "parse|json" -f ndjson)
+
+# MessagePack has the same fields, with raw FILETIME as time
+generate_simple_comparison_test("MsgpackInfo2WinXP" 1
+    "INFO2-sample1" "INFO2-sample1.msgpack" "parse|json" -f msgpack)
+generate_simple_comparison_test("MsgpackRdirVista" 0
+    "dir-sample1" "dir-sample1.msgpack" "parse|json" -f msgpack)
+
+# Arrow IPC stream keeps the same fields as typed columns
+generate_simple_comparison_test("ArrowInfo2WinXP" 1
+    "INFO2-sample1" "INFO2-sample1.arrow" "parse|json" -f arrow)
+generate_simple_comparison_test("ArrowRdirVista" 0
+    "dir-sample1" "dir-sample1.arrow" "parse|json" -f arrow)
@@ -0,0 +1,35 @@
+# Copyright (C) 2024, Abel Cheung
+# rifiuti2 is released under Revised BSD License.
+# Please see LICENSE file for more info.
+
+#
+# Parse multiple recycle bins concurrently with the library,
+# each on its own context, and compare against serial results
+#
+
+add_test(NAME f_LibConcurrent
+    COMMAND test_librifiuti info2
+        ${sample_dir}/INFO2-sample1
+        ${sample_dir}/INFO2-2k-cht-1
+        ${sample_dir}/INFO-NT-en-1
+        ${sample_dir}/INFO2-empty)
+
+add_test(NAME d_LibConcurrent
+    COMMAND test_librifiuti dir
+        ${sample_dir}/dir-sample1
+        ${sample_dir}/dir-win10-01
+        ${sample_dir}/dir-2019-uncpath
+        ${sample_dir}/dir-empty)
+
+set_tests_properties(f_LibConcurrent d_LibConcurrent
+    PROPERTIES LABELS "library")
+
+# Only make sure every kernel runs and is found in committed
+# baseline, timing is not checked
+add_test(NAME f_MicroBench
+    COMMAND microbench --samples 1 --min-time 0 --warmup 0
+        --compare ${CMAKE_CURRENT_SOURCE_DIR}/microbench-baseline.tsv)
+set_tests_properties(f_MicroBench
+    PROPERTIES
+        LABELS "library"
+        PASS_REGULAR_EXPRESSION "\nwin_filetime [^\n]+% +[+-][0-9.]+%\nprint_text_record [^\n]+% +[+-][0-9.]+%\nprint_xml_record [^\n]+% +[+-][0-9.]+%\nprint_json_record [^\n]+% +[+-][0-9.]+%\n")
@@ -38,3 +38,12 @@ createINFO2ParseTests()
 # In encoding.cmake now
 # (Info2Win95   INFO-95-ja-1 -l ${cp932})
 # (Info2UNCA2   INFO2-2k-tw-uncpath -l ${cp950})
+
+#
+# Interning path prefixes must not alter output
+#
+
+generate_simple_comparison_test(Info2InternPathU 1
+    "INFO2-sample1" "INFO2-sample1.txt" "parse" --intern-paths)
+generate_simple_comparison_test(Info2InternPathA 1
+    "INFO2-sample2" "INFO2-sample2.txt" "parse" --intern-paths -l CP1252)
@@ -40,3 +40,10 @@ add_test(NAME d_DirIsolatedIdx_CleanAlt
 
 generate_simple_comparison_test(DirIsolatedIdx 0
     "" "dir-isolated-idx.txt" "parse")
+
+#
+# Interning path prefixes must not alter output
+#
+
+generate_simple_comparison_test(DirInternPath 0
+    "dir-win10-01" "dir-win10-01.txt" "parse" --intern-paths)
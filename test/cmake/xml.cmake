@@ -102,6 +102,32 @@ createXmlTestSet(1 INFO2-sample1)
 createXmlTestSet(2 dir-sample1)
 createXmlTestSet(3 INFO-95-ja-1 -l CP932)
 
+# Records lacking fields not chosen for output are still valid
+if(NOT "${XMLLINT}" STREQUAL "XMLLINT-NOTFOUND")
+    add_test_using_shell(f_XmlFieldsDTDValidate
+        "$<TARGET_FILE:rifiuti> -f xml --fields index INFO2-sample1 | ${XMLLINT} --noout --dtdvalid ${CMAKE_CURRENT_SOURCE_DIR}/rifiuti.dtd -"
+        WORKING_DIRECTORY ${sample_dir})
+    add_test_using_shell(d_XmlFieldsDTDValidate
+        "$<TARGET_FILE:rifiuti-vista> -f xml --fields time,size dir-sample1 | ${XMLLINT} --noout --dtdvalid ${CMAKE_CURRENT_SOURCE_DIR}/rifiuti.dtd -"
+        WORKING_DIRECTORY ${sample_dir})
+    set_tests_properties(f_XmlFieldsDTDValidate d_XmlFieldsDTDValidate
+        PROPERTIES LABELS "xml")
+    add_bintype_label(f_XmlFieldsDTDValidate d_XmlFieldsDTDValidate)
+
+    # Index files removed since last scan are listed after records
+    if(NOT WIN32)
+        set(statedir ${bindir}/d_XmlRemovedDTDValidate.d)
+        add_test_using_shell(d_XmlRemovedDTDValidate
+            "rm -rf ${statedir} && mkdir ${statedir} && cp -R dir-win10-01 ${statedir} && cd ${statedir} && $<TARGET_FILE:rifiuti-vista> --state state dir-win10-01 > /dev/null && rm dir-win10-01/\\$IKEGS1G && $<TARGET_FILE:rifiuti-vista> --state state -f xml dir-win10-01 > out.xml && ${XMLLINT} --noout --dtdvalid ${CMAKE_CURRENT_SOURCE_DIR}/rifiuti.dtd out.xml && grep -c '<removed index=\"\\$IKEGS1G\">' out.xml && cd .. && rm -rf ${statedir}"
+            WORKING_DIRECTORY ${sample_dir})
+        set_tests_properties(d_XmlRemovedDTDValidate
+            PROPERTIES
+                LABELS "xml"
+                PASS_REGULAR_EXPRESSION "^1\n$")
+        add_bintype_label(d_XmlRemovedDTDValidate)
+    endif()
+endif()
+
 
 # Make sure no version is printed if $Recycle.bin
 # is empty because no index can be found; but empty
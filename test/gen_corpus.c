@@ -0,0 +1,497 @@
+/*
+ * Copyright (C) 2024, Abel Cheung
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+/*
+ * Generate synthetic recycle bins of arbitrary size, for observing
+ * how processing scales. Following corpora are written to output
+ * folder, all containing the same sequence of records:
+ *
+ * - INFO2 of every version and record size combination, and junk
+ *   filled variants of those affected on real systems
+ * - $Recycle.bin folders of both index file versions, either with
+ *   index files only, or with $R trashed files of existing records
+ *
+ * Records are derived from random seed, so all corpora of the same
+ * run get identical records, and only deletion time changes with
+ * time of run.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+/* Shared by both formats */
+#define WIN_PATH_MAX             260
+#define FILETIME_UNIX_EPOCH      116444736000000000LL
+
+/* INFO2 layout, see src/rifiuti.h */
+#define INFO2_HEADER_SIZE        20
+#define INFO2_FILESIZE_SUM_OFS   16
+#define LEGACY_RECORD_SIZE       ((WIN_PATH_MAX) + 20)
+#define UNICODE_RECORD_SIZE      ((WIN_PATH_MAX) * 3 + 20)
+
+/* $Recycle.bin layout, see src/rifiuti-vista.h */
+#define VERSION1_FILENAME_OFFSET 0x18
+#define VERSION2_FILENAME_OFFSET 0x1C
+
+/* Ratio of records whose trashed file is gone, in percent */
+#define GONE_PERCENT             20
+
+/* Oldest deletion time relative to now */
+#define MAX_AGE_SECONDS          (300 * 24 * 3600)
+
+typedef struct
+{
+    const char  *name;
+    uint32_t     version;
+    uint32_t     recordsize;
+    bool         junk;
+} info2_variant;
+
+static const info2_variant info2_variants[] = {
+    { "INFO2-95",      0, LEGACY_RECORD_SIZE,  false },
+    { "INFO2-98",      4, LEGACY_RECORD_SIZE,  false },
+    { "INFO2-98-junk", 4, LEGACY_RECORD_SIZE,  true  },
+    { "INFO2-me",      5, LEGACY_RECORD_SIZE,  false },
+    { "INFO2-me-junk", 5, LEGACY_RECORD_SIZE,  true  },
+    { "INFO2-nt4",     2, UNICODE_RECORD_SIZE, false },
+    { "INFO2-2k",      5, UNICODE_RECORD_SIZE, false },
+    { "INFO2-2k-junk", 5, UNICODE_RECORD_SIZE, true  },
+};
+
+typedef struct
+{
+    const char  *name;
+    uint64_t     version;
+    bool         payload;
+} dir_variant;
+
+static const dir_variant dir_variants[] = {
+    { "dir-v1",         1, false },
+    { "dir-v1-payload", 1, true  },
+    { "dir-v2",         2, false },
+    { "dir-v2-payload", 2, true  },
+};
+
+/*
+ * Characters used in paths besides ASCII, those not representable
+ * in legacy code page are dropped
+ */
+static const char *extra_chars[] = {
+    "é", "ü", "ñ", "ß", "ø", "Å", "ç",
+    "Ω", "λ", "Ж", "я",
+    "日", "本", "語", "テ", "ス", "ト",
+    "中", "文", "資", "料", "한", "글",
+};
+
+typedef struct
+{
+    GRand       *rand;
+    GRand       *junk;  // separate, so records stay the same
+    GPtrArray   *alphabet;
+    GIConv       to_utf16;
+    GIConv       to_legacy;
+    int          min_path;
+    int          max_path;
+    int64_t      now;
+    /* Current record */
+    GString     *path;
+    char        *legacy;
+    gsize        legacy_len;
+    char        *unicode;
+    gsize        unicode_len;
+    int64_t      filetime;
+    uint32_t     filesize;
+    bool         gone;
+} generator;
+
+static int       n_records  = 1000;
+static int       min_path   = 16;
+static int       max_path   = 120;
+static int       seed       = 1;
+static char     *legacy_cp  = NULL;
+static char     *only_type  = NULL;
+
+static const GOptionEntry entries[] = {
+    { "records", 'n', 0, G_OPTION_ARG_INT, &n_records,
+      "Number of records in each recycle bin (default 1000)", "N" },
+    { "min-path", 0, 0, G_OPTION_ARG_INT, &min_path,
+      "Minimum length of paths in characters (default 16)", "N" },
+    { "max-path", 0, 0, G_OPTION_ARG_INT, &max_path,
+      "Maximum length of paths in characters (default 120), "
+      "capped to 259 except for version 2 $Recycle.bin", "N" },
+    { "legacy-filename", 'l', 0, G_OPTION_ARG_STRING, &legacy_cp,
+      "Code page of legacy paths (default CP1252)", "CODEPAGE" },
+    { "seed", 0, 0, G_OPTION_ARG_INT, &seed,
+      "Random seed (default 1)", "N" },
+    { "type", 0, 0, G_OPTION_ARG_STRING, &only_type,
+      "Only generate 'info2' or 'dir' corpora", "TYPE" },
+    { NULL }
+};
+
+
+static void
+die (const char *fmt, ...) G_GNUC_PRINTF (1, 2);
+
+static void
+die (const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start (ap, fmt);
+    fputs ("gen_corpus: ", stderr);
+    vfprintf (stderr, fmt, ap);
+    fputc ('\n', stderr);
+    va_end (ap);
+    exit (1);
+}
+
+
+static void
+put_le32 (guchar   *buf,
+          uint32_t  val)
+{
+    val = GUINT32_TO_LE (val);
+    memcpy (buf, &val, sizeof (val));
+}
+
+
+static void
+put_le64 (guchar   *buf,
+          uint64_t  val)
+{
+    val = GUINT64_TO_LE (val);
+    memcpy (buf, &val, sizeof (val));
+}
+
+
+static void
+generator_init (generator   *gen,
+                const char  *cp)
+{
+    GError *error = NULL;
+
+    gen->to_utf16 = g_iconv_open ("UTF-16LE", "UTF-8");
+    gen->to_legacy = g_iconv_open (cp, "UTF-8");
+    if (gen->to_legacy == (GIConv) -1)
+        die ("Code page '%s' is not supported", cp);
+
+    gen->alphabet = g_ptr_array_new_with_free_func (g_free);
+    for (const char *c = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+        "abcdefghijklmnopqrstuvwxyz0123456789 _-"; *c; c++)
+        g_ptr_array_add (gen->alphabet, g_strndup (c, 1));
+
+    for (gsize i = 0; i < G_N_ELEMENTS (extra_chars); i++)
+    {
+        char *s = g_convert_with_iconv (extra_chars[i], -1,
+            gen->to_legacy, NULL, NULL, &error);
+        if (s)
+            g_ptr_array_add (gen->alphabet, g_strdup (extra_chars[i]));
+        else
+            g_clear_error (&error);
+        g_free (s);
+    }
+
+    gen->path = g_string_new (NULL);
+    gen->now = g_get_real_time ();
+}
+
+
+/* Restart record sequence, so each corpus gets the same records */
+static void
+generator_reset (generator  *gen,
+                 int         path_limit)
+{
+    if (gen->rand)
+    {
+        g_rand_free (gen->rand);
+        g_rand_free (gen->junk);
+    }
+    gen->rand = g_rand_new_with_seed ((guint32) seed);
+    gen->junk = g_rand_new_with_seed ((guint32) seed + 1);
+    gen->min_path = MIN (min_path, path_limit);
+    gen->max_path = MIN (max_path, path_limit);
+}
+
+
+static void
+generator_next (generator  *gen)
+{
+    GRand  *r = gen->rand;
+    int     len;
+
+    len = g_rand_int_range (r, gen->min_path, gen->max_path + 1);
+
+    g_string_assign (gen->path, "C:\\");
+    for (int i = 3; i < len; i++)
+    {
+        if (i > 4 && i < len - 1 &&
+            gen->path->str[gen->path->len - 1] != '\\' &&
+            g_rand_int_range (r, 0, 10) == 0)
+            g_string_append_c (gen->path, '\\');
+        else
+            g_string_append (gen->path, g_ptr_array_index (gen->alphabet,
+                g_rand_int_range (r, 0, gen->alphabet->len)));
+    }
+
+    gen->filetime = (gen->now -
+        (int64_t) g_rand_int_range (r, 0, MAX_AGE_SECONDS) * G_USEC_PER_SEC)
+        * 10 + FILETIME_UNIX_EPOCH;
+    gen->filesize = g_rand_int_range (r, 0, 64 << 20);
+    gen->gone = g_rand_int_range (r, 0, 100) < GONE_PERCENT;
+
+    // Legacy path may take more bytes than characters
+    g_free (gen->legacy);
+    while (true)
+    {
+        gen->legacy = g_convert_with_iconv (gen->path->str, gen->path->len,
+            gen->to_legacy, NULL, &gen->legacy_len, NULL);
+        if (gen->legacy == NULL)
+            die ("Failed to convert path to legacy code page");
+        if (gen->legacy_len < WIN_PATH_MAX || gen->max_path >= WIN_PATH_MAX)
+            break;
+        g_free (gen->legacy);
+        g_string_truncate (gen->path, g_utf8_find_prev_char (gen->path->str,
+            gen->path->str + gen->path->len) - gen->path->str);
+    }
+
+    g_free (gen->unicode);
+    gen->unicode = g_convert_with_iconv (gen->path->str, gen->path->len,
+        gen->to_utf16, NULL, &gen->unicode_len, NULL);
+}
+
+
+static void
+generator_clear (generator  *gen)
+{
+    if (gen->rand)
+    {
+        g_rand_free (gen->rand);
+        g_rand_free (gen->junk);
+    }
+    g_ptr_array_free (gen->alphabet, TRUE);
+    g_iconv_close (gen->to_utf16);
+    g_iconv_close (gen->to_legacy);
+    g_string_free (gen->path, TRUE);
+    g_free (gen->legacy);
+    g_free (gen->unicode);
+}
+
+
+static FILE *
+open_output (const char  *path)
+{
+    FILE *fp = g_fopen (path, "wb");
+
+    if (fp == NULL)
+        die ("Can not create '%s': %s", path, g_strerror (errno));
+    return fp;
+}
+
+
+static void
+close_output (FILE        *fp,
+              const char  *path)
+{
+    if (ferror (fp) | fclose (fp))
+        die ("Failed writing '%s'", path);
+}
+
+
+static void
+write_info2 (generator           *gen,
+             const info2_variant *v,
+             const char          *path)
+{
+    FILE    *fp = open_output (path);
+    guchar   header[INFO2_HEADER_SIZE] = { 0 };
+    guchar  *buf = g_malloc (v->recordsize);
+    uint32_t sum = 0;
+
+    put_le32 (header, v->version);
+    put_le32 (header + 8, (uint32_t) n_records);  // total entry
+    put_le32 (header + 12, v->recordsize);
+    fwrite (header, sizeof (header), 1, fp);
+
+    generator_reset (gen, WIN_PATH_MAX - 1);
+    for (int i = 0; i < n_records; i++)
+    {
+        generator_next (gen);
+
+        // Junk remains after null terminators of paths
+        if (v->junk)
+            for (uint32_t j = 0; j < v->recordsize; j++)
+                buf[j] = (guchar) g_rand_int_range (gen->junk, 1, 256);
+        else
+            memset (buf, 0, v->recordsize);
+
+        memcpy (buf, gen->legacy, gen->legacy_len);
+        buf[gen->legacy_len] = '\0';
+        if (gen->gone)
+            buf[0] = '\0';
+        else
+            sum += gen->filesize;
+
+        put_le32 (buf + WIN_PATH_MAX, (uint32_t) i + 1);
+        put_le32 (buf + WIN_PATH_MAX + 4, 2);  // drive C
+        put_le64 (buf + WIN_PATH_MAX + 8, (uint64_t) gen->filetime);
+        put_le32 (buf + WIN_PATH_MAX + 16, gen->filesize);
+
+        if (v->recordsize == UNICODE_RECORD_SIZE)
+        {
+            guchar *u = buf + LEGACY_RECORD_SIZE;
+            memcpy (u, gen->unicode, gen->unicode_len);
+            u[gen->unicode_len] = u[gen->unicode_len + 1] = '\0';
+        }
+
+        fwrite (buf, v->recordsize, 1, fp);
+    }
+
+    put_le32 (header + INFO2_FILESIZE_SUM_OFS, sum);
+    fseek (fp, INFO2_FILESIZE_SUM_OFS, SEEK_SET);
+    fwrite (header + INFO2_FILESIZE_SUM_OFS, 4, 1, fp);
+
+    close_output (fp, path);
+    g_free (buf);
+}
+
+
+/* Index file names are unique, derived from record number */
+static void
+trash_name (char    *name,
+            char     prefix,
+            int      n)
+{
+    static const char digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    name[0] = '$';
+    name[1] = prefix;
+    for (int i = 7; i >= 2; i--, n /= 36)
+        name[i] = digits[n % 36];
+    strcpy (name + 8, ".dat");
+}
+
+
+static void
+write_dir (generator         *gen,
+           const dir_variant *v,
+           const char        *dir)
+{
+    GString  *buf = g_string_new (NULL);
+    char      name[16];
+
+    if (g_mkdir (dir, 0755) != 0)
+        die ("Can not create folder '%s': %s", dir, g_strerror (errno));
+
+    generator_reset (gen, v->version == 1 ? WIN_PATH_MAX - 1 : G_MAXINT);
+    for (int i = 0; i < n_records; i++)
+    {
+        char   *path;
+        FILE   *fp;
+        guchar  field[8];
+
+        generator_next (gen);
+
+        g_string_truncate (buf, 0);
+        put_le64 (field, v->version);
+        g_string_append_len (buf, (char *) field, 8);
+        put_le64 (field, gen->filesize);
+        g_string_append_len (buf, (char *) field, 8);
+        put_le64 (field, (uint64_t) gen->filetime);
+        g_string_append_len (buf, (char *) field, 8);
+        if (v->version == 2)
+        {
+            put_le32 (field, (uint32_t) gen->unicode_len / 2 + 1);
+            g_string_append_len (buf, (char *) field, 4);
+        }
+        g_string_append_len (buf, gen->unicode, gen->unicode_len);
+        g_string_append_len (buf, "\0\0", 2);
+        while (v->version == 1 &&
+            buf->len < VERSION1_FILENAME_OFFSET + WIN_PATH_MAX * 2)
+            g_string_append_c (buf, '\0');
+
+        trash_name (name, 'I', i);
+        path = g_build_filename (dir, name, NULL);
+        fp = open_output (path);
+        fwrite (buf->str, buf->len, 1, fp);
+        close_output (fp, path);
+        g_free (path);
+
+        if (v->payload && ! gen->gone)
+        {
+            trash_name (name, 'R', i);
+            path = g_build_filename (dir, name, NULL);
+            close_output (open_output (path), path);
+            g_free (path);
+        }
+    }
+
+    g_string_free (buf, TRUE);
+}
+
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext  *context;
+    GError          *error = NULL;
+    generator        gen = { 0 };
+    const char      *outdir;
+
+    context = g_option_context_new ("OUTDIR");
+    g_option_context_set_summary (context,
+        "Generate synthetic recycle bins for benchmarking");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (! g_option_context_parse (context, &argc, &argv, &error))
+        die ("%s", error->message);
+    g_option_context_free (context);
+
+    if (argc != 2)
+        die ("Exactly one output folder must be specified");
+    if (n_records < 0 || min_path < 4 || max_path < min_path)
+        die ("Invalid record count or path length range");
+    if (only_type && strcmp (only_type, "info2") != 0 &&
+        strcmp (only_type, "dir") != 0)
+        die ("Type must be either 'info2' or 'dir'");
+
+    outdir = argv[1];
+    if (g_file_test (outdir, G_FILE_TEST_EXISTS))
+        die ("Output folder '%s' already exists", outdir);
+    if (g_mkdir_with_parents (outdir, 0755) != 0)
+        die ("Can not create folder '%s': %s", outdir, g_strerror (errno));
+
+    generator_init (&gen, legacy_cp ? legacy_cp : "CP1252");
+
+    if (g_strcmp0 (only_type, "dir") != 0)
+        for (gsize i = 0; i < G_N_ELEMENTS (info2_variants); i++)
+        {
+            char *p = g_build_filename (outdir, info2_variants[i].name, NULL);
+            write_info2 (&gen, &info2_variants[i], p);
+            g_print ("%s\n", p);
+            g_free (p);
+        }
+
+    if (g_strcmp0 (only_type, "info2") != 0)
+        for (gsize i = 0; i < G_N_ELEMENTS (dir_variants); i++)
+        {
+            char *p = g_build_filename (outdir, dir_variants[i].name, NULL);
+            write_dir (&gen, &dir_variants[i], p);
+            g_print ("%s\n", p);
+            g_free (p);
+        }
+
+    generator_clear (&gen);
+    g_free (legacy_cp);
+    g_free (only_type);
+    return 0;
+}
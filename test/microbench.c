@@ -0,0 +1,669 @@
+/*
+ * Copyright (C) 2024, Abel Cheung
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+/*
+ * Time conversion and escaping helpers of the parsing library, and
+ * record emitters of programs, in isolation. Each kernel processes
+ * a fixed dataset of paths per iteration. After warmup, the number of iterations per sample is
+ * calibrated to last at least the minimum sample time, and result
+ * is summarized over all samples as time per item.
+ *
+ * Output of --save can be fed to --compare on a later run, so that
+ * effect of optimization is shown against the saved baseline.
+ * Baseline of source tree is kept in microbench-baseline.tsv.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "utils-cli.h"
+
+extern metarecord *meta;
+
+#define N_ITEMS  1000
+
+typedef struct
+{
+    GPtrArray   *unicode;          // GString, UTF-16LE
+    GPtrArray   *unicode_broken;   // with unpaired surrogates
+    GPtrArray   *unicode_ctrl;     // with unprintable chars
+    GPtrArray   *legacy;           // GString, CP932
+    GPtrArray   *legacy_broken;    // with invalid DBCS sequences
+    GPtrArray   *utf8;             // char *, for JSON escaping
+    GPtrArray   *delims;           // char *, delimiter option values
+    int64_t      filetimes[N_ITEMS];
+    volatile size_t sink;          // keeps results alive
+} dataset;
+
+typedef struct
+{
+    const char  *name;
+    void       (*func) (dataset *d);
+} kernel;
+
+typedef struct
+{
+    double       median;  // all in nanoseconds per item
+    double       min;
+    double       mean;
+    double       stddev;
+} summary;
+
+static int       n_samples   = 15;
+static int       min_time_ms = 20;
+static int       warmup_ms   = 100;
+static char     *only        = NULL;
+static char     *save_file   = NULL;
+static char     *compare_file = NULL;
+static gsize     printed     = 0;
+
+static const GOptionEntry entries[] = {
+    { "samples", 'n', 0, G_OPTION_ARG_INT, &n_samples,
+      "Number of timed samples per kernel (default 15)", "N" },
+    { "min-time", 0, 0, G_OPTION_ARG_INT, &min_time_ms,
+      "Minimum duration of each sample in ms (default 20)", "MS" },
+    { "warmup", 0, 0, G_OPTION_ARG_INT, &warmup_ms,
+      "Duration of warmup in ms (default 100)", "MS" },
+    { "filter", 0, 0, G_OPTION_ARG_STRING, &only,
+      "Only run kernels whose name contains TEXT", "TEXT" },
+    { "save", 0, 0, G_OPTION_ARG_FILENAME, &save_file,
+      "Save results to FILE as baseline", "FILE" },
+    { "compare", 0, 0, G_OPTION_ARG_FILENAME, &compare_file,
+      "Compare results with baseline saved in FILE", "FILE" },
+    { NULL }
+};
+
+
+/* Path components, in UTF-8 */
+static const char *words[] = {
+    "Documents and Settings", "Users", "Program Files", "Windows",
+    "Desktop", "My Documents", "report", "draft (1)", "photo_0012",
+    "résumé", "Übersicht", "下載", "デスクトップ", "資料夾",
+    "Ελληνικά", "Загрузки", "새 폴더", "it's", "a*b",
+};
+
+static const char *exts[] = {
+    ".txt", ".docx", ".jpg", ".exe", ".zip", "",
+};
+
+
+static char *
+_random_path   (GRand   *r)
+{
+    GString *s = g_string_new ("C:");
+    int      depth = g_rand_int_range (r, 1, 8);
+
+    for (int i = 0; i < depth; i++)
+    {
+        g_string_append_c (s, '\\');
+        g_string_append (s, words[g_rand_int_range (r, 0,
+            G_N_ELEMENTS (words))]);
+    }
+    g_string_append (s, exts[g_rand_int_range (r, 0, G_N_ELEMENTS (exts))]);
+    return g_string_free (s, FALSE);
+}
+
+
+static GString *
+_to_utf16 (const char  *utf8)
+{
+    glong       len;
+    gunichar2  *u = g_utf8_to_utf16 (utf8, -1, NULL, &len, NULL);
+    GString    *s = g_string_sized_new ((len + 1) * 2);
+
+    for (glong i = 0; i < len; i++)
+    {
+        guint16 c = GUINT16_TO_LE (u[i]);
+        g_string_append_len (s, (const char *) &c, 2);
+    }
+    g_string_append_len (s, "\0\0", 2);
+    g_free (u);
+    return s;
+}
+
+
+/* Overwrite random UTF-16 unit after drive letter */
+static void
+_poke_unit (GString  *s,
+            GRand    *r,
+            guint16   unit)
+{
+    gsize pos = 2 * g_rand_int_range (r, 2, MAX (3, s->len / 2 - 1));
+
+    unit = GUINT16_TO_LE (unit);
+    memcpy (s->str + pos, &unit, 2);
+}
+
+
+static GString *
+_to_cp932 (const char  *utf8)
+{
+    gsize   len;
+    char   *s = g_convert_with_fallback (utf8, -1, "CP932", "UTF-8",
+                    "?", NULL, &len, NULL);
+    GString *result = g_string_new_len (s, MIN (len, WIN_PATH_MAX - 1));
+
+    g_free (s);
+    return result;
+}
+
+
+static void
+_free_gstring (gpointer  s)
+{
+    g_string_free (s, TRUE);
+}
+
+
+static void
+dataset_init (dataset  *d)
+{
+    GRand *r = g_rand_new_with_seed (42);
+
+    d->unicode        = g_ptr_array_new_with_free_func (_free_gstring);
+    d->unicode_broken = g_ptr_array_new_with_free_func (_free_gstring);
+    d->unicode_ctrl   = g_ptr_array_new_with_free_func (_free_gstring);
+    d->legacy         = g_ptr_array_new_with_free_func (_free_gstring);
+    d->legacy_broken  = g_ptr_array_new_with_free_func (_free_gstring);
+    d->utf8           = g_ptr_array_new_with_free_func (g_free);
+    d->delims         = g_ptr_array_new_with_free_func (g_free);
+
+    for (int i = 0; i < N_ITEMS; i++)
+    {
+        char     *p = _random_path (r);
+        GString  *s;
+
+        g_ptr_array_add (d->unicode, _to_utf16 (p));
+
+        // Lone high or low surrogate, as seen on damaged files
+        s = _to_utf16 (p);
+        _poke_unit (s, r, g_rand_int_range (r, 0, 2) ? 0xD83D : 0xDE00);
+        g_ptr_array_add (d->unicode_broken, s);
+
+        s = _to_utf16 (p);
+        _poke_unit (s, r, g_rand_int_range (r, 1, 0x20));
+        _poke_unit (s, r, 0x200B);  // zero width space
+        g_ptr_array_add (d->unicode_ctrl, s);
+
+        g_ptr_array_add (d->legacy, _to_cp932 (p));
+
+        // Lead byte followed by byte invalid as trail byte
+        s = _to_cp932 (p);
+        if (s->len > 4)
+        {
+            gsize pos = g_rand_int_range (r, 2, s->len - 1);
+            s->str[pos] = (char) 0x81;
+            s->str[pos + 1] = (char) 0x7F;
+        }
+        g_ptr_array_add (d->legacy_broken, s);
+
+        g_ptr_array_add (d->utf8, p);
+
+        g_ptr_array_add (d->delims, g_strdup (
+            (const char *[]) { "\\t", "\\r\\n", " | ", "\\e[1m\\t" } [i % 4]));
+
+        d->filetimes[i] = 116444736000000000LL +
+            (int64_t) g_rand_int_range (r, 800000000, 1700000000) * 10000000;
+    }
+
+    g_rand_free (r);
+}
+
+
+/*
+ * Records of $Recycle.bin printed by emitters, using all fields
+ * as programs do by default. Only valid paths are used, since
+ * conversion error would be stored in record on every iteration.
+ */
+static void
+dataset_add_records (dataset  *d)
+{
+    GRand *r = g_rand_new_with_seed (42);
+
+    for (int i = 0; i < N_ITEMS; i++)
+    {
+        rbin_struct    *record = g_malloc0 (sizeof (rbin_struct));
+        const GString  *path = g_ptr_array_index (d->unicode, i);
+
+        record->version = VERSION_WIN10;
+        record->index_s = g_strdup_printf ("$I%06X%s", (guint) i,
+            exts[i % G_N_ELEMENTS (exts)]);
+        record->winfiletime = d->filetimes[i];
+        record->deltime = win_filetime_to_gdatetime (d->filetimes[i]);
+        record->filesize = g_rand_int_range (r, 0, G_MAXINT);
+        record->raw_uni_path = g_string_new_len (path->str, path->len);
+        record->gone = g_rand_int_range (r, 0, 2) ?
+            FILESTATUS_GONE : FILESTATUS_EXISTS;
+        g_ptr_array_add (meta->records, record);
+    }
+
+    g_rand_free (r);
+}
+
+
+static void
+dataset_clear (dataset  *d)
+{
+    g_ptr_array_free (d->unicode,        TRUE);
+    g_ptr_array_free (d->unicode_broken, TRUE);
+    g_ptr_array_free (d->unicode_ctrl,   TRUE);
+    g_ptr_array_free (d->legacy,         TRUE);
+    g_ptr_array_free (d->legacy_broken,  TRUE);
+    g_ptr_array_free (d->utf8,   TRUE);
+    g_ptr_array_free (d->delims, TRUE);
+}
+
+
+static char *
+_passthrough (const char  *src)
+{
+    return g_strdup (src);
+}
+
+
+static void
+_conv_all (dataset           *d,
+           GPtrArray         *paths,
+           const char        *enc,
+           out_fmt            fmt_type,
+           StrTransformFunc   func)
+{
+    for (guint i = 0; i < paths->len; i++)
+    {
+        char *s = conv_path_to_utf8_with_tmpl (
+            g_ptr_array_index (paths, i), enc, fmt_type, func, NULL, NULL);
+        d->sink += strlen (s);
+        g_free (s);
+    }
+}
+
+
+static void
+k_ucs2_bytelen (dataset  *d)
+{
+    for (guint i = 0; i < d->unicode->len; i++)
+    {
+        const GString *s = g_ptr_array_index (d->unicode, i);
+        d->sink += ucs2_bytelen (s->str, s->len);
+    }
+}
+
+
+static void
+k_conv_unicode (dataset  *d)
+{
+    _conv_all (d, d->unicode, NULL, FORMAT_TEXT, NULL);
+}
+
+
+static void
+k_conv_unicode_nofilter (dataset  *d)
+{
+    _conv_all (d, d->unicode, NULL, FORMAT_TEXT, _passthrough);
+}
+
+
+static void
+k_conv_unicode_broken (dataset  *d)
+{
+    _conv_all (d, d->unicode_broken, NULL, FORMAT_XML, NULL);
+}
+
+
+static void
+k_conv_unicode_ctrl (dataset  *d)
+{
+    _conv_all (d, d->unicode_ctrl, NULL, FORMAT_TEXT, NULL);
+}
+
+
+static void
+k_conv_unicode_json (dataset  *d)
+{
+    _conv_all (d, d->unicode, NULL, FORMAT_JSON, json_escape);
+}
+
+
+static void
+k_conv_legacy (dataset  *d)
+{
+    _conv_all (d, d->legacy, "CP932", FORMAT_TEXT, NULL);
+}
+
+
+static void
+k_conv_legacy_broken (dataset  *d)
+{
+    _conv_all (d, d->legacy_broken, "CP932", FORMAT_TEXT, NULL);
+}
+
+
+static void
+k_json_escape (dataset  *d)
+{
+    for (guint i = 0; i < d->utf8->len; i++)
+    {
+        char *s = json_escape (g_ptr_array_index (d->utf8, i));
+        d->sink += strlen (s);
+        g_free (s);
+    }
+}
+
+
+static void
+k_filter_escapes (dataset  *d)
+{
+    for (guint i = 0; i < d->delims->len; i++)
+    {
+        char *s = filter_escapes (g_ptr_array_index (d->delims, i));
+        d->sink += strlen (s);
+        g_free (s);
+    }
+}
+
+
+static void
+k_win_filetime (dataset  *d)
+{
+    for (int i = 0; i < N_ITEMS; i++)
+    {
+        GDateTime *dt = win_filetime_to_gdatetime (d->filetimes[i]);
+        d->sink += g_date_time_get_second (dt);
+        g_date_time_unref (dt);
+    }
+}
+
+
+/* Output of record emitters is only counted, not written */
+static void
+_count_printed (const gchar  *s)
+{
+    printed += strlen (s);
+}
+
+
+static void
+_print_records (dataset  *d,
+                out_fmt   format)
+{
+    GPrintFunc old = g_set_print_handler (_count_printed);
+
+    dump_records (format);
+    g_set_print_handler (old);
+    d->sink += printed;
+}
+
+
+static void
+k_print_text_record (dataset  *d)
+{
+    _print_records (d, FORMAT_TEXT);
+}
+
+
+static void
+k_print_xml_record (dataset  *d)
+{
+    _print_records (d, FORMAT_XML);
+}
+
+
+static void
+k_print_json_record (dataset  *d)
+{
+    _print_records (d, FORMAT_JSON);
+}
+
+
+/*
+ * Difference between conv_unicode and conv_unicode_nofilter is the
+ * cost of filtering unprintable chars, which is not exported
+ */
+static const kernel kernels[] = {
+    { "ucs2_bytelen",          k_ucs2_bytelen          },
+    { "conv_unicode",          k_conv_unicode          },
+    { "conv_unicode_nofilter", k_conv_unicode_nofilter },
+    { "conv_unicode_broken",   k_conv_unicode_broken   },
+    { "conv_unicode_ctrl",     k_conv_unicode_ctrl     },
+    { "conv_unicode_json",     k_conv_unicode_json     },
+    { "conv_legacy",           k_conv_legacy           },
+    { "conv_legacy_broken",    k_conv_legacy_broken    },
+    { "json_escape",           k_json_escape           },
+    { "filter_escapes",        k_filter_escapes        },
+    { "win_filetime",          k_win_filetime          },
+    { "print_text_record",     k_print_text_record     },
+    { "print_xml_record",      k_print_xml_record      },
+    { "print_json_record",     k_print_json_record     },
+};
+
+
+static int
+_cmp_double (const void  *a,
+             const void  *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+
+static summary
+run_kernel (const kernel  *k,
+            dataset       *d)
+{
+    double   *samples = g_new (double, n_samples);
+    summary   sum = { 0 };
+    gint64    start, elapsed;
+    gint64    iters = 0;
+    int       per_sample;
+
+    // Warmup, also finding how many iterations fill a sample
+    start = g_get_monotonic_time ();
+    do
+    {
+        k->func (d);
+        iters++;
+        elapsed = g_get_monotonic_time () - start;
+    }
+    while (elapsed < warmup_ms * 1000);
+
+    per_sample = (int) MAX (1, iters * min_time_ms * 1000 / MAX (1, elapsed));
+
+    for (int s = 0; s < n_samples; s++)
+    {
+        start = g_get_monotonic_time ();
+        for (int i = 0; i < per_sample; i++)
+            k->func (d);
+        elapsed = g_get_monotonic_time () - start;
+        samples[s] = elapsed * 1000.0 / ((double) per_sample * N_ITEMS);
+        sum.mean += samples[s];
+    }
+
+    sum.mean /= n_samples;
+    for (int s = 0; s < n_samples; s++)
+        sum.stddev += (samples[s] - sum.mean) * (samples[s] - sum.mean);
+    sum.stddev = n_samples > 1 ? sqrt (sum.stddev / (n_samples - 1)) : 0;
+
+    qsort (samples, n_samples, sizeof (double), _cmp_double);
+    sum.min = samples[0];
+    sum.median = (n_samples % 2) ? samples[n_samples / 2] :
+        (samples[n_samples / 2 - 1] + samples[n_samples / 2]) / 2;
+
+    g_free (samples);
+    return sum;
+}
+
+
+/* Empty $Recycle.bin is recognized by its desktop.ini */
+static char *
+_make_empty_bin (GError  **error)
+{
+    char  *dir, *ini;
+    bool   ok;
+
+    if (NULL == (dir = g_dir_make_tmp ("microbench-XXXXXX", error)))
+        return NULL;
+
+    ini = g_build_filename (dir, "desktop.ini", NULL);
+    ok = g_file_set_contents (ini,
+        "[.ShellClassInfo]\r\nCLSID={" RECYCLE_BIN_CLSID "}\r\n", -1, error);
+    g_free (ini);
+
+    if (! ok)
+    {
+        g_rmdir (dir);
+        g_clear_pointer (&dir, g_free);
+    }
+    return dir;
+}
+
+
+static void
+_remove_empty_bin (char  *dir)
+{
+    char *ini = g_build_filename (dir, "desktop.ini", NULL);
+
+    g_unlink (ini);
+    g_rmdir (dir);
+    g_free (ini);
+    g_free (dir);
+}
+
+
+/* Baseline is "name<TAB>median" per line */
+static GHashTable *
+load_baseline (const char  *path)
+{
+    GHashTable  *table;
+    char        *content, **lines;
+    GError      *error = NULL;
+
+    if (! g_file_get_contents (path, &content, NULL, &error))
+    {
+        g_printerr ("microbench: %s\n", error->message);
+        exit (1);
+    }
+
+    table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    lines = g_strsplit (content, "\n", -1);
+    for (char **l = lines; *l; l++)
+    {
+        char **f = g_strsplit (*l, "\t", 2);
+        if (f[0] && f[1] && **l != '#')
+        {
+            double *v = g_new (double, 1);
+            *v = g_ascii_strtod (f[1], NULL);
+            g_hash_table_insert (table, g_strdup (f[0]), v);
+        }
+        g_strfreev (f);
+    }
+    g_strfreev (lines);
+    g_free (content);
+    return table;
+}
+
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext  *context;
+    GError          *error = NULL;
+    GHashTable      *baseline = NULL;
+    GString         *saved;
+    dataset          d = { 0 };
+    char            *tmpdir, **cli_argv;
+
+    context = g_option_context_new (NULL);
+    g_option_context_set_summary (context,
+        "Time conversion and escaping helpers of rifiuti2 library");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (! g_option_context_parse (context, &argc, &argv, &error))
+    {
+        g_printerr ("microbench: %s\n", error->message);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (n_samples < 1 || min_time_ms < 0 || warmup_ms < 0)
+    {
+        g_printerr ("microbench: invalid sample count or duration\n");
+        return 1;
+    }
+
+    if (compare_file)
+        baseline = load_baseline (compare_file);
+
+    // Options of programs are left at defaults for record emitters
+    if (NULL == (tmpdir = _make_empty_bin (&error)))
+    {
+        g_printerr ("microbench: %s\n", error->message);
+        return 1;
+    }
+    cli_argv = g_new0 (char *, 3);
+    cli_argv[0] = g_strdup ("microbench");
+    cli_argv[1] = g_strdup (tmpdir);
+    if (! rifiuti_init (RECYCLE_BIN_TYPE_DIR, "", "", &cli_argv, &error))
+    {
+        g_printerr ("microbench: %s\n", error->message);
+        _remove_empty_bin (tmpdir);
+        return 1;
+    }
+    _remove_empty_bin (tmpdir);
+
+    dataset_init (&d);
+    dataset_add_records (&d);
+    saved = g_string_new ("# kernel\tmedian ns/item\n");
+
+    g_print ("%-24s%12s%12s%12s%10s", "Kernel", "Median(ns)", "Min(ns)",
+        "Mean(ns)", "Stddev");
+    g_print (baseline ? "%10s\n" : "\n", "Change");
+
+    for (gsize i = 0; i < G_N_ELEMENTS (kernels); i++)
+    {
+        summary  s;
+        double  *base;
+
+        if (only && ! strstr (kernels[i].name, only))
+            continue;
+
+        s = run_kernel (&kernels[i], &d);
+        g_print ("%-24s%12.1f%12.1f%12.1f%9.1f%%", kernels[i].name,
+            s.median, s.min, s.mean, s.stddev * 100 / s.mean);
+        if (baseline &&
+            (base = g_hash_table_lookup (baseline, kernels[i].name)))
+            g_print ("%+9.1f%%", (s.median - *base) * 100 / *base);
+        g_print ("\n");
+
+        {
+            char num[G_ASCII_DTOSTR_BUF_SIZE];
+            g_string_append_printf (saved, "%s\t%s\n", kernels[i].name,
+                g_ascii_formatd (num, sizeof (num), "%.2f", s.median));
+        }
+    }
+
+    if (save_file && ! g_file_set_contents (save_file, saved->str, -1, &error))
+    {
+        g_printerr ("microbench: %s\n", error->message);
+        return 1;
+    }
+
+    g_string_free (saved, TRUE);
+    if (baseline)
+        g_hash_table_destroy (baseline);
+    dataset_clear (&d);
+    rifiuti_cleanup (&error);
+    g_strfreev (cli_argv);
+    g_free (only);
+    g_free (save_file);
+    g_free (compare_file);
+    return 0;
+}
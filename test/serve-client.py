@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2024, Abel Cheung
+# rifiuti2 is released under Revised BSD License.
+# Please see LICENSE file for more info.
+#
+# Minimal client for server mode (--serve). Sends each request given
+# on command line, separated by '--next', over the same connection.
+# Output and error of requests are relayed to stdout and stderr,
+# and exit status of last request becomes exit status of client.
+
+import os
+import socket
+import struct
+import sys
+import time
+
+
+def recv_exact(sock, n):
+    buf = b''
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise EOFError('connection closed by server')
+        buf += chunk
+    return buf
+
+
+def run(sock, args):
+    payload = b''.join(os.fsencode(a) + b'\0' for a in args)
+    sock.sendall(b'R' + struct.pack('>I', len(payload)) + payload)
+    while True:
+        tag, size = struct.unpack('>cI', recv_exact(sock, 5))
+        data = recv_exact(sock, size)
+        if tag == b'O':
+            sys.stdout.buffer.write(data)
+        elif tag == b'E':
+            sys.stderr.buffer.write(data)
+        elif tag == b'X':
+            return struct.unpack('>i', data)[0]
+        else:
+            raise ValueError('unknown frame %r' % tag)
+
+
+def main():
+    path, argv = sys.argv[1], sys.argv[2:]
+    requests = [[]]
+    for a in argv:
+        if a == '--next':
+            requests.append([])
+        else:
+            requests[-1].append(a)
+
+    # Server may still be starting up
+    for _ in range(50):
+        if os.path.exists(path):
+            break
+        time.sleep(0.1)
+
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(path)
+        for req in requests:
+            code = run(sock, req)
+    sys.stdout.flush()
+    return code
+
+
+if __name__ == '__main__':
+    sys.exit(main())
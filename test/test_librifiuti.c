@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2024, Abel Cheung
+ * rifiuti2 is released under Revised BSD License.
+ * Please see LICENSE file for more info.
+ */
+
+/*
+ * Parse every recycle bin given on command line, once serially
+ * and then again concurrently with one thread per bin, several
+ * rounds at once. Results of both must be identical.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <glib.h>
+
+#include "librifiuti.h"
+
+#define ROUNDS 4
+
+typedef struct
+{
+    rbin_type    type;
+    const char  *path;
+    char        *digest;
+} job;
+
+
+/* Summarize records so that results can be compared */
+static char *
+parse_one (rbin_type    type,
+           const char  *path)
+{
+    r2_ctx             *ctx = r2_ctx_new (type);
+    r2_iter             iter;
+    const rbin_struct  *rec;
+    GError             *error = NULL;
+    GString            *s = g_string_new (NULL);
+
+    if (! r2_ctx_load (ctx, path, &error))
+    {
+        g_string_append_printf (s, "error: %s\n", error->message);
+        g_error_free (error);
+    }
+
+    r2_iter_init (&iter, ctx);
+    while ((rec = r2_iter_next (&iter)) != NULL)
+    {
+        char *p = r2_record_get_path (ctx, rec);
+        g_string_append_printf (s, "%" PRId64 "\t%" PRIu64
+            "\t%s\n", rec->winfiletime, rec->filesize, p ? p : "");
+        g_free (p);
+    }
+
+    r2_ctx_free (ctx);
+    return g_string_free (s, FALSE);
+}
+
+
+static gpointer
+run_job (gpointer data)
+{
+    job *j = data;
+    j->digest = parse_one (j->type, j->path);
+    return NULL;
+}
+
+
+int main (int argc, char **argv)
+{
+    rbin_type   type;
+    int         n = argc - 2, ret = 0;
+    char      **expected;
+    job        *jobs;
+    GThread   **threads;
+
+    if (argc < 3)
+    {
+        g_printerr ("Usage: %s info2|dir PATH...\n", argv[0]);
+        return 2;
+    }
+    type = strcmp (argv[1], "info2") ? RECYCLE_BIN_TYPE_DIR :
+        RECYCLE_BIN_TYPE_FILE;
+
+    expected = g_new0 (char *, n);
+    for (int i = 0; i < n; i++)
+        expected[i] = parse_one (type, argv[i + 2]);
+
+    jobs = g_new0 (job, n * ROUNDS);
+    threads = g_new0 (GThread *, n * ROUNDS);
+    for (int i = 0; i < n * ROUNDS; i++)
+    {
+        jobs[i].type = type;
+        jobs[i].path = argv[i % n + 2];
+        threads[i] = g_thread_new (NULL, run_job, &jobs[i]);
+    }
+
+    for (int i = 0; i < n * ROUNDS; i++)
+    {
+        g_thread_join (threads[i]);
+        if (strcmp (jobs[i].digest, expected[i % n]) != 0)
+        {
+            g_printerr ("Result mismatch for '%s':\n%s\n---\n%s",
+                jobs[i].path, expected[i % n], jobs[i].digest);
+            ret = 1;
+        }
+        g_free (jobs[i].digest);
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        if (ret == 0)
+            g_print ("%s", expected[i]);
+        g_free (expected[i]);
+    }
+    g_free (expected);
+    g_free (jobs);
+    g_free (threads);
+
+    return ret;
+}